@@ -1,1239 +1,1836 @@
+#define GL_GLEXT_PROTOTYPES	// framebuffer objects and timer queries
+
 #include <iostream>
 #include <fstream>
 #include <climits>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
 #include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <GL/freeglut.h>
+#include "glcounters.h"
 #include "loadTGA.h"
+#include "vecmath.h"
+#include "cradle.h"
+#include "metatravellers.h"
+#include "mesh.h"
+#include "mobius.h"
+#include "scenegraph.h"
+#include "scenefile.h"
+#include "jobs.h"
+#include "commandlist.h"
+#include "pipeline.h"
+#include "headless.h"
+#include "savePNG.h"
+#include "profiler.h"
+#include "inputlog.h"
+#include "camerapath.h"
+#include "capture.h"
+#include "resolution.h"
+#include "antialias.h"
+#include "probes.h"
+#include "particles.h"
+#include "collision.h"
+#include "processmemory.h"
+#include "lightmap.h"
 
 #define GL_CLAMP_TO_EDGE 0x812F // clamp to edge isn't defined by default
 
-#define PLANE_X 1000
-#define PLANE_Z 1000
-#define FLOOR_SCALE 8.0
 #define PLANE_BOUNDARY 100
-#define PLANE_TILE_SIZE 10
 #define MOVE_SPEED 1
 #define TURN_SPEED 1
 #define LOOK_HEIGHT 10
-
-#define MUSEUM_RADIUS 180
-#define MUSEUM_SIDES 6
-#define MUSEUM_PILLAR_SIDES 24
-#define METATRAVELLER_COUNT 72
+#define CAMERA_RADIUS 12		// the camera's body, a sphere on the floor below the eye
+#define FIELD_OF_VIEW 60
+#define NEAR_PLANE 10
+#define FAR_PLANE 5000
+#define WINDOW_SIZE 800
+
+#define SCENE_PATH "scenes/museum.scene"
+#define PIPELINE_DEPTH 2	// frames in flight, including the one on screen
+#define SIMULATION_STEP 10	// ms
+#define MAX_PREDICTED_STEPS 4	// furthest the camera is carried past its last step
+#define SCENE_LIGHTS 2	// GL_LIGHT2 and GL_LIGHT3 are the cradle spotlights
 #define METATRAVELLER_SPEED 2
 #define METATRAVELLER_SPIRALS 6
 #define MOBIUS_STRUP_RADIUS 20
-#define MOBIUS_STRIP_SPEED 1
-#define MOBIUS_STRIP_BALLS 3
+#define MOBIUS_STRIP_WIDTH 5
+#define MOBIUS_STRIP_SEGMENTS 144
+#define MOBIUS_STRIP_ROWS 4
 #define CRADLE_MAX_ANGLE 45
 #define CRADLE_LENGTH 40
+#define CRADLE_SPARK_SPEED 1	// rad/s lost in one step that counts as an impact
+#define DUST_CAPACITY 4096
+#define SPARK_CAPACITY 2048
 #define GRAVITY 9.80665
-
-#define deg2rad(deg) (deg * 4.0 * atan(1)) / 180
-#define rad2deg(rad) (180 * rad) / (4.0 * atan(1.0))
-#define clamp(val, min, max) val < min ? min : (val > max ? max : val)
-#define min(val1, val2) (val1 < val2 ? val1 : val2)
-#define max(val1, val2) (val1 > val2 ? val1 : val2)
+#define STRESS_CELL 500		// grid spacing of generated scenes; fits a museum and its pillars
+#define STRESS_FRAMES 30	// frames rendered at each step of --bench-stress
 
 using namespace std;
 
-typedef struct {
-	float x;
-	float y;
-	float z;
-} Vector;
-
 //-- Globals --------------------------------------------------------------
 float *x, *y, *z;		//vertex coordinate arrays
 int *t1, *t2, *t3;		//triangles
 int nvrt, ntri;			//total number of vertices and triangles
-int angle = 90;	    //Rotation angle for viewing
+float angle = 90;	    //Rotation angle for viewing
 float cam_hgt = 100;
 
 float cam_x = 0;
 float cam_y = 50;
-float cam_z = -PLANE_Z / 2;
-int moveForward = 0;
-int moveBack = 0;
-int turnLeft = 0;
-int turnRight = 0;
-float speedModifier = 1;
+float cam_z = 0;
+// Input is written on the GL thread and read by the simulation thread
+atomic<int> moveForward(0);
+atomic<int> moveBack(0);
+atomic<int> turnLeft(0);
+atomic<int> turnRight(0);
+atomic<float> speedModifier(1);
+
+Mesh floorMesh;
+Mesh museumWallMesh;
+Mesh museumPillarMesh;
+Mesh museumFloorMesh;
+Mesh platformMesh;
+Mesh skyboxMeshes[6];			// front, back, right, left, bottom, top
+Mesh boundaryMesh;
+
+typedef struct {
+	int node;					// exhibit root in the scene graph
+	const char* name;			// from the scene file
+	TravellerBatch batch;
+	vector<int> travellers;
+	vector<int> rings;
+} TravellerExhibit;
+
+typedef struct {
+	int node;
+	const char* name;
+	int strip;
+	vector<int> balls;
+	int reflection;				// cube map material of its probe, or -1
+} MobiusExhibit;
 
-Vector museumPillarVertices[MUSEUM_PILLAR_SIDES * 2];
-Vector museumPillarNormals[MUSEUM_PILLAR_SIDES * 2];
+typedef struct {
+	int node;
+	const char* name;
+	int balls[CRADLE_BALLS];	// the exhibit's index is its cradle in the shared batch
+	bool hasSpotlights;
+	int reflection;
+} CradleExhibit;
+
+const char* scenePath = SCENE_PATH;
+SceneFile sceneFile;
+const SceneMeshDesc* floorDesc;
+const SceneMeshDesc* platformDesc;
+const SceneMeshDesc* pillarDesc;
 
 float sceneTime = 0;
-int metatravellerAngles[METATRAVELLER_COUNT];
-bool metatravellerRingsEnabled = false;
+vector<TravellerExhibit> travellerExhibits;
+atomic<bool> metatravellerRingsEnabled(false);
 int mobiusStripBallAngle = 0;
-Vector mobiusStripVertices[74];
-Vector mobiusStripNormals[74];
-
-float cradleAngle = CRADLE_MAX_ANGLE;
+MobiusParams mobiusStripParams = { MOBIUS_STRUP_RADIUS, MOBIUS_STRIP_WIDTH, MOBIUS_STRIP_SEGMENTS, MOBIUS_STRIP_ROWS };
+MobiusStrip mobiusStrip;
+vector<MobiusExhibit> mobiusExhibits;
+
+CradleBatch cradle;
+vector<CradleExhibit> cradleExhibits;
+
+SceneGraph scene;
+Mat4 projection;
+Frustum viewFrustum;
+int museumNode = -1;			// the first museum, which has the ceiling light and the dust
+vector<int> museumNodes;		// every museum; later ones take the first one's shape
+int museumSides;
+float museumRadius;
+vector<int> museumWallNodes;	// inner and outer face per side, museum by museum; side 0 is the entrance
+vector<int> museumPillarNodes;	// museum by museum
+
+// The museums' walls, pillars and floors are lit by lightmaps baked at
+// load, unless they are turned off
+Lightmap lightmap;
+GLuint lightmapTexture = 0;		// 0 for dynamic lighting
+bool lightmapsEnabled = true;
+vector<int> museumWallCharts;	// lightmap chart per entry of museumWallNodes
+vector<int> museumPillarCharts;
+vector<int> museumFloorCharts;	// per museum
 
 float shadowColor[4] = {0.2, 0.2, 0.2, 1};
 
-GLuint texIds[9];
+vector<GLuint> texIds;			// one per scene material, then the probes' cube maps
+int skyboxMaterials[6];			// front, back, right, left, bottom, top
+int wallMaterial;
+int floorMaterial;
+int pillarMaterial;
+int particleMaterial;			// -1 when the scene has none, which turns particles off
 
-void calcMetatravellerAngles()
+typedef struct {
+	Mat4 matrix;				// view, times the shadow projection for shadow passes
+	bool isShadow;
+	bool isProbe;				// a reflection probe face; leaves out the reflective balls
+} RenderPass;
+
+// Render slots, recorded in parallel and replayed in this order
+#define SLOT_SKYBOX 0
+#define SLOT_FLOOR 1
+#define SLOT_MOBIUS_SHADOWS 2
+#define SLOT_MUSEUM_SHADOW 3
+#define SLOT_TRAVELLER_SHADOWS 4
+#define SLOT_MUSEUM 5
+#define SLOT_CEILING_LIGHT 6
+#define SLOT_EXHIBITS 7			// one per exhibit from here on, then the particles
+
+JobSystem jobs;
+vector<CommandList> frameLists;
+
+// Everything display needs from one simulation step. The simulation
+// thread owns 'scene' and the exhibits' animation state and publishes
+// a copy of them here; rendering only ever reads a published frame.
+typedef struct {
+	SceneGraph graph;
+	Vec3 eye;
+	Vec3 target;
+	float camX;					// keyboard camera after this step
+	float camZ;
+	float camAngle;
+	bool isFreeCamera;			// driven by live input, not a path or replay
+	bool ringsEnabled;
+	ParticleVertices dust;
+	ParticleVertices sparks;
+} FrameState;
+
+int pipelineDepth = PIPELINE_DEPTH;
+FramePipeline pipeline;
+vector<FrameState> frameStates;		// one per pipeline slot
+thread simulationThread;
+bool headless = false;				// rendering offscreen; the simulation runs unpaced
+
+Profiler profiler;
+const char* profilePath = 0;		// CSV, or a Chrome trace if it ends in .json
+bool profilerOverlayEnabled = false;
+const char* glBudgetPath = 0;		// headless runs fail when a frame's GL calls exceed it
+const FrameState* frameState;		// frame being recorded
+
+long simulationStep = 0;
+InputState simulationInput;			// input of the last step
+InputLog inputLog;
+const char* inputRecordPath = 0;
+const char* inputReplayPath = 0;
+CameraPath cameraPath;				// replaces the keyboard camera when it has keys
+const char* cameraPathName = 0;		// a canned path (see buildCannedCameraPath) or a file
+const char* cameraPathSavePath = 0;
+FrameCapture frameCapture;
+const char* capturePath = 0;			// an image sequence pattern or a raw video file
+DynamicResolution resolution;
+double resolutionTargetMs = 0;		// frame time to scale the resolution for; 0 renders at full size
+AntiAliasing antiAliasing;
+const char* antiAliasingOption = 0;	// see parseAntiAliasing; msaa4 in a window and off headless by default
+InputLatency inputLatency;
+bool perFrameInput = true;			// move the camera by the input at the start of each frame
+ReflectionProbes reflectionProbes;
+int probeFacesPerFrame = 2;			// 0 turns reflections off
+int probeSize = 64;
+vector<CommandList> probeLists;
+ParticlePool dustParticles;			// drifting in the ceiling light
+ParticleEmitter dustEmitter;
+ParticlePool sparkParticles;		// from cradle impacts
+ParticleEmitter sparkEmitter;
+vector<float> cradleBallSpeeds;		// [cradle * CRADLE_BALLS + ball] at the last step
+const char* particleMode = "on";	// on, sorted (dust drawn back to front) or off
+const char* meshOrderOption = 0;	// generated or optimised; either prints each mesh's ACMR at exit
+TriangleCollider sceneCollider;		// walls, pillars and platforms, which the camera cannot pass
+SphereCollider exhibitParts;		// moving parts, refitted from the frame being drawn when picking
+vector<int> exhibitPartNodes;		// scene graph node of each part
+vector<const char*> exhibitNames;	// by collider owner id
+int pickX = -1, pickY = -1;			// window position of a click waiting for the next frame
+
+InputState readInput()
 {
-	for (int i = 0; i < METATRAVELLER_COUNT; i++)
-	{
-		metatravellerAngles[i] = (metatravellerAngles[i] + METATRAVELLER_SPEED) % 360;
-	}
+	InputState input = { moveForward, moveBack, turnLeft, turnRight, speedModifier, metatravellerRingsEnabled };
+	return input;
 }
 
-void calculateCamPos()
+// Moves a camera by 'steps' simulation steps of the given input. Steps
+// may be fractional, which lets the renderer carry the camera on from
+// the last simulated step to the moment a frame is drawn.
+void moveCamera(float* x, float* z, float* heading, const InputState& input, float steps)
 {
-	angle = (angle + (360 + (TURN_SPEED * (turnLeft + turnRight)))) % 360;
-	cam_x += (cos(deg2rad(angle)) * MOVE_SPEED) * (moveForward + moveBack) * speedModifier;
-	cam_z += (sin(deg2rad(angle)) * MOVE_SPEED) * (moveForward + moveBack) * speedModifier;
+	*heading = fmod(*heading + 360 + TURN_SPEED * (input.left + input.right) * steps, 360);
+	float distance = MOVE_SPEED * (input.forward + input.back) * input.speed * steps;
+	Vec3 motion = vec3(cos(deg2rad(*heading)) * distance, 0, sin(deg2rad(*heading)) * distance);
+
+	// The body is swept, so the camera slides along walls and around
+	// pillars and platforms however far it moves in one go
+	Vec3 body = slideSphere(&sceneCollider, vec3(*x, CAMERA_RADIUS, *z), motion, CAMERA_RADIUS, vec3(0, 1, 0));
+	*x = body.x;
+	*z = body.z;
+
+	float planeX = floorDesc->params.floor.halfX, planeZ = floorDesc->params.floor.halfZ;
+	*x = clampf(*x, -planeX + PLANE_BOUNDARY, planeX - PLANE_BOUNDARY);
+	*z = clampf(*z, -planeZ + PLANE_BOUNDARY, planeZ - PLANE_BOUNDARY);
+}
 
-	cam_x = clamp(cam_x, -PLANE_X + PLANE_BOUNDARY, PLANE_X - PLANE_BOUNDARY);
-	cam_z = clamp(cam_z, -PLANE_Z + PLANE_BOUNDARY, PLANE_Z - PLANE_BOUNDARY);
+void calculateCamPos(const InputState& input)
+{
+	moveCamera(&cam_x, &cam_z, &angle, input, 1);
 }
 
-void timer(int value)
+void cameraLookAt(float x, float z, float heading, Vec3* eye, Vec3* target)
 {
-	calcMetatravellerAngles();
-	calculateCamPos();
-	mobiusStripBallAngle = (mobiusStripBallAngle + 1) % 720; 
-	cradleAngle = rad2deg(deg2rad(CRADLE_MAX_ANGLE) * cosf(sqrtf(GRAVITY / (CRADLE_LENGTH / 100.0)) * sceneTime));
-	sceneTime = fmod(sceneTime + 0.01, 360.0);
+	*eye = vec3(x, cam_y, z);
+	*target = vec3(x + cos(deg2rad(heading)) * 200, LOOK_HEIGHT, z + sin(deg2rad(heading)) * 200);
+}
 
-	glutPostRedisplay();
-	glutTimerFunc(10, timer, 0);
+// Copies this frame's animation into the scene graph's local transforms.
+// Only these nodes (and their children) are recomputed on the next update.
+void updateSceneAnimation()
+{
+	for (size_t e = 0; e < travellerExhibits.size(); e++)
+	{
+		TravellerExhibit* exhibit = &travellerExhibits[e];
+		for (size_t i = 0; i < exhibit->travellers.size(); i++)
+		{
+			Mat4 instance;
+			memcpy(instance.m, &exhibit->batch.instances[16 * i], sizeof(instance.m));
+			setLocalTransform(&scene, exhibit->travellers[i], instance);
+		}
+	}
+
+	for (size_t e = 0; e < mobiusExhibits.size(); e++)
+	{
+		const MobiusExhibit* exhibit = &mobiusExhibits[e];
+		float angleOffset = 720.0 / exhibit->balls.size();
+		for (size_t i = 0; i < exhibit->balls.size(); i++)
+		{
+			float ballAngle = mobiusStripBallAngle + i * angleOffset;
+			setLocalTransform(&scene, exhibit->balls[i], mat4Rotation(ballAngle, vec3(0, 1, 0))
+				* mat4Translation(vec3(0, 0, -MOBIUS_STRUP_RADIUS))
+				* mat4Rotation(-ballAngle / 2.0, vec3(1, 0, 0))
+				* mat4Translation(vec3(0, 2.5, 0)));
+		}
+	}
+
+	for (size_t e = 0; e < cradleExhibits.size(); e++)
+	{
+		for (int i = 0; i < CRADLE_BALLS; i++)
+		{
+			setLocalTransform(&scene, cradleExhibits[e].balls[i], mat4Translation(vec3((i - CRADLE_BALLS / 2) * CRADLE_BALL_SPACING, CRADLE_LENGTH, 0))
+				* mat4Rotation(rad2deg(cradle.angles[i][e]), vec3(0, 0, 1))
+				* mat4Translation(vec3(0, -CRADLE_LENGTH, 0)));
+		}
+	}
 }
 
-void rotateVectorX(Vector* vec, float rot)
+// The graph is only brought up to date when a frame is captured, so a
+// ball's position this step comes from its static pendulum root and the
+// local transform updateSceneAnimation has just set from its angle
+Vec3 cradleBallPosition(int node)
 {
-	Vector newVec =
+	return mat4GetTranslation(worldMatrix(&scene, scene.parent[node]) * scene.local[node]);
+}
+
+// A ball that suddenly loses speed has struck its neighbour; sparks
+// fly from the point of contact
+void emitCradleSparks()
+{
+	cradleBallSpeeds.resize(cradleExhibits.size() * CRADLE_BALLS);
+	for (size_t c = 0; c < cradleExhibits.size(); c++)
 	{
-		vec->x,
-		(cosf(deg2rad(rot)) * vec->y) - (sinf(deg2rad(rot)) * vec->z),
-		(sinf(deg2rad(rot)) * vec->y) + (cosf(deg2rad(rot)) * vec->z),
-	};
-	vec->x = newVec.x;
-	vec->y = newVec.y;
-	vec->z = newVec.z;
+		for (int b = 0; b < CRADLE_BALLS; b++)
+		{
+			float speed = fabs(cradle.velocities[b][c]);
+			float* last = &cradleBallSpeeds[c * CRADLE_BALLS + b];
+			if (*last - speed > CRADLE_SPARK_SPEED)
+			{
+				int neighbour = b < CRADLE_BALLS / 2 ? b + 1 : b - 1;
+				Vec3 ball = cradleBallPosition(cradleExhibits[c].balls[b]);
+				Vec3 towards = cradleBallPosition(cradleExhibits[c].balls[neighbour]) - ball;
+				sparkEmitter.position = ball + towards * (CRADLE_BALL_RADIUS / max(length(towards), 0.01f));
+				spawnParticles(&sparkParticles, &sparkEmitter, 60);
+			}
+			*last = speed;
+		}
+	}
 }
 
-void rotateVectorY(Vector* vec, float rot)
+void stepParticles(float elapsed)
 {
-	Vector newVec =
+	if (particleMaterial < 0) return;
+	if (museumNode >= 0) emitParticles(&dustParticles, &dustEmitter, elapsed);
+	emitCradleSparks();
+	advanceParticles(&dustParticles, elapsed);
+	advanceParticles(&sparkParticles, elapsed);
+}
+
+// Input is sampled once per step, which is what makes logs replay exactly
+void stepSimulation()
+{
+	InputState input = readInput();
+	replayInput(&inputLog, simulationStep, &input);
+	recordInput(&inputLog, simulationStep, input);
+	simulationInput = input;
+
+	for (size_t e = 0; e < travellerExhibits.size(); e++)
 	{
-		(cosf(deg2rad(rot)) * vec->x) + (sinf(deg2rad(rot)) * vec->z),
-		vec->y,
-		-(sinf(deg2rad(rot)) * vec->x) + (cosf(deg2rad(rot)) * vec->z),
-	};
-	vec->x = newVec.x;
-	vec->y = newVec.y;
-	vec->z = newVec.z;
+		advanceTravellers(&travellerExhibits[e].batch, 0.01);
+	}
+	calculateCamPos(input);
+	mobiusStripBallAngle = (mobiusStripBallAngle + 1) % 720; 
+	advanceCradles(&cradle, 0.01);
+	sceneTime = fmod(sceneTime + 0.01, 360.0);
+	updateSceneAnimation();
+	stepParticles(0.01);
+	simulationStep++;
 }
 
-void rotateVectorZ(Vector* vec, float rot)
+// Brings the simulation's scene graph up to date and copies out what
+// recording reads: world matrices and bounds. Assignment reuses the
+// slot's storage once it has grown to the graph's size.
+void captureFrameState(FrameState* state)
 {
-	Vector newVec =
+	updateSceneGraph(&scene);
+	state->graph.world = scene.world;
+	state->graph.worldCentre = scene.worldCentre;
+	state->graph.worldRadius = scene.worldRadius;
+	state->graph.boundsRadius = scene.boundsRadius;
+	state->ringsEnabled = simulationInput.rings;
+	state->camX = cam_x;
+	state->camZ = cam_z;
+	state->camAngle = angle;
+	state->isFreeCamera = cameraPath.keys.empty() && !inputLog.isReplaying;
+	if (!cameraPath.keys.empty())
 	{
-		(cosf(deg2rad(rot)) * vec->x) - (sinf(deg2rad(rot)) * vec->y),
-		(sinf(deg2rad(rot)) * vec->x) + (cosf(deg2rad(rot)) * vec->y),
-		vec->z,
-	};
-	vec->x = newVec.x;
-	vec->y = newVec.y;
-	vec->z = newVec.z;
+		evaluateCameraPath(&cameraPath, simulationStep * (SIMULATION_STEP / 1000.0), &state->eye, &state->target);
+	}
+	else cameraLookAt(cam_x, cam_z, angle, &state->eye, &state->target);
+
+	bool isSorted = strcmp(particleMode, "sorted") == 0;
+	writeParticleVertices(&dustParticles, &state->dust, isSorted ? &state->eye : 0);
+	writeParticleVertices(&sparkParticles, &state->sparks);
 }
 
-void normalise(Vector* vec)
+// Steps the simulation every SIMULATION_STEP ms and publishes each step,
+// waiting whenever the renderer is pipelineDepth frames behind. A late
+// step is not caught up, so the simulation slows down with the renderer
+// rather than queueing stale frames.
+void simulationWorker()
 {
-	float n = 0;
-	if (vec->x >= vec->y && vec->x >= vec->z)
+	auto next = chrono::steady_clock::now();
+	while (true)
 	{
-		n = vec->x;
+		int slot = beginFrameWrite(&pipeline);
+		if (slot < 0) return;
+		if (!headless) this_thread::sleep_until(next);
+		next = max(next + chrono::milliseconds(SIMULATION_STEP), chrono::steady_clock::now());
+
+		FrameTime sampled = chrono::steady_clock::now();
+		stepSimulation();
+		captureFrameState(&frameStates[slot]);
+		publishFrame(&pipeline, slot, sampled);
 	}
-	else if (vec->y >= vec->x && vec->y >= vec->z)
+}
+
+void startSimulation()
+{
+	initialiseFramePipeline(&pipeline, pipelineDepth);
+	frameStates.resize(pipeline.depth);
+	simulationThread = thread(simulationWorker);
+}
+
+// Calls fn(name, mesh) for each generated mesh, including the
+// primitives built so far
+template <typename Fn>
+void forEachSceneMesh(Fn fn)
+{
+	static const char* primitiveNames[5] = { "sphere", "cylinder", "cone", "torus", "cube" };
+	fn("floor", &floorMesh);
+	fn("boundary", &boundaryMesh);
+	fn("skybox face", &skyboxMeshes[0]);
+	if (museumNode >= 0)
 	{
-		n = vec->y;
+		fn("museum wall", &museumWallMesh);
+		fn("museum floor", &museumFloorMesh);
 	}
-	else
+	fn("pillar", &museumPillarMesh);
+	fn("platform", &platformMesh);
+	fn("mobius strip", &mobiusStrip.mesh);
+	for (size_t i = 0; i < primitiveMeshes.size(); i++)
 	{
-		n = vec->z;
+		const PrimitiveMesh* p = &primitiveMeshes[i];
+		char name[64];
+		if (p->type == PRIMITIVE_CUBE) snprintf(name, sizeof(name), "%s", primitiveNames[p->type]);
+			else snprintf(name, sizeof(name), "%s %dx%d", primitiveNames[p->type], p->slices, p->stacks);
+		fn(name, &p->mesh);
 	}
-	if (n == 0) n = 1;
+}
 
-	vec->x = vec->x / n;
-	vec->y = vec->y / n;
-	vec->z = vec->z / n;
+void printMeshPackings()
+{
+	cout << "packed vertices:" << endl;
+	forEachSceneMesh(printMeshPacking);
 }
 
-Vector normal(Vector v1, Vector v2, Vector v3)
+void printMeshOrders()
 {
-	float x1 = v1.x, x2 = v2.x, x3 = v3.x;
-	float y1 = v1.y, y2 = v2.y, y3 = v3.y;
-	float z1 = v1.z, z2 = v2.z, z3 = v3.z;
-	float nx, ny, nz;
-	nx = y1*(z2-z3) + y2*(z3-z1) + y3*(z1-z2);
-	ny = z1*(x2-x3) + z2*(x3-x1) + z3*(x1-x2);
-	nz = x1*(y2-y3) + x2*(y3-y1) + x3*(y1-y2);
-	glNormal3f(nx, ny, nz);
-	return { nx, ny, nz };
+	cout << "vertex cache (" << (meshIndexOrder == MESH_ORDER_OPTIMISED ? "optimised" : "generated") << " order, FIFO "
+		<< MESH_CACHE_SIZE << "):" << endl;
+	forEachSceneMesh(printMeshOrder);
 }
 
-void loadTextures()
+// Threads must be joined before exit, or their destructors terminate
+void shutdown()
 {
-	glGenTextures(9, texIds);
-
-	// Skybox Front
-	glBindTexture(GL_TEXTURE_2D, texIds[0]);
-	loadTGA("textures/skybox/Front.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Skybox Back
-	glBindTexture(GL_TEXTURE_2D, texIds[1]);
-	loadTGA("textures/skybox/Back.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Skybox Right
-	glBindTexture(GL_TEXTURE_2D, texIds[2]);
-	loadTGA("textures/skybox/Right.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Skybox Left
-	glBindTexture(GL_TEXTURE_2D, texIds[3]);
-	loadTGA("textures/skybox/Left.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Skybox Bottom
-	glBindTexture(GL_TEXTURE_2D, texIds[4]);
-	loadTGA("textures/skybox/Bottom.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Skybox Top
-	glBindTexture(GL_TEXTURE_2D, texIds[5]);
-	loadTGA("textures/skybox/Top.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	// Brick
-	glBindTexture(GL_TEXTURE_2D, texIds[6]);
-	ImageData brick1024 = loadTGAImageData("textures/brick/brick1024.tga");
-	ImageData brick512 = loadTGAImageData("textures/brick/brick512.tga");
-	ImageData brick256 = loadTGAImageData("textures/brick/brick256.tga");
-	ImageData brick128 = loadTGAImageData("textures/brick/brick128.tga");
-	ImageData brick64 = loadTGAImageData("textures/brick/brick64.tga");
-	ImageData brick32 = loadTGAImageData("textures/brick/brick32.tga");
-	ImageData brick16 = loadTGAImageData("textures/brick/brick16.tga");
-	ImageData brick8 = loadTGAImageData("textures/brick/brick8.tga");
-	ImageData brick4 = loadTGAImageData("textures/brick/brick4.tga");
-	ImageData brick2 = loadTGAImageData("textures/brick/brick2.tga");
-	ImageData brick1 = loadTGAImageData("textures/brick/brick1.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, brick1024.nbytes, brick1024.width, brick1024.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick1024.data);
-	glTexImage2D(GL_TEXTURE_2D, 1, brick512.nbytes, brick512.width, brick512.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick512.data);
-	glTexImage2D(GL_TEXTURE_2D, 2, brick256.nbytes, brick256.width, brick256.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick256.data);
-	glTexImage2D(GL_TEXTURE_2D, 3, brick128.nbytes, brick128.width, brick128.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick128.data);
-	glTexImage2D(GL_TEXTURE_2D, 4, brick64.nbytes, brick64.width, brick64.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick64.data);
-	glTexImage2D(GL_TEXTURE_2D, 5, brick32.nbytes, brick32.width, brick32.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick32.data);
-	glTexImage2D(GL_TEXTURE_2D, 6, brick16.nbytes, brick16.width, brick16.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick16.data);
-	glTexImage2D(GL_TEXTURE_2D, 7, brick8.nbytes, brick8.width, brick8.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick8.data);
-	glTexImage2D(GL_TEXTURE_2D, 8, brick4.nbytes, brick4.width, brick4.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick4.data);
-	glTexImage2D(GL_TEXTURE_2D, 9, brick2.nbytes, brick2.width, brick2.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick2.data);
-	glTexImage2D(GL_TEXTURE_2D, 10, brick1.nbytes, brick1.width, brick1.height, 0, GL_RGB, GL_UNSIGNED_BYTE, brick1.data);
-	delete brick1024.data;
-	delete brick512.data;
-	delete brick256.data;
-	delete brick128.data;
-	delete brick64.data;
-	delete brick32.data;
-	delete brick16.data;
-	delete brick8.data;
-	delete brick4.data;
-	delete brick2.data;
-	delete brick1.data;
-
-	// Concrete
-	glBindTexture(GL_TEXTURE_2D, texIds[7]);
-	ImageData concrete1024 = loadTGAImageData("textures/concrete/concrete1024.tga");
-	ImageData concrete512 = loadTGAImageData("textures/concrete/concrete512.tga");
-	ImageData concrete256 = loadTGAImageData("textures/concrete/concrete256.tga");
-	ImageData concrete128 = loadTGAImageData("textures/concrete/concrete128.tga");
-	ImageData concrete64 = loadTGAImageData("textures/concrete/concrete64.tga");
-	ImageData concrete32 = loadTGAImageData("textures/concrete/concrete32.tga");
-	ImageData concrete16 = loadTGAImageData("textures/concrete/concrete16.tga");
-	ImageData concrete8 = loadTGAImageData("textures/concrete/concrete8.tga");
-	ImageData concrete4 = loadTGAImageData("textures/concrete/concrete4.tga");
-	ImageData concrete2 = loadTGAImageData("textures/concrete/concrete2.tga");
-	ImageData concrete1 = loadTGAImageData("textures/concrete/concrete1.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, concrete1024.nbytes, concrete1024.width, concrete1024.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete1024.data);
-	glTexImage2D(GL_TEXTURE_2D, 1, concrete512.nbytes, concrete512.width, concrete512.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete512.data);
-	glTexImage2D(GL_TEXTURE_2D, 2, concrete256.nbytes, concrete256.width, concrete256.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete256.data);
-	glTexImage2D(GL_TEXTURE_2D, 3, concrete128.nbytes, concrete128.width, concrete128.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete128.data);
-	glTexImage2D(GL_TEXTURE_2D, 4, concrete64.nbytes, concrete64.width, concrete64.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete64.data);
-	glTexImage2D(GL_TEXTURE_2D, 5, concrete32.nbytes, concrete32.width, concrete32.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete32.data);
-	glTexImage2D(GL_TEXTURE_2D, 6, concrete16.nbytes, concrete16.width, concrete16.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete16.data);
-	glTexImage2D(GL_TEXTURE_2D, 7, concrete8.nbytes, concrete8.width, concrete8.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete8.data);
-	glTexImage2D(GL_TEXTURE_2D, 8, concrete4.nbytes, concrete4.width, concrete4.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete4.data);
-	glTexImage2D(GL_TEXTURE_2D, 9, concrete2.nbytes, concrete2.width, concrete2.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete2.data);
-	glTexImage2D(GL_TEXTURE_2D, 10, concrete1.nbytes, concrete1.width, concrete1.height, 0, GL_RGB, GL_UNSIGNED_BYTE, concrete1.data);
-	delete concrete1024.data;
-	delete concrete512.data;
-	delete concrete256.data;
-	delete concrete128.data;
-	delete concrete64.data;
-	delete concrete32.data;
-	delete concrete16.data;
-	delete concrete8.data;
-	delete concrete4.data;
-	delete concrete2.data;
-	delete concrete1.data;
-
-	// Sediment
-	glBindTexture(GL_TEXTURE_2D, texIds[8]);
-	ImageData sediment1024 = loadTGAImageData("textures/sediment/sediment1024.tga");
-	ImageData sediment512 = loadTGAImageData("textures/sediment/sediment512.tga");
-	ImageData sediment256 = loadTGAImageData("textures/sediment/sediment256.tga");
-	ImageData sediment128 = loadTGAImageData("textures/sediment/sediment128.tga");
-	ImageData sediment64 = loadTGAImageData("textures/sediment/sediment64.tga");
-	ImageData sediment32 = loadTGAImageData("textures/sediment/sediment32.tga");
-	ImageData sediment16 = loadTGAImageData("textures/sediment/sediment16.tga");
-	ImageData sediment8 = loadTGAImageData("textures/sediment/sediment8.tga");
-	ImageData sediment4 = loadTGAImageData("textures/sediment/sediment4.tga");
-	ImageData sediment2 = loadTGAImageData("textures/sediment/sediment2.tga");
-	ImageData sediment1 = loadTGAImageData("textures/sediment/sediment1.tga");
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, sediment1024.nbytes, sediment1024.width, sediment1024.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment1024.data);
-	glTexImage2D(GL_TEXTURE_2D, 1, sediment512.nbytes, sediment512.width, sediment512.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment512.data);
-	glTexImage2D(GL_TEXTURE_2D, 2, sediment256.nbytes, sediment256.width, sediment256.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment256.data);
-	glTexImage2D(GL_TEXTURE_2D, 3, sediment128.nbytes, sediment128.width, sediment128.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment128.data);
-	glTexImage2D(GL_TEXTURE_2D, 4, sediment64.nbytes, sediment64.width, sediment64.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment64.data);
-	glTexImage2D(GL_TEXTURE_2D, 5, sediment32.nbytes, sediment32.width, sediment32.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment32.data);
-	glTexImage2D(GL_TEXTURE_2D, 6, sediment16.nbytes, sediment16.width, sediment16.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment16.data);
-	glTexImage2D(GL_TEXTURE_2D, 7, sediment8.nbytes, sediment8.width, sediment8.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment8.data);
-	glTexImage2D(GL_TEXTURE_2D, 8, sediment4.nbytes, sediment4.width, sediment4.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment4.data);
-	glTexImage2D(GL_TEXTURE_2D, 9, sediment2.nbytes, sediment2.width, sediment2.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment2.data);
-	glTexImage2D(GL_TEXTURE_2D, 10, sediment1.nbytes, sediment1.width, sediment1.height, 0, GL_RGB, GL_UNSIGNED_BYTE, sediment1.data);
-	delete sediment1024.data;
-	delete sediment512.data;
-	delete sediment256.data;
-	delete sediment128.data;
-	delete sediment64.data;
-	delete sediment32.data;
-	delete sediment16.data;
-	delete sediment8.data;
-	delete sediment4.data;
-	delete sediment2.data;
-	delete sediment1.data;
-}
-
-void drawSkybox()
-{
-	glEnable(GL_TEXTURE_2D);
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	float skyBoxScale = 2 * (PLANE_X >= PLANE_Z ? PLANE_X : PLANE_Z);
-	glPushMatrix();
-		// glTranslatef(0, skyBoxScale - 0.1, 0);
-		// FRONT
-		glBindTexture(GL_TEXTURE_2D, texIds[0]);
-		glBegin(GL_QUADS);
-		glNormal3f(0, 0, -1);
-		glTexCoord2f(0, 0);
-		glVertex3f(skyBoxScale, -skyBoxScale, skyBoxScale); // bottom left
-		glTexCoord2f(1, 0);
-		glVertex3f(-skyBoxScale, -skyBoxScale, skyBoxScale); // bottom right
-		glTexCoord2f(1, 1);
-		glVertex3f(-skyBoxScale, skyBoxScale, skyBoxScale); // top right
-		glTexCoord2f(0, 1);
-		glVertex3f(skyBoxScale, skyBoxScale, skyBoxScale); // top left
-		glEnd();
-		
-		// BACK
-		glBindTexture(GL_TEXTURE_2D, texIds[1]);
-		glBegin(GL_QUADS);
-		glNormal3f(0, 0, 1);
-		glTexCoord2f(0, 0);
-		glVertex3f(-skyBoxScale, -skyBoxScale, -skyBoxScale); // bottom left
-		glTexCoord2f(1, 0);
-		glVertex3f(skyBoxScale, -skyBoxScale, -skyBoxScale); // bottom right
-		glTexCoord2f(1, 1);
-		glVertex3f(skyBoxScale, skyBoxScale, -skyBoxScale); // top right
-		glTexCoord2f(0, 1);
-		glVertex3f(-skyBoxScale, skyBoxScale, -skyBoxScale); // top left
-		glEnd();
-		
-		// LEFT
-		glBindTexture(GL_TEXTURE_2D, texIds[2]);
-		glBegin(GL_QUADS);
-		glNormal3f(-1, 0, 0);
-		glTexCoord2f(0, 0);
-		glVertex3f(skyBoxScale, -skyBoxScale, -skyBoxScale); // bottom left
-		glTexCoord2f(1, 0);
-		glVertex3f(skyBoxScale, -skyBoxScale, skyBoxScale); // bottom right
-		glTexCoord2f(1, 1);
-		glVertex3f(skyBoxScale, skyBoxScale, skyBoxScale); // top right
-		glTexCoord2f(0, 1);
-		glVertex3f(skyBoxScale, skyBoxScale, -skyBoxScale); // top left
-		glEnd();
-		
-		// RIGHT
-		glBindTexture(GL_TEXTURE_2D, texIds[3]);
-		glBegin(GL_QUADS);
-		glNormal3f(1, 0, 0);
-		glTexCoord2f(0, 0);
-		glVertex3f(-skyBoxScale, -skyBoxScale, skyBoxScale); // bottom left
-		glTexCoord2f(1, 0);
-		glVertex3f(-skyBoxScale, -skyBoxScale, -skyBoxScale); // bottom right
-		glTexCoord2f(1, 1);
-		glVertex3f(-skyBoxScale, skyBoxScale, -skyBoxScale); // top right
-		glTexCoord2f(0, 1);
-		glVertex3f(-skyBoxScale, skyBoxScale, skyBoxScale); // top left
-		glEnd();
-		
-		// BOTTOM
-		glBindTexture(GL_TEXTURE_2D, texIds[4]);
-		glBegin(GL_QUADS);
-		glNormal3f(0, 1, 0);
-		glTexCoord2f(0, 0);
-		glVertex3f(-skyBoxScale, -skyBoxScale, skyBoxScale); // bottom left
-		glTexCoord2f(0, 1);
-		glVertex3f(-skyBoxScale, -skyBoxScale, -skyBoxScale); // bottom right
-		glTexCoord2f(1, 1);
-		glVertex3f(skyBoxScale, -skyBoxScale, -skyBoxScale); // top right
-		glTexCoord2f(1, 0);
-		glVertex3f(skyBoxScale, -skyBoxScale, skyBoxScale); // top left
-		glEnd();
-		
-		// TOP
-		glBindTexture(GL_TEXTURE_2D, texIds[5]);
-		glBegin(GL_QUADS);
-		glNormal3f(0, -1, 0);
-		glTexCoord2f(0, 0);
-		glVertex3f(-skyBoxScale, skyBoxScale, -skyBoxScale); // bottom left
-		glTexCoord2f(1, 0);
-		glVertex3f(-skyBoxScale, skyBoxScale, skyBoxScale); // bottom right
-		glTexCoord2f(1, 1);
-		glVertex3f(skyBoxScale, skyBoxScale, skyBoxScale); // top right
-		glTexCoord2f(0, 1);
-		glVertex3f(skyBoxScale, skyBoxScale, -skyBoxScale); // top left
-		glEnd();
-	glPopMatrix();
+	stopFramePipeline(&pipeline);
+	if (simulationThread.joinable()) simulationThread.join();
+	shutdownJobSystem(&jobs);
+	reportInputLatency(&inputLatency, 1);
+	finishCapture(&frameCapture);
+	destroyDynamicResolution(&resolution);
+	releaseAntiAliasing(&antiAliasing);
+	destroyReflectionProbes(&reflectionProbes);
+	shutdownProfiler(&profiler);
+	if (meshVertexFormat == MESH_FORMAT_PACKED) printMeshPackings();
+	if (meshOrderOption) printMeshOrders();
 }
 
-//----------draw a floor plane-------------------
-void drawFloor()
-{
-	glDisable(GL_LIGHTING);
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glPushMatrix();
-		glBindTexture(GL_TEXTURE_2D, texIds[7]);
-		glColor3f(1, 1, 1);
-		glBegin(GL_QUADS);
-		glNormal3f(0, 1, 0);
-		for(int x = -PLANE_X; x <= PLANE_X; x += PLANE_TILE_SIZE)
+void timer(int value)
+{
+	glutPostRedisplay();
+	glutTimerFunc(SIMULATION_STEP, timer, 0);
+}
+
+// Image file for a material's mip level; 'out' holds 256 characters
+const char* materialImagePath(const SceneMaterialDesc* material, int level, char* out)
+{
+	const char* path = sceneString(&sceneFile, material->path);
+	if (material->params.texture.mipmaps <= 1) return path;
+	snprintf(out, 256, path, max((int)material->params.texture.size >> level, 1));
+	return out;
+}
+
+// Loads every scene material in file order. Mipmapped materials read one
+// file per level, substituting the level's size into the path.
+// Every image is decoded into one arena, sized up front from the files'
+// headers to the largest of them, so loading allocates a single buffer
+void loadTextures()
+{
+	int count = sceneFile.header->materialCount;
+	texIds.resize(count);
+	glGenTextures(count, texIds.data());
+	ProcessMemory before = readProcessMemory();
+	auto start = chrono::steady_clock::now();
+
+	char path[256];
+	int largest = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const SceneMaterialDesc* material = &sceneFile.materials[i];
+		for (int level = 0; level < (int)material->params.texture.mipmaps; level++)
+		{
+			largest = max(largest, tgaImageSize(materialImagePath(material, level, path)));
+		}
+	}
+	ImageArena arena = { ImageData(), 0, 0 };
+	reserveImageArena(&arena, largest);
+
+	for (int i = 0; i < count; i++)
+	{
+		const SceneMaterialDesc* material = &sceneFile.materials[i];
+		glBindTexture(GL_TEXTURE_2D, texIds[i]);
+
+		int mipmaps = (int)material->params.texture.mipmaps;
+		if (mipmaps > 1)
 		{
-			for(int z = -PLANE_Z; z <= PLANE_Z; z += PLANE_TILE_SIZE)
+			for (int level = 0; level < mipmaps; level++)
 			{
-				glTexCoord2f(((x / PLANE_TILE_SIZE) + 0) / FLOOR_SCALE, ((z / PLANE_TILE_SIZE) + 0) / FLOOR_SCALE);
-				glVertex3f(x, 0, z);
-				
-				glTexCoord2f(((x / PLANE_TILE_SIZE) + 0) / FLOOR_SCALE, ((z / PLANE_TILE_SIZE) + 1) / FLOOR_SCALE);
-				glVertex3f(x, 0, z + PLANE_TILE_SIZE);
-				
-				glTexCoord2f(((x / PLANE_TILE_SIZE) + 1) / FLOOR_SCALE, ((z / PLANE_TILE_SIZE) + 1) / FLOOR_SCALE);
-				glVertex3f(x + PLANE_TILE_SIZE, 0, z + PLANE_TILE_SIZE);
-				
-				glTexCoord2f(((x / PLANE_TILE_SIZE) + 1) / FLOOR_SCALE, ((z / PLANE_TILE_SIZE) + 0) / FLOOR_SCALE);
-				glVertex3f(x + PLANE_TILE_SIZE, 0, z);
+				const ImageData* image = loadTGAImageData(materialImagePath(material, level, path), &arena);
+				glTexImage2D(GL_TEXTURE_2D, level, image->nbytes, image->width, image->height, 0, GL_RGB, GL_UNSIGNED_BYTE, image->data.data());
 			}
+			glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		}
-		glEnd();
-	glPopMatrix();
-
-	glPushMatrix();
-		glBindTexture(GL_TEXTURE_2D, texIds[6]);
-		glColor3f(0.8, 0.4, 0);
-		glBegin(GL_QUADS);
-			glNormal3f(0, 0, 1);
-			glTexCoord2f(0, 2); glVertex3f(-PLANE_X, 100, -PLANE_Z);
-			glTexCoord2f(0, 0); glVertex3f(-PLANE_X, 0, -PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 0); glVertex3f(PLANE_X, 0, -PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 2); glVertex3f(PLANE_X, 100, -PLANE_Z);
-
-			glNormal3f(0, 0, -1);
-			glTexCoord2f(0, 2); glVertex3f(PLANE_X, 100, PLANE_Z);
-			glTexCoord2f(0, 0); glVertex3f(PLANE_X, 0, PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 0); glVertex3f(-PLANE_X, 0, PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 2); glVertex3f(-PLANE_X, 100, PLANE_Z);
-			
-			glNormal3f(1, 0, 0);
-			glTexCoord2f(0, 2); glVertex3f(-PLANE_X, 100, -PLANE_Z);
-			glTexCoord2f(0, 0); glVertex3f(-PLANE_X, 0, -PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 0); glVertex3f(-PLANE_X, 0, PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 2); glVertex3f(-PLANE_X, 100, PLANE_Z);
-
-			glNormal3f(-1, 0, 0);
-			glTexCoord2f(0, 2); glVertex3f(PLANE_X, 100, PLANE_Z);
-			glTexCoord2f(0, 0); glVertex3f(PLANE_X, 0, PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 0); glVertex3f(PLANE_X, 0, -PLANE_Z);
-			glTexCoord2f((2 * PLANE_X) / 50.0, 2); glVertex3f(PLANE_X, 100, -PLANE_Z);
-		glEnd();
-
-	glPopMatrix();
-	glEnable(GL_LIGHTING);
+		else
+		{
+			loadTGA(materialImagePath(material, 0, path), &arena);
+			glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		}
+
+		if (material->params.texture.clamp != 0)
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+	}
+	cout << "textures: " << arena.loads << " images in " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()
+		<< " ms, " << arena.allocations << " decode buffer of " << largest / 1048576.0 << " MB" << endl;
+	printProcessMemoryChange("texture memory", before);
 }
 
-void drawMuseum(bool isShadow)
+void findMaterials()
 {
+	const char* skyboxNames[6] = { "skybox_front", "skybox_back", "skybox_right", "skybox_left", "skybox_bottom", "skybox_top" };
+	for (int i = 0; i < 6; i++)
+	{
+		skyboxMaterials[i] = findSceneMaterial(&sceneFile, skyboxNames[i]);
+	}
+	wallMaterial = findSceneMaterial(&sceneFile, "wall");
+	floorMaterial = findSceneMaterial(&sceneFile, "floor");
+	pillarMaterial = findSceneMaterial(&sceneFile, "pillar");
+	particleMaterial = lookupSceneMaterial(&sceneFile, "particle");
+}
+
+// Shadows are projected onto the floor, so only the main pass is culled
+bool isCulled(int node, bool isShadow)
+{
+	return !isShadow && !isNodeVisible(&frameState->graph, node, &viewFrustum);
+}
+
+// A node's transform for the pass, as a command
+void recordSceneNode(CommandList* list, const RenderPass* pass, int node)
+{
+	recordMatrix(list, pass->matrix * worldMatrix(&frameState->graph, node));
+}
+
+void recordSkybox(CommandList* list, const RenderPass* pass)
+{
+	recordEnable(list, RENDER_STATE_TEXTURE);
+	recordTextureMode(list, TEXTURE_MODE_REPLACE);
+	recordMatrix(list, pass->matrix);
+	for (int i = 0; i < 6; i++)
+	{
+		recordMaterial(list, skyboxMaterials[i]);
+		recordMesh(list, &skyboxMeshes[i]);
+	}
+}
+
+//----------draw a floor plane-------------------
+void recordFloor(CommandList* list, const RenderPass* pass)
+{
+	recordDisable(list, RENDER_STATE_LIGHTING);
+	recordTextureMode(list, TEXTURE_MODE_MODULATE);
+	recordMatrix(list, pass->matrix);
+	recordMaterial(list, floorMaterial);
+	recordColour(list, 1, 1, 1);
+	recordMesh(list, &floorMesh);
+
+	recordMaterial(list, wallMaterial);
+	recordColour(list, 0.8, 0.4, 0);
+	recordMesh(list, &boundaryMesh);
+	recordEnable(list, RENDER_STATE_LIGHTING);
+}
+
+// With lightmaps the walls, pillars and floors are unlit, each modulated
+// by its chart of the baked lighting; only the roof is lit as it draws
+void recordMuseum(CommandList* list, const RenderPass* pass)
+{
+	if (museumNode < 0) return;
+	bool isShadow = pass->isShadow;
+	bool isBaked = !isShadow && lightmapTexture != 0;
 	if (isShadow)
 	{
-		glDisable(GL_TEXTURE_2D);
-		glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
+		recordDisable(list, RENDER_STATE_TEXTURE);
+		recordColour(list, shadowColor);
 	}
 	else 
 	{
-		glEnable(GL_TEXTURE_2D);
-		glColor3f(1, 1, 1);
-	}
-	float angle = 360.0 / MUSEUM_SIDES;
-	float wallLength = tan(deg2rad(angle / 2)) * MUSEUM_RADIUS * 2;
-	for (int i = 1; i < MUSEUM_SIDES; i++)
-	{
-		glPushMatrix();
-			glRotatef((angle * i) + 90, 0, 1, 0);
-			glTranslatef(MUSEUM_RADIUS, 50, 0);
-			glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-			glBindTexture(GL_TEXTURE_2D, texIds[6]);
-			int numColumns = (int)ceil(wallLength / 20.0);
-
-			glPushMatrix();
-				glDisable(GL_LIGHT0);
-				glTranslatef(-5, -50, -100);
-				glBegin(GL_QUADS);
-					glNormal3f(-1, 0, 0);
-					for (int x = 0; x < numColumns; x++)
-					{
-						for (int y = 0; y < 5; y++)
-						{
-							float left = min(20 * (x + 1), wallLength);
-							float texCoordLeft;
-							if (((int)left) % 20 == 0)
-							{
-								texCoordLeft = 1;
-							}
-							else
-							{
-								texCoordLeft = (wallLength - (20 * x)) / 20.0;
-							}
-
-							glTexCoord2f(0, 0); glVertex3f(0, 20 * y, 20 * x);
-							glTexCoord2f(texCoordLeft, 0); glVertex3f(0, 20 * y, left);
-							glTexCoord2f(texCoordLeft, 1); glVertex3f(0, 20 * (y + 1), left);
-							glTexCoord2f(0, 1); glVertex3f(0, 20 * (y + 1), 20 * x);
-						}
-					}
-				glEnd();
-				glEnable(GL_LIGHT0);
-			glPopMatrix();
-
-			glPushMatrix();
-				glTranslatef(5, -50, -100);
-				glBegin(GL_QUADS);
-					glNormal3f(-1, 0, 0);
-					for (int x = 0; x < numColumns; x++)
-					{
-						for (int y = 0; y < 5; y++)
-						{
-							float left = min(20 * (x + 1), wallLength);
-							float texCoordLeft;
-							if (((int)left) % 20 == 0)
-							{
-								texCoordLeft = 1;
-							}
-							else
-							{
-								texCoordLeft = (wallLength - (20 * x)) / 20.0;
-							}
-
-							glTexCoord2f(0, 0); glVertex3f(0, 20 * y, 20 * x);
-							glTexCoord2f(texCoordLeft, 0); glVertex3f(0, 20 * y, left);
-							glTexCoord2f(texCoordLeft, 1); glVertex3f(0, 20 * (y + 1), left);
-							glTexCoord2f(0, 1); glVertex3f(0, 20 * (y + 1), 20 * x);
-						}
-					}
-				glEnd();
-			glPopMatrix();
-		glPopMatrix();
+		// The sun lights the museum only
+		if (isBaked)
+		{
+			recordDisable(list, RENDER_STATE_LIGHTING);
+			recordLightmap(list);
+		}
+		else recordEnable(list, RENDER_STATE_LIGHT0);
+		recordEnable(list, RENDER_STATE_TEXTURE);
+		recordColour(list, 1, 1, 1);
+	}
+	float angle = 360.0 / museumSides;
+	recordTextureMode(list, TEXTURE_MODE_MODULATE);
+	recordMaterial(list, wallMaterial);
+	for (size_t m = 0; m < museumNodes.size(); m++)
+	{
+		size_t first = m * museumSides * 2;
+		const int* walls = &museumWallNodes[first];
+		for (int i = 1; i < museumSides; i++)
+		{
+			// The inner face is lit by the ceiling light only
+			if (!isCulled(walls[i * 2], isShadow))
+			{
+				recordSceneNode(list, pass, walls[i * 2]);
+				if (isBaked) recordLightmapChart(list, lightmapChartMatrix(&lightmap, museumWallCharts[first + i * 2]));
+					else if (!isShadow) recordDisable(list, RENDER_STATE_LIGHT0);
+				recordMesh(list, &museumWallMesh);
+				if (!isBaked && !isShadow) recordEnable(list, RENDER_STATE_LIGHT0);
+			}
+
+			if (!isCulled(walls[i * 2 + 1], isShadow))
+			{
+				recordSceneNode(list, pass, walls[i * 2 + 1]);
+				if (isBaked) recordLightmapChart(list, lightmapChartMatrix(&lightmap, museumWallCharts[first + i * 2 + 1]));
+				recordMesh(list, &museumWallMesh);
+			}
+		}
 	}
 
 	// pillars
-	float pillarDistance = MUSEUM_RADIUS / sin(deg2rad(angle));
-	for (int i = 0; i < MUSEUM_SIDES; i++)
-	{
-		float xScale = 1;
-		float yScale = 5;
-
-		// Draw cylinder
-		glPushMatrix();
-			glRotatef((angle * i), 0, 1, 0);
-			glTranslatef(pillarDistance, 0, 0);
-
-			glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-			glBindTexture(GL_TEXTURE_2D, texIds[8]);
-			glBegin(GL_QUADS);
-				for (int j = 0; j < MUSEUM_PILLAR_SIDES; j++)
-				{
-					Vector v1 = museumPillarVertices[2 * j];
-					Vector v1n = museumPillarNormals[2 * j];
-					Vector v2 = museumPillarVertices[(2 * j + 1) % (MUSEUM_PILLAR_SIDES * 2)];
-					Vector v2n = museumPillarNormals[(2 * j + 1) % (MUSEUM_PILLAR_SIDES * 2)];
-					Vector v3 = museumPillarVertices[(2 * j + 3) % (MUSEUM_PILLAR_SIDES * 2)];
-					Vector v3n = museumPillarNormals[(2 * j + 3) % (MUSEUM_PILLAR_SIDES * 2)];
-					Vector v4 = museumPillarVertices[(2 * j + 2) % (MUSEUM_PILLAR_SIDES * 2)];
-					Vector v4n = museumPillarNormals[(2 * j + 2) % (MUSEUM_PILLAR_SIDES * 2)];
-
-					glNormal3f(v1n.x, v1n.y, v1n.z);
-					glTexCoord2f((xScale / MUSEUM_PILLAR_SIDES) * j, 0);
-					glVertex3f(v1.x, v1.y, v1.z);
-					
-					glNormal3f(v2n.x, v2n.y, v2n.z);
-					glTexCoord2f((xScale / MUSEUM_PILLAR_SIDES) * j, 1);
-					glVertex3f(v2.x, v2.y, v2.z);
-					
-					glNormal3f(v3n.x, v3n.y, v3n.z);
-					glTexCoord2f((xScale / MUSEUM_PILLAR_SIDES) * (j + 1), 1);
-					glVertex3f(v3.x, v3.y, v3.z);
-					
-					glNormal3f(v4n.x, v4n.y, v4n.z);
-					glTexCoord2f((xScale / MUSEUM_PILLAR_SIDES) * (j + 1), 0);
-					glVertex3f(v4.x, v4.y, v4.z);
-				}
-			glEnd();
-		glPopMatrix();
-	}
-	// glEnable(GL_LIGHTING);
-	glDisable(GL_TEXTURE_2D);
-
-	// roof
+	float pillarDistance = museumRadius / sin(deg2rad(angle));
+	recordMaterial(list, pillarMaterial);
+	for (size_t i = 0; i < museumPillarNodes.size(); i++)
+	{
+		if (isCulled(museumPillarNodes[i], isShadow)) continue;
+		recordSceneNode(list, pass, museumPillarNodes[i]);
+		if (isBaked) recordLightmapChart(list, lightmapChartMatrix(&lightmap, museumPillarCharts[i]));
+		recordMesh(list, &museumPillarMesh);
+	}
+	recordDisable(list, RENDER_STATE_TEXTURE);
+
+	auto isVisible = [&](size_t m)
+	{
+		Mat4 world = worldMatrix(&frameState->graph, museumNodes[m]);
+		return isShadow || sphereInFrustum(&viewFrustum, transformPoint(world, vec3(0, 50, 0)), pillarDistance + 20);
+	};
+
+	// floors
+	if (!isShadow)
+	{
+		recordColour(list, 0.5, 0, 0);
+		for (size_t m = 0; m < museumNodes.size(); m++)
+		{
+			if (!isVisible(m)) continue;
+			recordSceneNode(list, pass, museumNodes[m]);
+			if (isBaked) recordLightmapChart(list, lightmapChartMatrix(&lightmap, museumFloorCharts[m]));
+			recordMesh(list, &museumFloorMesh);
+		}
+	}
+	if (isBaked)
+	{
+		recordLightmapOff(list);
+		recordEnable(list, RENDER_STATE_LIGHTING);
+		recordEnable(list, RENDER_STATE_LIGHT0);
+	}
+
+	// roofs
 	// TODO: change glutSolidCone to gluCylinder (for texcoords)
-	if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-		else glColor3f(0.3, 0.3, 0.3);
-	glPushMatrix();
-		glTranslatef(0, 100, 0);
-		glRotatef(-90, 1, 0, 0);
-		glutSolidCone(pillarDistance + 20, 100, MUSEUM_SIDES, MUSEUM_SIDES);
-	glPopMatrix();
-
-	// floor
-	// TODO: generate floor using points and texcoords
+	if (isShadow) recordColour(list, shadowColor);
+		else recordColour(list, 0.3, 0.3, 0.3);
+	for (size_t m = 0; m < museumNodes.size(); m++)
+	{
+		if (!isVisible(m)) continue;
+		Mat4 museum = pass->matrix * worldMatrix(&frameState->graph, museumNodes[m]);
+		recordMatrix(list, museum * mat4Translation(vec3(0, 100, 0)) * mat4Rotation(-90, vec3(1, 0, 0)));
+		recordCone(list, pillarDistance + 20, 100, museumSides, museumSides);
+	}
+	if (!isShadow) recordDisable(list, RENDER_STATE_LIGHT0);
+}
+
+void recordPlatform(CommandList* list, const Mat4& base)
+{
+	float width = platformDesc->params.platform.width;
+	float height = platformDesc->params.platform.height;
+	float depth = platformDesc->params.platform.depth;
+	recordColour(list, 0.8, 0.8, 0.8);
+	recordMatrix(list, base * mat4Translation(vec3(-width / 2, height / 2 + 0.05, -depth / 2)));
+	recordMesh(list, &platformMesh);
+	recordMatrix(list, base * mat4Scale(vec3(width, height, depth)));
+	recordCube(list, 1);
+}
+
+void recordMetatravellers(CommandList* list, const RenderPass* pass, const TravellerExhibit* exhibit)
+{
+	bool isShadow = pass->isShadow;
+	if (isCulled(exhibit->node, isShadow)) return;
+
 	if (!isShadow)
 	{
-		// glColor3f(0.5, 0, 0.8);
-		glColor3f(0.5, 0, 0);
-		glPushMatrix();
-			glTranslatef(0, -0.98, 0);
-			glRotatef(-90, 1, 0, 0);
-			glutSolidCylinder(pillarDistance, 1, MUSEUM_SIDES, MUSEUM_SIDES);
-		glPopMatrix();
+		Mat4 base = pass->matrix * worldMatrix(&frameState->graph, exhibit->node);
+		recordPlatform(list, base);
+
+		static const unsigned char message[] = "Press 'E' to toggle rings";
+		float textScale = 0.05;
+		recordDisable(list, RENDER_STATE_LIGHTING);
+		recordMatrix(list, base * mat4Translation(vec3(0, 10, -platformDesc->params.platform.depth / 2))
+			* mat4Scale(vec3(-textScale, textScale, 1)));
+		recordColour(list, 1, 1, 1);
+		recordText(list, message);
+		recordEnable(list, RENDER_STATE_LIGHTING);
+	}
+
+	for (size_t i = 0; i < exhibit->travellers.size(); i++)
+	{
+		if (frameState->ringsEnabled && !isCulled(exhibit->rings[i], isShadow))
+		{
+			if (isShadow) recordColour(list, shadowColor);
+				else recordColour(list, 1, 0.9, 0.3);
+			recordSceneNode(list, pass, exhibit->rings[i]);
+			recordTorus(list, 0.1, 5, 4, 36);
+		}
+
+		if (isCulled(exhibit->travellers[i], isShadow)) continue;
+		if (isShadow) recordColour(list, shadowColor);
+			else recordColour(list, 0.8, 0, 0.8);
+		recordSceneNode(list, pass, exhibit->travellers[i]);
+		recordSphere(list, 1, 12, 12);
 	}
 }
 
-void drawPlatform()
+void recordMobiusStrip(CommandList* list, const RenderPass* pass, const MobiusExhibit* exhibit)
 {
-	glPushMatrix();
-		glColor3f(0.8, 0.8, 0.8);
+	bool isShadow = pass->isShadow;
+	if (isCulled(exhibit->node, isShadow)) return;
 
-		glPushMatrix();
-			glTranslatef(-60, 5.05, -40);
-			glBegin(GL_QUADS);
-				for (int x = 0; x < 120; x++)
-				{
-					for (int z = 0; z < 80; z++)
-					{
-						glNormal3f(0, 1, 0);
-						glVertex3f(x, 0, z);
-						glVertex3f(x, 0, z + 1);
-						glVertex3f(x + 1, 0, z + 1);
-						glVertex3f(x + 1, 0, z);
-					}
-				}
-			glEnd();
-		glPopMatrix();
+	// Base
+	if (!isShadow)
+	{
+		recordPlatform(list, pass->matrix * worldMatrix(&frameState->graph, exhibit->node));
+	}
 
-		glScalef(120, 10, 80);
-		glutSolidCube(1);
-	glPopMatrix();
+	// Mobius Strip
+	if (isShadow) recordColour(list, shadowColor);
+		else recordColour(list, 0, 0.0, 0.8);
+	recordSceneNode(list, pass, exhibit->strip);
+	recordMesh(list, &mobiusStrip.mesh);
+
+	// Balls, reflecting their probe; probe faces leave them out
+	bool isReflective = !isShadow && exhibit->reflection >= 0;
+	if (isReflective && pass->isProbe) return;
+	if (isShadow) recordColour(list, shadowColor);
+		else if (isReflective) recordColour(list, 1, 1, 1);
+		else recordColour(list, 0.6, 0.6, 0.6);
+	if (isReflective)
+	{
+		recordTextureMode(list, TEXTURE_MODE_MODULATE);
+		recordReflection(list, exhibit->reflection, pass->matrix);
+	}
+	for (size_t i = 0; i < exhibit->balls.size(); i++)
+	{
+		if (isCulled(exhibit->balls[i], isShadow)) continue;
+		recordSceneNode(list, pass, exhibit->balls[i]);
+		recordSphere(list, 2, 12, 12);
+	}
+	if (isReflective) recordReflectionOff(list);
 }
 
-void drawMetatravellers(bool isShadow)
+void recordNewtonsCradle(CommandList* list, const RenderPass* pass, const CradleExhibit* exhibit)
 {
-	glPushMatrix();
-		glTranslatef(0, 0, 120);
-		if (!isShadow)
-		{
-			drawPlatform();
-
-			glPushMatrix();
-				glDisable(GL_LIGHTING);
-				float textScale = 0.05;
-				float textWidth = 0;
-				unsigned char message[] = "Press 'E' to toggle rings";
-				for (int i = 0; i < sizeof(message) / sizeof(message[0]); i++)
-				{
-					textWidth += (glutStrokeWidth(GLUT_STROKE_ROMAN, message[i]) * textScale);
-				}
-				glTranslatef(textWidth / 2, 10, -40);
-				glColor3f(1, 1, 1);
-				glScalef(-textScale, textScale, 1);
-				glutStrokeString(GLUT_STROKE_ROMAN, message);
-				glEnable(GL_LIGHTING);
-			glPopMatrix();
-		}
+	bool isShadow = pass->isShadow;
+	if (isCulled(exhibit->node, isShadow)) return;
+	Mat4 base = pass->matrix * worldMatrix(&frameState->graph, exhibit->node);
 
-		glPushMatrix();
-			glTranslatef(0, 30, 0);
-			for (int i = 0; i < METATRAVELLER_COUNT; i++)
+	// Base
+	if (!isShadow)
+	{
+		recordPlatform(list, base);
+	}
+
+	// Pendulums
+	int ballLights[CRADLE_BALLS] = { 2, -1, -1, -1, 3 };
+
+	for (int i = 0; i < CRADLE_BALLS; i++)
+	{
+		// Culled end balls still place their spotlights
+		bool isLit = ballLights[i] >= 0;
+		bool placesLight = isLit && !isShadow && exhibit->hasSpotlights;
+		bool isVisible = !isCulled(exhibit->balls[i], isShadow);
+		if (!isVisible && !placesLight) continue;
+
+		Mat4 ball = pass->matrix * worldMatrix(&frameState->graph, exhibit->balls[i]);
+		if (isVisible)
+		{
+			if (isShadow) recordColour(list, shadowColor);
+				else recordColour(list, 0.5, 0.5, 0.5);
+			recordMatrix(list, ball * mat4Rotation(-70, vec3(1, 0, 0)));
+			recordCylinder(list, 0.5, CRADLE_LENGTH, 12, 12);
+			recordMatrix(list, ball * mat4Rotation(-110, vec3(1, 0, 0)));
+			recordCylinder(list, 0.5, CRADLE_LENGTH, 12, 12);
+
+			// The end balls glow and carry a spotlight each. The others
+			// reflect their probe, so they are left out of its faces.
+			bool isReflective = !isShadow && !isLit && exhibit->reflection >= 0;
+			if (isShadow)
 			{
-				if (metatravellerRingsEnabled)
-				{
-					if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-						else glColor3f(1, 0.9, 0.3);
-					glPushMatrix();
-						glRotatef(i * (360.0 / METATRAVELLER_COUNT), 0, 1, 0);
-						glTranslatef(0, 0, 20);
-						glRotatef(90, 0, 1, 0);
-						glutSolidTorus(0.1, 5, 4, 36);
-					glPopMatrix();
-				}
-				
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.8, 0, 0.8);
-				glPushMatrix();
-					glRotatef(i * (360.0 / METATRAVELLER_COUNT), 0, 1, 0);
-					glTranslatef(0, 0, 20);
-					glRotatef(metatravellerAngles[i], 1, 0, 0);
-					glTranslatef(0, 0, 5);
-					glutSolidSphere(1, 12, 12);
-				glPopMatrix();
+				recordColour(list, shadowColor);
 			}
-		glPopMatrix();
-	glPopMatrix();
+			else if (isLit)
+			{
+				recordColour(list, 1, 1, 0.8);
+				recordDisable(list, RENDER_STATE_LIGHTING);
+			}
+			else if (isReflective)
+			{
+				recordColour(list, 1, 1, 1);
+				recordTextureMode(list, TEXTURE_MODE_MODULATE);
+			}
+			else
+			{
+				recordColour(list, 0.8, 0.8, 0.8);
+			}
+			if (!isReflective || !pass->isProbe)
+			{
+				if (isReflective) recordReflection(list, exhibit->reflection, pass->matrix);
+				recordMatrix(list, ball);
+				recordSphere(list, CRADLE_BALL_RADIUS, 12, 12);
+				if (isReflective) recordReflectionOff(list);
+			}
+		}
+		if (isLit && !isShadow) recordEnable(list, RENDER_STATE_LIGHTING);
+		if (placesLight)
+		{
+			recordMatrix(list, ball);
+			recordSpotlight(list, ballLights[i], 15, 100);
+		}
+	}
+
+	// Frame
+	float top = 10 + (CRADLE_LENGTH * cos(deg2rad(20)));
+	float side = CRADLE_LENGTH * sin(deg2rad(20));
+	if (isShadow) recordColour(list, shadowColor);
+		else recordColour(list, 0.5, 0.5, 0.5);
+	for (int j = -1; j <= 1; j += 2)
+	{
+		recordMatrix(list, base * mat4Translation(vec3(-21.5, top, j * side)) * mat4Rotation(90, vec3(0, 1, 0)));
+		recordCylinder(list, 1.5, 43, 12, 12);
+	}
+	for (int i = -1; i <= 1; i += 2)
+	{
+		for (int j = -1; j <= 1; j += 2)
+		{
+			recordMatrix(list, base * mat4Translation(vec3(i * 20, 0, j * side)) * mat4Rotation(-90, vec3(1, 0, 0)));
+			recordCylinder(list, 1.5, top, 12, 12);
+		}
+	}
+}
+
+void recordCeilingLight(CommandList* list, const RenderPass* pass)
+{
+	if (museumNode < 0) return;
+	Mat4 light = pass->matrix * worldMatrix(&frameState->graph, museumNode) * mat4Translation(vec3(0, 92, 0))
+		* mat4Rotation(90, vec3(-1, 0, 0));
+	recordMatrix(list, light);
+	recordColour(list, 0.4, 0.4, 0.4);
+	recordCone(list, 10, 15, 12, 12);
+	recordDisable(list, RENDER_STATE_LIGHTING);
+	recordColour(list, 1, 1, 0.8);
+	recordSphere(list, 4, 12, 12);
+	recordEnable(list, RENDER_STATE_LIGHTING);
+}
+
+// Drawn last, as particles blend over everything and write no depth.
+// Probe faces leave them out: sprite sizes are in pixels of the main
+// view.
+void recordParticleSystems(CommandList* list, const RenderPass* pass)
+{
+	if (particleMaterial < 0 || pass->isProbe) return;
+	recordDisable(list, RENDER_STATE_LIGHTING);
+	recordEnable(list, RENDER_STATE_TEXTURE);
+	recordTextureMode(list, TEXTURE_MODE_MODULATE);
+	recordMaterial(list, particleMaterial);
+	recordMatrix(list, pass->matrix);
+	if (frameState->dust.count > 0) recordParticles(list, frameState->dust.data.data(), frameState->dust.count, 3, 100, false);
+	if (frameState->sparks.count > 0) recordParticles(list, frameState->sparks.data.data(), frameState->sparks.count, 6, 100, true);
+	recordDisable(list, RENDER_STATE_TEXTURE);
+	recordEnable(list, RENDER_STATE_LIGHTING);
+}
+
+void initialiseFloor()
+{
+	int planeX = (int)floorDesc->params.floor.halfX, planeZ = (int)floorDesc->params.floor.halfZ;
+	int tile = (int)floorDesc->params.floor.tile;
+	float texScale = floorDesc->params.floor.texScale;
+
+	MeshBuilder builder;
+	for(int x = -planeX; x <= planeX; x += tile)
+	{
+		for(int z = -planeZ; z <= planeZ; z += tile)
+		{
+			float s0 = ((x / tile) + 0) / texScale, s1 = ((x / tile) + 1) / texScale;
+			float t0 = ((z / tile) + 0) / texScale, t1 = ((z / tile) + 1) / texScale;
+			addMeshQuad(&builder,
+				addMeshVertex(&builder, x, 0, z, s0, t0),
+				addMeshVertex(&builder, x, 0, z + tile, s0, t1),
+				addMeshVertex(&builder, x + tile, 0, z + tile, s1, t1),
+				addMeshVertex(&builder, x + tile, 0, z, s1, t0));
+		}
+	}
+	buildMesh(&builder, &floorMesh);
+
+	// Boundary walls, facing inwards
+	float x = floorDesc->params.floor.halfX, z = floorDesc->params.floor.halfZ;
+	float s = (2 * x) / 50.0;
+	float walls[4][2][2] = {
+		{ { -x, -z }, { x, -z } },
+		{ { x, z }, { -x, z } },
+		{ { -x, -z }, { -x, z } },
+		{ { x, z }, { x, -z } }
+	};
+	MeshBuilder boundary;
+	for (int i = 0; i < 4; i++)
+	{
+		float* a = walls[i][0];
+		float* b = walls[i][1];
+		addMeshQuad(&boundary,
+			addMeshVertex(&boundary, a[0], 100, a[1], 0, 2),
+			addMeshVertex(&boundary, a[0], 0, a[1], 0, 0),
+			addMeshVertex(&boundary, b[0], 0, b[1], s, 0),
+			addMeshVertex(&boundary, b[0], 100, b[1], s, 2));
+	}
+	buildMesh(&boundary, &boundaryMesh);
 }
 
-void drawMobiusStrip(bool isShadow)
+void initialiseSkybox()
 {
-	glPushMatrix();
-		glTranslatef(120, 0, 0);
-		glRotatef(90, 0, 1, 0);
-		// Base
-		if (!isShadow)
+	float scale = 2 * maxf(floorDesc->params.floor.halfX, floorDesc->params.floor.halfZ);
+
+	// Corners of each face as signs of the box's half-size, with texcoords
+	// from the bottom left
+	float faces[6][4][5] = {
+		{ { 1, -1, 1, 0, 0 }, { -1, -1, 1, 1, 0 }, { -1, 1, 1, 1, 1 }, { 1, 1, 1, 0, 1 } },			// front
+		{ { -1, -1, -1, 0, 0 }, { 1, -1, -1, 1, 0 }, { 1, 1, -1, 1, 1 }, { -1, 1, -1, 0, 1 } },		// back
+		{ { 1, -1, -1, 0, 0 }, { 1, -1, 1, 1, 0 }, { 1, 1, 1, 1, 1 }, { 1, 1, -1, 0, 1 } },			// right
+		{ { -1, -1, 1, 0, 0 }, { -1, -1, -1, 1, 0 }, { -1, 1, -1, 1, 1 }, { -1, 1, 1, 0, 1 } },		// left
+		{ { -1, -1, 1, 0, 0 }, { -1, -1, -1, 0, 1 }, { 1, -1, -1, 1, 1 }, { 1, -1, 1, 1, 0 } },		// bottom
+		{ { -1, 1, -1, 0, 0 }, { -1, 1, 1, 1, 0 }, { 1, 1, 1, 1, 1 }, { 1, 1, -1, 0, 1 } }			// top
+	};
+	for (int i = 0; i < 6; i++)
+	{
+		MeshBuilder builder;
+		int v[4];
+		for (int j = 0; j < 4; j++)
 		{
-			drawPlatform();
+			const float* c = faces[i][j];
+			v[j] = addMeshVertex(&builder, c[0] * scale, c[1] * scale, c[2] * scale, c[3], c[4]);
 		}
+		addMeshQuad(&builder, v[0], v[1], v[2], v[3]);
+		buildMesh(&builder, &skyboxMeshes[i]);
+	}
+}
 
-		glPushMatrix();
-			// Mobius Strip
-			if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-				else glColor3f(0, 0.0, 0.8);
-			glTranslatef(0, 20, 0);
-			glBegin(GL_TRIANGLES);
-			for (int i = 0; i < 37; i++)
+void initialiseMuseumWalls()
+{
+	// One wall of 20x20 brick tiles in the x = 0 plane, facing -x. The last
+	// column is cut short so the wall spans exactly one side of the polygon.
+	float angle = 360.0 / museumSides;
+	float wallLength = tan(deg2rad(angle / 2)) * museumRadius * 2;
+	int numColumns = (int)ceil(wallLength / 20.0);
+
+	MeshBuilder builder;
+	for (int x = 0; x < numColumns; x++)
+	{
+		for (int y = 0; y < 5; y++)
+		{
+			float left = minf(20 * (x + 1), wallLength);
+			float texCoordLeft;
+			if (((int)left) % 20 == 0)
 			{
-				Vector v1 = mobiusStripVertices[2 * i];
-				Vector v1n = mobiusStripNormals[2 * i];
-				Vector v2 = mobiusStripVertices[(2 * i + 1) % 74];
-				Vector v2n = mobiusStripNormals[(2 * i + 1) % 74];
-				Vector v3 = mobiusStripVertices[(2 * i + 2) % 74];
-				Vector v3n = mobiusStripNormals[(2 * i + 2) % 74];
-				Vector v4 = mobiusStripVertices[(2 * i + 3) % 74];
-				Vector v4n = mobiusStripNormals[(2 * i + 3) % 74];
-
-				glNormal3f(v1n.x, v1n.y, v1n.z); glVertex3f(v1.x, v1.y, v1.z);
-				glNormal3f(v2n.x, v2n.y, v2n.z); glVertex3f(v2.x, v2.y, v2.z);
-				glNormal3f(v3n.x, v3n.y, v3n.z); glVertex3f(v3.x, v3.y, v3.z);
-
-				glNormal3f(v4n.x, v4n.y, v4n.z); glVertex3f(v4.x, v4.y, v4.z);
-				glNormal3f(v3n.x, v3n.y, v3n.z); glVertex3f(v3.x, v3.y, v3.z);
-				glNormal3f(v2n.x, v2n.y, v2n.z); glVertex3f(v2.x, v2.y, v2.z);
+				texCoordLeft = 1;
 			}
-			glEnd();
-			
-			// Balls
-			float angleOffset = 720.0 / MOBIUS_STRIP_BALLS;
-			for (int i = 0; i < MOBIUS_STRIP_BALLS; i++)
+			else
 			{
-				glPushMatrix();
-					if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-						else glColor3f(0.6, 0.6, 0.6);
-					glRotatef((mobiusStripBallAngle + i * angleOffset), 0, 1, 0);
-					glTranslatef(0, 0, -MOBIUS_STRUP_RADIUS);
-					glRotatef((-(mobiusStripBallAngle + i * angleOffset) / 2.0), 1, 0, 0);
-					glTranslatef(0, 2.5, 0);
-					glutSolidSphere(2, 12, 12);
-				glPopMatrix();
+				texCoordLeft = (wallLength - (20 * x)) / 20.0;
 			}
-		glPopMatrix();
-	glPopMatrix();
+
+			addMeshQuad(&builder,
+				addMeshVertex(&builder, 0, 20 * y, 20 * x, 0, 0),
+				addMeshVertex(&builder, 0, 20 * y, left, texCoordLeft, 0),
+				addMeshVertex(&builder, 0, 20 * (y + 1), left, texCoordLeft, 1),
+				addMeshVertex(&builder, 0, 20 * (y + 1), 20 * x, 0, 1));
+		}
+	}
+	buildMesh(&builder, &museumWallMesh);
+	planarLightmapCoords(&museumWallMesh, 2, 1);
 }
 
-void drawNewtonsCradle(bool isShadow)
+void initialiseMuseumFloor()
 {
-	glPushMatrix();
-		glTranslatef(-120, 0, 0);
-		glRotatef(-90, 0, 1, 0);
-		// Base
-		if (!isShadow)
-		{
-			drawPlatform();
-		}
+	// A fan just above the ground, with its corners under the pillars
+	float angle = 360.0 / museumSides;
+	float pillarDistance = museumRadius / sin(deg2rad(angle));
 
-		// // Pendulums
-		glPushMatrix();
-			glTranslatef(0, 10, 0);
-
-			float white[4] = { 1, 1, 1, 1 };
-			float spotlightPos[4] = { 0, 0, 0, 1.0 }; 
-			float spotDir[3] = { 0, -1, 0 };
-
-			glPushMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.5, 0.5, 0.5);
-				glTranslatef(-12, CRADLE_LENGTH, 0);
-				glRotatef(min(0, cradleAngle), 0, 0, 1);
-				glTranslatef(-0, -CRADLE_LENGTH, 0);
-				glPushMatrix();
-					glRotatef(-70, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				glPushMatrix();
-					glRotatef(-110, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				if (isShadow)
-				{
-					glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);	
-				}
-				else
-				{
-					glColor3f(1, 1, 0.8);
-					glDisable(GL_LIGHTING);
-				}
-				glutSolidSphere(3, 12, 12);
-				if (!isShadow)
-				{
-					glEnable(GL_LIGHTING);
-					glPushMatrix();
-						glLightfv(GL_LIGHT2, GL_DIFFUSE, white);
-						glLightfv(GL_LIGHT2, GL_SPECULAR, white);
-						glLightfv(GL_LIGHT2, GL_POSITION, spotlightPos);
-						glLightfv(GL_LIGHT2, GL_SPOT_DIRECTION, spotDir);
-						glLightf(GL_LIGHT2, GL_SPOT_CUTOFF, 15);
-						glLightf(GL_LIGHT2, GL_SPOT_EXPONENT, 100);
-					glPopMatrix();
-				}
-			glPopMatrix();
-
-			glPushMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.5, 0.5, 0.5);
-				glTranslatef(-6, 0, 0);
-				glPushMatrix();
-					glRotatef(-70, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				glPushMatrix();
-					glRotatef(-110, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.8, 0.8, 0.8);
-				glutSolidSphere(3, 12, 12);
-			glPopMatrix();
-
-			glPushMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.5, 0.5, 0.5);
-				glPushMatrix();
-					glRotatef(-70, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				glPushMatrix();
-					glRotatef(-110, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.8, 0.8, 0.8);
-				glutSolidSphere(3, 12, 12);
-			glPopMatrix();
-
-			glPushMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.5, 0.5, 0.5);
-				glTranslatef(6, 0, 0);
-				glPushMatrix();
-					glRotatef(-70, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				glPushMatrix();
-					glRotatef(-110, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.8, 0.8, 0.8);
-				glutSolidSphere(3, 12, 12);
-			glPopMatrix();
-
-			glPushMatrix();
-				if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-					else glColor3f(0.5, 0.5, 0.5);
-				glTranslatef(12, CRADLE_LENGTH, 0);
-				glRotatef(max(0, cradleAngle), 0, 0, 1);
-				glTranslatef(0, -CRADLE_LENGTH, 0);
-				glPushMatrix();
-					glRotatef(-70, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				glPushMatrix();
-					glRotatef(-110, 1, 0, 0);
-					glutSolidCylinder(0.5, CRADLE_LENGTH, 12, 12);
-				glPopMatrix();
-				if (isShadow)
-				{
-					glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);	
-				}
-				else
-				{
-					glColor3f(1, 1, 0.8);
-					glDisable(GL_LIGHTING);
-				}
-				glutSolidSphere(3, 12, 12);
-				if (!isShadow)
-				{
-					glEnable(GL_LIGHTING);
-					glPushMatrix();
-						glLightfv(GL_LIGHT3, GL_DIFFUSE, white);
-						glLightfv(GL_LIGHT3, GL_SPECULAR, white);
-						glLightfv(GL_LIGHT3, GL_POSITION, spotlightPos);
-						glLightfv(GL_LIGHT3, GL_SPOT_DIRECTION, spotDir);
-						glLightf(GL_LIGHT3, GL_SPOT_CUTOFF, 15);
-						glLightf(GL_LIGHT3, GL_SPOT_EXPONENT, 100);
-					glPopMatrix();
-				}
-			glPopMatrix();
-		glPopMatrix();
-
-		// Frame
-		glPushMatrix();
-			if (isShadow) glColor4f(shadowColor[0], shadowColor[1], shadowColor[2], shadowColor[3]);
-				else glColor3f(0.5, 0.5, 0.5);
-			glPushMatrix();
-				glTranslatef(-21.5, 10 + (CRADLE_LENGTH * cos(deg2rad(20))), (CRADLE_LENGTH * sin(deg2rad(20))));
-				glRotatef(90, 0, 1, 0);
-				glutSolidCylinder(1.5, 43, 12, 12);
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(-21.5, 10 + (CRADLE_LENGTH * cos(deg2rad(20))), -(CRADLE_LENGTH * sin(deg2rad(20))));
-				glRotatef(90, 0, 1, 0);
-				glutSolidCylinder(1.5, 43, 12, 12);
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(20, 0, (CRADLE_LENGTH * sin(deg2rad(20))));
-				glRotatef(-90, 1, 0, 0);
-				glutSolidCylinder(1.5, 10 + (CRADLE_LENGTH * cos(deg2rad(20))), 12, 12);
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(-20, 0, (CRADLE_LENGTH * sin(deg2rad(20))));
-				glRotatef(-90, 1, 0, 0);
-				glutSolidCylinder(1.5, 10 + (CRADLE_LENGTH * cos(deg2rad(20))), 12, 12);
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(20, 0, -(CRADLE_LENGTH * sin(deg2rad(20))));
-				glRotatef(-90, 1, 0, 0);
-				glutSolidCylinder(1.5, 10 + (CRADLE_LENGTH * cos(deg2rad(20))), 12, 12);
-			glPopMatrix();
-			glPushMatrix();
-				glTranslatef(-20, 0, -(CRADLE_LENGTH * sin(deg2rad(20))));
-				glRotatef(-90, 1, 0, 0);
-				glutSolidCylinder(1.5, 10 + (CRADLE_LENGTH * cos(deg2rad(20))), 12, 12);
-			glPopMatrix();
-		glPopMatrix();
-	glPopMatrix();
-}
-
-void drawCeilingLight()
-{
-	glPushMatrix();
-		glTranslatef(0, 92, 0);
-		glPushMatrix();
-			glRotatef(90, -1, 0, 0);
-			glColor3f(0.4, 0.4, 0.4);
-			glutSolidCone(10, 15, 12, 12);
-		glPopMatrix();
-		glPushMatrix();
-			glDisable(GL_LIGHTING);
-			glRotatef(90, -1, 0, 0);
-			glColor3f(1, 1, 0.8);
-			glutSolidSphere(4, 12, 12);
-			glEnable(GL_LIGHTING);
-		glPopMatrix();
-	glPopMatrix();
+	MeshBuilder builder;
+	int centre = addMeshVertex(&builder, 0, 0.02, 0, 0, 1, 0, 0.5, 0.5);
+	for (int i = 0; i < museumSides; i++)
+	{
+		Vec3 a = rotateY(vec3(pillarDistance, 0.02, 0), angle * i);
+		Vec3 b = rotateY(vec3(pillarDistance, 0.02, 0), angle * (i + 1));
+		addMeshTriangle(&builder, centre,
+			addMeshVertex(&builder, a.x, a.y, a.z, 0, 1, 0, 0.5 + a.x / (pillarDistance * 2), 0.5 + a.z / (pillarDistance * 2)),
+			addMeshVertex(&builder, b.x, b.y, b.z, 0, 1, 0, 0.5 + b.x / (pillarDistance * 2), 0.5 + b.z / (pillarDistance * 2)));
+	}
+	buildMesh(&builder, &museumFloorMesh);
+	textureLightmapCoords(&museumFloorMesh);
 }
 
 void initialisePillars()
 {
-	// Calculate vertex positions
-	for (int i = 0; i < MUSEUM_PILLAR_SIDES; i++)
+	// Top and bottom rings; the first and last columns share positions but
+	// not texture coordinates, so the seam is still smooth-shaded
+	float radius = pillarDesc->params.pillar.radius;
+	float height = pillarDesc->params.pillar.height;
+	int sides = (int)pillarDesc->params.pillar.sides;
+
+	MeshBuilder builder;
+	vector<int> top(sides + 1), bottom(sides + 1);
+	for (int i = 0; i <= sides; i++)
 	{
-		museumPillarVertices[2 * i] = { 10, 100, 0 };
-		museumPillarVertices[2 * i + 1] = { 10, 0, 0 };
+		Vec3 v1 = rotateY(vec3(radius, height, 0), (360.0 / sides) * i);
+		Vec3 v2 = rotateY(vec3(radius, 0, 0), (360.0 / sides) * i);
 
-		rotateVectorY(&museumPillarVertices[2 * i], (360.0 / MUSEUM_PILLAR_SIDES) * i);
-		rotateVectorY(&museumPillarVertices[2 * i + 1], (360.0 / MUSEUM_PILLAR_SIDES) * i);
+		float s = (1.0 / sides) * i;
+		top[i] = addMeshVertex(&builder, v1.x, v1.y, v1.z, s, 0);
+		bottom[i] = addMeshVertex(&builder, v2.x, v2.y, v2.z, s, 1);
 	}
-	
-	// Calculate vertex normals
-	for (int i = 0; i < MUSEUM_PILLAR_SIDES; i++)
+
+	for (int i = 0; i < sides; i++)
 	{
-		Vector v1 = museumPillarVertices[2 * i];
-		Vector v2 = museumPillarVertices[(2 * i + 1) % (MUSEUM_PILLAR_SIDES * 2)];
-		Vector v3 = museumPillarVertices[(2 * i + 3) % (MUSEUM_PILLAR_SIDES * 2)];
+		addMeshQuad(&builder, top[i], bottom[i], bottom[i + 1], top[i + 1]);
+	}
+	buildMesh(&builder, &museumPillarMesh);
+	textureLightmapCoords(&museumPillarMesh);
+}
+
+void initialisePlatform()
+{
+	// Finely tessellated top so the spotlights have vertices to light
+	int width = (int)platformDesc->params.platform.width;
+	int depth = (int)platformDesc->params.platform.depth;
+
+	MeshBuilder builder;
+	for (int x = 0; x < width; x++)
+	{
+		for (int z = 0; z < depth; z++)
+		{
+			addMeshQuad(&builder,
+				addMeshVertex(&builder, x, 0, z, 0, 0),
+				addMeshVertex(&builder, x, 0, z + 1, 0, 0),
+				addMeshVertex(&builder, x + 1, 0, z + 1, 0, 0),
+				addMeshVertex(&builder, x + 1, 0, z, 0, 0));
+		}
+	}
+	buildMesh(&builder, &platformMesh);
+}
 
-		Vector n = normal(v1, v2, v3);
-		museumPillarNormals[2 * i].x += n.x;
-		museumPillarNormals[2 * i].y += n.y;
-		museumPillarNormals[2 * i].z += n.z;
+void initialiseMobiusStrip()
+{
+	generateMobiusStrip(&mobiusStrip, mobiusStripParams);
+}
 
-		museumPillarNormals[(2 * i + 1) % (MUSEUM_PILLAR_SIDES * 2)].x += n.x;
-		museumPillarNormals[(2 * i + 1) % (MUSEUM_PILLAR_SIDES * 2)].y += n.y;
-		museumPillarNormals[(2 * i + 1) % (MUSEUM_PILLAR_SIDES * 2)].z += n.z;
+void addMuseum(const SceneNodeDesc* desc, int node)
+{
+	if (museumNode < 0)
+	{
+		museumNode = node;
+		museumRadius = desc->params.museum.radius;
+		museumSides = (int)desc->params.museum.sides;
+	}
+	museumNodes.push_back(node);
 
-		museumPillarNormals[(2 * i + 2) % (MUSEUM_PILLAR_SIDES * 2)].x += n.x;
-		museumPillarNormals[(2 * i + 2) % (MUSEUM_PILLAR_SIDES * 2)].y += n.y;
-		museumPillarNormals[(2 * i + 2) % (MUSEUM_PILLAR_SIDES * 2)].z += n.z;
+	Vec3 up = vec3(0, 1, 0);
+	float angle = 360.0 / museumSides;
+	float wallLength = tan(deg2rad(angle / 2)) * museumRadius * 2;
+	float pillarDistance = museumRadius / sin(deg2rad(angle));
 
-		museumPillarNormals[(2 * i + 3) % (MUSEUM_PILLAR_SIDES * 2)].x += n.x;
-		museumPillarNormals[(2 * i + 3) % (MUSEUM_PILLAR_SIDES * 2)].y += n.y;
-		museumPillarNormals[(2 * i + 3) % (MUSEUM_PILLAR_SIDES * 2)].z += n.z;
+	Vec3 wallCentre = vec3(0, 50, wallLength / 2);
+	int walls = (int)museumWallNodes.size();
+	museumWallNodes.resize(walls + museumSides * 2, -1);
+	for (int i = 1; i < museumSides; i++)
+	{
+		Mat4 side = mat4Rotation((angle * i) + 90, up) * mat4Translation(vec3(museumRadius, 50, 0));
+		museumWallNodes[walls + i * 2] = addSceneNode(&scene, node, side * mat4Translation(vec3(-5, -50, -100)), wallCentre, length(wallCentre));
+		museumWallNodes[walls + i * 2 + 1] = addSceneNode(&scene, node, side * mat4Translation(vec3(5, -50, -100)), wallCentre, length(wallCentre));
 	}
 
-	// Normalise vertex normals
-	for (int i = 0; i < MUSEUM_PILLAR_SIDES * 2; i++)
+	float pillarRadius = pillarDesc->params.pillar.radius, pillarHeight = pillarDesc->params.pillar.height;
+	for (int i = 0; i < museumSides; i++)
 	{
-		normalise(&museumPillarNormals[i]);
+		museumPillarNodes.push_back(addSceneNode(&scene, node, mat4Rotation(angle * i, up) * mat4Translation(vec3(pillarDistance, 0, 0)),
+			vec3(0, pillarHeight / 2, 0), length(vec3(pillarRadius, pillarHeight / 2, 0))));
 	}
 }
 
-void initialiseMetatravellers()
+void addMetatravellers(const SceneNodeDesc* desc, int node)
 {
-	for (int i = 0; i < METATRAVELLER_COUNT; i++)
+	TravellerExhibit exhibit;
+	exhibit.node = node;
+	exhibit.name = sceneFile.strings + desc->name;
+	int count = (int)desc->params.travellers.count;
+
+	// METATRAVELLER_SPEED is in degrees per 10 ms tick
+	initialiseTravellerBatch(&exhibit.batch, count, 20, 5, METATRAVELLER_SPIRALS, deg2rad(METATRAVELLER_SPEED * 100.0));
+	advanceTravellers(&exhibit.batch, 0);
+
+	Vec3 up = vec3(0, 1, 0);
+	int travellerRoot = addSceneNode(&scene, node, mat4Translation(vec3(0, 30, 0)));
+	for (int i = 0; i < count; i++)
 	{
-		metatravellerAngles[i] = ((360 * METATRAVELLER_SPIRALS) / METATRAVELLER_COUNT) * i;
+		exhibit.rings.push_back(addSceneNode(&scene, travellerRoot, mat4Rotation(i * (360.0 / count), up)
+			* mat4Translation(vec3(0, 0, 20)) * mat4Rotation(90, up), vec3(0, 0, 0), 5.1));
+		exhibit.travellers.push_back(addSceneNode(&scene, travellerRoot, mat4Identity(), vec3(0, 0, 0), 1));
 	}
+	travellerExhibits.push_back(exhibit);
 }
 
-void initialiseMobiusStrip()
+void addMobiusStrip(const SceneNodeDesc* desc, int node)
 {
-	// Calculate vertex positions
-	for (int i = 0; i < 37; i++)
+	MobiusExhibit exhibit;
+	exhibit.node = node;
+	exhibit.name = sceneFile.strings + desc->name;
+	exhibit.reflection = -1;
+	exhibit.strip = addSceneNode(&scene, node, mat4Translation(vec3(0, 20, 0)),
+		vec3(0, 0, 0), MOBIUS_STRUP_RADIUS + MOBIUS_STRIP_WIDTH);
+	for (int i = 0; i < (int)desc->params.mobius.balls; i++)
 	{
-		mobiusStripVertices[2 * i].x = 0;
-		mobiusStripVertices[2 * i].y = 5;
-		mobiusStripVertices[2 * i].z = 0;
-		
-		mobiusStripVertices[2 * i + 1].x = 0;
-		mobiusStripVertices[2 * i + 1].y = -5;
-		mobiusStripVertices[2 * i + 1].z = 0;
-
-		rotateVectorX(&mobiusStripVertices[2 * i], 5 * i);
-		rotateVectorX(&mobiusStripVertices[2 * i + 1], 5 * i);
+		exhibit.balls.push_back(addSceneNode(&scene, exhibit.strip, mat4Identity(), vec3(0, 0, 0), 2));
+	}
+	mobiusExhibits.push_back(exhibit);
+}
 
-		mobiusStripVertices[2 * i].z += MOBIUS_STRUP_RADIUS;
-		mobiusStripVertices[2 * i + 1].z += MOBIUS_STRUP_RADIUS;
+void addNewtonsCradle(const SceneNodeDesc* desc, int node)
+{
+	// Only the first cradle gets spotlights; fixed-function GL has 8 lights
+	CradleExhibit exhibit;
+	exhibit.node = node;
+	exhibit.name = sceneFile.strings + desc->name;
+	exhibit.hasSpotlights = cradleExhibits.empty();
+	exhibit.reflection = -1;
+
+	// Ball spheres include the strings up to the frame
+	int pendulumRoot = addSceneNode(&scene, node, mat4Translation(vec3(0, 10, 0)));
+	for (int i = 0; i < CRADLE_BALLS; i++)
+	{
+		exhibit.balls[i] = addSceneNode(&scene, pendulumRoot, mat4Identity(),
+			vec3(0, CRADLE_LENGTH / 2, 0), CRADLE_LENGTH / 2 + CRADLE_BALL_RADIUS);
+	}
+	cradleExhibits.push_back(exhibit);
+}
 
-		rotateVectorY(&mobiusStripVertices[2 * i], 10 * i);
-		rotateVectorY(&mobiusStripVertices[2 * i + 1], 10 * i);
+void initialiseNewtonsCradles()
+{
+	// Pendulum length in metres sets the swing period
+	int count = (int)cradleExhibits.size();
+	initialiseCradleBatch(&cradle, count, CRADLE_LENGTH, GRAVITY / (CRADLE_LENGTH / 100.0));
+	for (int i = 0; i < count; i++)
+	{
+		cradle.angles[CRADLE_BALLS - 1][i] = deg2rad(CRADLE_MAX_ANGLE);
 	}
+}
 
-	// Calculate vertex normals
-	for (int i = 0; i < 37; i++)
+// Builds the scene graph from the scene file's nodes. Each node becomes a
+// graph node placed by its position and yaw, and exhibits add their own
+// children; animated ones get their local transforms from
+// updateSceneAnimation. Bounding spheres are in each node's space.
+void initialiseSceneGraph()
+{
+	// Each exhibit's sphere covers its platform and everything above it
+	Vec3 exhibitCentre = vec3(0, 25, 0);
+	float exhibitRadius = 80;
+
+	int count = sceneFile.header->nodeCount;
+	vector<int> graphNodes(count);
+	for (int i = 0; i < count; i++)
 	{
-		Vector v1 = mobiusStripVertices[2 * i];
-		Vector v2 = mobiusStripVertices[(2 * i + 1) % 74];
-		Vector v3 = mobiusStripVertices[(2 * i + 2) % 74];
-		Vector v4 = mobiusStripVertices[(2 * i + 3) % 74];
+		const SceneNodeDesc* desc = &sceneFile.nodes[i];
+		Mat4 local = mat4Translation(vec3(desc->position[0], desc->position[1], desc->position[2]))
+			* mat4Rotation(desc->yaw, vec3(0, 1, 0));
+		int parent = desc->parent >= 0 ? graphNodes[desc->parent] : -1;
+		bool isExhibit = desc->type == SCENE_NODE_TRAVELLERS || desc->type == SCENE_NODE_MOBIUS || desc->type == SCENE_NODE_CRADLE;
+		graphNodes[i] = isExhibit ? addSceneNode(&scene, parent, local, exhibitCentre, exhibitRadius) : addSceneNode(&scene, parent, local);
+
+		switch (desc->type)
+		{
+			case SCENE_NODE_MUSEUM:
+				addMuseum(desc, graphNodes[i]);
+				break;
+			case SCENE_NODE_TRAVELLERS:
+				addMetatravellers(desc, graphNodes[i]);
+				break;
+			case SCENE_NODE_MOBIUS:
+				addMobiusStrip(desc, graphNodes[i]);
+				break;
+			case SCENE_NODE_CRADLE:
+				addNewtonsCradle(desc, graphNodes[i]);
+				break;
+		}
+	}
+	initialiseNewtonsCradles();
 
-		Vector n1 = normal(v1, v2, v3);
-		mobiusStripNormals[2 * i].x += n1.x;
-		mobiusStripNormals[2 * i].y += n1.y;
-		mobiusStripNormals[2 * i].z += n1.z;
+	updateSceneAnimation();
+	updateSceneGraph(&scene);
+}
 
-		mobiusStripNormals[(2 * i + 1) % 74].x += n1.x;
-		mobiusStripNormals[(2 * i + 1) % 74].y += n1.y;
-		mobiusStripNormals[(2 * i + 1) % 74].z += n1.z;
+// Projects geometry onto the y = 0 plane away from a point light
+Mat4 shadowMatrix(Vec3 light)
+{
+	Mat4 r = { {
+		light.y, 0, 0, 0,
+		-light.x, 0, -light.z, -1,
+		0, 0, light.y, 0,
+		0, 0, 0, light.y
+	} };
+	return r;
+}
 
-		mobiusStripNormals[(2 * i + 2) % 74].x += n1.x;
-		mobiusStripNormals[(2 * i + 2) % 74].y += n1.y;
-		mobiusStripNormals[(2 * i + 2) % 74].z += n1.z;
-		
-		Vector n2 = normal(v4, v3, v2);
-		mobiusStripNormals[(2 * i + 3) % 74].x += n2.x;
-		mobiusStripNormals[(2 * i + 3) % 74].y += n2.y;
-		mobiusStripNormals[(2 * i + 3) % 74].z += n2.z;
+// Each exhibit is shadowed by a point light 90 units above its centre
+RenderPass exhibitShadowPass(const Mat4& view, int node, bool isProbe)
+{
+	Vec3 light = mat4GetTranslation(worldMatrix(&frameState->graph, node)) + vec3(0, 90, 0);
+	RenderPass pass = { view * mat4Translation(vec3(0, 5.1, 0)) * shadowMatrix(light), true, isProbe };
+	return pass;
+}
 
-		mobiusStripNormals[(2 * i + 2) % 74].x += n2.x;
-		mobiusStripNormals[(2 * i + 2) % 74].y += n2.y;
-		mobiusStripNormals[(2 * i + 2) % 74].z += n2.z;
+// Records one slot of the frame into its command list. Shadow slots turn
+// lighting off around their own commands, so every slot can be replayed
+// after any other.
+void recordSlot(CommandList* list, const Mat4& view, int slot, bool isProbe)
+{
+	RenderPass pass = { view, false, isProbe };
+	clearCommandList(list);
+	switch (slot)
+	{
+		case SLOT_SKYBOX:
+			recordSkybox(list, &pass);
+			break;
+		case SLOT_FLOOR:
+			recordFloor(list, &pass);
+			break;
+		case SLOT_MOBIUS_SHADOWS:
+			recordDisable(list, RENDER_STATE_LIGHTING);
+			for (size_t i = 0; i < mobiusExhibits.size(); i++)
+			{
+				RenderPass shadow = exhibitShadowPass(view, mobiusExhibits[i].node, isProbe);
+				recordMobiusStrip(list, &shadow, &mobiusExhibits[i]);
+			}
+			recordEnable(list, RENDER_STATE_LIGHTING);
+			break;
+		case SLOT_MUSEUM_SHADOW:
+		{
+			RenderPass shadow = { view * mat4Translation(vec3(0, 0.01, 0)) * shadowMatrix(vec3(0, 500, -500)), true, isProbe };
+			recordDisable(list, RENDER_STATE_LIGHTING);
+			recordMuseum(list, &shadow);
+			recordEnable(list, RENDER_STATE_LIGHTING);
+			break;
+		}
+		case SLOT_TRAVELLER_SHADOWS:
+			// Newton's cradle shadows are disabled
+			recordDisable(list, RENDER_STATE_LIGHTING);
+			for (size_t i = 0; i < travellerExhibits.size(); i++)
+			{
+				RenderPass shadow = exhibitShadowPass(view, travellerExhibits[i].node, isProbe);
+				recordMetatravellers(list, &shadow, &travellerExhibits[i]);
+			}
+			recordEnable(list, RENDER_STATE_LIGHTING);
+			break;
+		case SLOT_MUSEUM:
+			recordMuseum(list, &pass);
+			break;
+		case SLOT_CEILING_LIGHT:
+			recordCeilingLight(list, &pass);
+			break;
+		default:
+		{
+			// Exhibits in the order travellers, mobius strips, cradles, then
+			// the particles
+			size_t e = slot - SLOT_EXHIBITS;
+			if (e < travellerExhibits.size())
+			{
+				recordMetatravellers(list, &pass, &travellerExhibits[e]);
+				break;
+			}
+			e -= travellerExhibits.size();
+			if (e < mobiusExhibits.size())
+			{
+				recordMobiusStrip(list, &pass, &mobiusExhibits[e]);
+				break;
+			}
+			e -= mobiusExhibits.size();
+			if (e < cradleExhibits.size())
+			{
+				recordNewtonsCradle(list, &pass, &cradleExhibits[e]);
+				break;
+			}
+			recordParticleSystems(list, &pass);
+			break;
+		}
+	}
+}
+
+// Profiler marker names, in slot order
+string slotName(int slot)
+{
+	static const char* names[SLOT_EXHIBITS] = { "skybox", "floor", "mobius shadows", "museum shadow",
+		"traveller shadows", "museum", "ceiling light" };
+	if (slot < SLOT_EXHIBITS) return names[slot];
+
+	size_t e = slot - SLOT_EXHIBITS;
+	if (e < travellerExhibits.size()) return "travellers " + to_string(e);
+	e -= travellerExhibits.size();
+	if (e < mobiusExhibits.size()) return "mobius " + to_string(e);
+	e -= mobiusExhibits.size();
+	if (e < cradleExhibits.size()) return "cradle " + to_string(e);
+	return "particles";
+}
 
-		mobiusStripNormals[(2 * i + 1) % 74].x += n2.x;
-		mobiusStripNormals[(2 * i + 1) % 74].y += n2.y;
-		mobiusStripNormals[(2 * i + 1) % 74].z += n2.z;
+// Records every slot of a published frame into 'lists' on the job
+// system, one job per slot, culled to the given view and projection.
+// The frame is only read while recording.
+void recordFrame(const FrameState* state, const Mat4& view, const Mat4& viewProjection, vector<CommandList>* lists, bool isProbe)
+{
+	frameState = state;
+	viewFrustum = frustumFromMatrix(viewProjection * view);
+
+	int slots = SLOT_EXHIBITS + (int)(travellerExhibits.size() + mobiusExhibits.size() + cradleExhibits.size()) + 1;
+	lists->resize(slots);
+	atomic<int> pending(0);
+	for (int i = 0; i < slots; i++)
+	{
+		CommandList* list = &(*lists)[i];
+		submitJob(&jobs, &pending, [list, &view, i, isProbe] { recordSlot(list, view, i, isProbe); });
 	}
+	waitForJobs(&jobs, &pending);
+}
 
-	// Normalise vertex normals
-	for (int i = 0; i < 74; i++)
+// Scene light positions are given in world space, so they are set under
+// each pass's view
+void placeSceneLights(const Mat4& view)
+{
+	glLoadMatrixf(view.m);
+	int lightCount = min((int)sceneFile.header->lightCount, SCENE_LIGHTS);
+	for (int i = 0; i < lightCount; i++)
 	{
-		normalise(&mobiusStripNormals[i]);
+		const SceneLightDesc* light = &sceneFile.lights[i];
+		float position[4] = { light->params.light.x, light->params.light.y, light->params.light.z,
+			light->type == SCENE_LIGHT_POINT ? 1.0f : 0.0f };
+		glLightfv(GL_LIGHT0 + i, GL_POSITION, position);
 	}
 }
 
-void display()
+// Renders this frame's share of reflection probe faces. Faces leave out
+// the reflective balls, which the cradle's probe sits inside, and the
+// cradle spotlights, whose positions are only placed by the main pass.
+void renderProbeFaces(const FrameState* state, Vec3 eye)
 {
-	float innerLightPos[4] = {0., 90., 0., 1.0};  //light's position
-	float lightDir[4] = {0, -1, -1, 0};
+	vector<ProbeFace> faces;
+	chooseProbeFaces(&reflectionProbes, eye, &viewFrustum, &faces);
+	if (faces.empty()) return;
 
-	float white[4] = {1, 1, 1, 1};
-	float grey[4] {0.5, 0.5, 0.5, 1};
-	float black[4] = {0, 0, 0, 1};
+	Mat4 faceProjection = probeProjection(FAR_PLANE);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(faceProjection.m);
+	glMatrixMode(GL_MODELVIEW);
+	glPushAttrib(GL_LIGHTING_BIT | GL_ENABLE_BIT);
+	glDisable(GL_LIGHT2);
+	glDisable(GL_LIGHT3);
+	// State carries over from face to face; only the target changes
+	ReplayState replay;
+	forgetReplayState(&replay);
+	for (size_t f = 0; f < faces.size(); f++)
+	{
+		const ReflectionProbe* probe = &reflectionProbes.probes[faces[f].probe];
+		Mat4 faceView = probeFaceView(probe, faces[f].face);
+		recordFrame(state, faceView, faceProjection, &probeLists, true);
+		beginProbeFace(&reflectionProbes, faces[f], f == 0);
+		placeSceneLights(faceView);
+		for (size_t i = 0; i < probeLists.size(); i++)
+		{
+			replayCommandList(&probeLists[i], texIds.data(), &replay);
+		}
+	}
+	glPopAttrib();
+	endProbeFaces(&reflectionProbes);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(projection.m);
+	glMatrixMode(GL_MODELVIEW);
+}
 
+// Casts a ray through window position (x, y) of the frame being drawn
+// and reports the nearest exhibit under it; walls and pillars block it.
+// The moving parts are refitted to this frame's animation first.
+void pickExhibit(const FrameState* state, Vec3 eye, const Mat4& view, int x, int y)
+{
+	for (size_t i = 0; i < exhibitPartNodes.size(); i++)
+	{
+		int node = exhibitPartNodes[i];
+		moveColliderSphere(&exhibitParts, (int)i, state->graph.worldCentre[node], state->graph.worldRadius[node]);
+	}
+	refitSphereCollider(&exhibitParts);
+
+	float width = glutGet(GLUT_WINDOW_WIDTH), height = glutGet(GLUT_WINDOW_HEIGHT);
+	float scale = tan(deg2rad(FIELD_OF_VIEW / 2.0));
+	Vec3 direction = vec3((2 * (x + 0.5f) / width - 1) * scale, (1 - 2 * (y + 0.5f) / height) * scale, -1);
+	direction = normalize(transformDirection(mat4RigidInverse(view), direction));
+
+	float distance = FAR_PLANE;
+	int triangle = raycastTriangles(&sceneCollider, eye, direction, &distance);
+	int part = raycastSpheres(&exhibitParts, eye, direction, &distance);
+	int owner = part >= 0 ? exhibitParts.owner[part] : (triangle >= 0 ? sceneCollider.owner[triangle] : -1);
+	if (owner < 0) cout << "picked: nothing" << endl;
+		else cout << "picked: " << exhibitNames[owner] << " at distance " << distance << endl;
+}
+
+void display()
+{
+	auto frameStart = chrono::steady_clock::now();
+	beginResolutionFrame(&resolution);
+	beginAntiAliasingFrame(&antiAliasing);
 	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);    //GL_LINE = Wireframe;   GL_FILL = Solid
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 
-	float look_x = cos(deg2rad(angle)) * 200;
-	float look_z = sin(deg2rad(angle)) * 200;
+	int slot = acquireFrame(&pipeline);
+	if (slot < 0) return;
+	const FrameState* state = &frameStates[slot];
+	beginProfileFrame(&profiler);
+	beginGLCountersFrame();
+
+	// The keyboard camera is carried on from its last simulated step with
+	// the input as it is now, so key changes show in this frame rather
+	// than after the next tick reaches the screen
+	Vec3 eye = state->eye, target = state->target;
+	FrameTime inputSampled = pipeline.sampled[slot];
+	if (perFrameInput && state->isFreeCamera && !headless)
+	{
+		inputSampled = chrono::steady_clock::now();
+		float steps = chrono::duration<float, milli>(inputSampled - pipeline.sampled[slot]).count() / SIMULATION_STEP;
+		float x = state->camX, z = state->camZ, heading = state->camAngle;
+		moveCamera(&x, &z, &heading, readInput(), min(steps, (float)MAX_PREDICTED_STEPS));
+		cameraLookAt(x, z, heading, &eye, &target);
+	}
+	Mat4 view = mat4LookAt(eye, target, vec3(0, 1, 0));
+	if (pickX >= 0)
+	{
+		pickExhibit(state, eye, view, pickX, pickY);
+		pickX = -1;
+	}
+	int marker = beginProfileMarker(&profiler, "probes", true);
+	viewFrustum = frustumFromMatrix(projection * view);
+	renderProbeFaces(state, eye);
+	endProfileMarker(&profiler, marker);
+	marker = beginProfileMarker(&profiler, "record", false);
+	recordFrame(state, view, projection, &frameLists, false);
+	endProfileMarker(&profiler, marker);
+
+	placeSceneLights(view);
+
+	ReplayState replay;
+	forgetReplayState(&replay);
+	for (size_t i = 0; i < frameLists.size(); i++)
+	{
+		marker = beginProfileMarker(&profiler, slotName((int)i), true);
+		replayCommandList(&frameLists[i], texIds.data(), &replay);
+		endProfileMarker(&profiler, marker);
+	}
+	marker = beginProfileMarker(&profiler, "resolve", true);
+	endAntiAliasingFrame(&antiAliasing);
+	endProfileMarker(&profiler, marker);
+	marker = beginProfileMarker(&profiler, "upscale", true);
+	endResolutionFrame(&resolution);
+	endProfileMarker(&profiler, marker);
+	if (profilerOverlayEnabled && !headless) drawProfilerOverlay(&profiler, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+
+	marker = beginProfileMarker(&profiler, "capture", false);
+	captureFrame(&frameCapture);
+	endProfileMarker(&profiler, marker);
+
+	marker = beginProfileMarker(&profiler, headless ? "finish" : "swap", false);
+	if (headless) glFinish();
+		else glutSwapBuffers();
+	endProfileMarker(&profiler, marker);
+	resolveInputLatency(&inputLatency, inputSampled, chrono::steady_clock::now());
+	reportInputLatency(&inputLatency, 50);
+	endProfileFrame(&profiler);
+	endGLCountersFrame();
+	releaseFrame(&pipeline);
+	reportFrameLatency(&pipeline, 1000);
+	updateDynamicResolution(&resolution, chrono::duration<double, milli>(chrono::steady_clock::now() - frameStart).count());
+	reportDynamicResolution(&resolution, 100);
+}
 
-	gluLookAt(cam_x, cam_y, cam_z, cam_x + look_x, LOOK_HEIGHT, cam_z + look_z, 0, 1, 0);
-	glLightfv(GL_LIGHT0, GL_POSITION, lightDir);
+// Scene lights take GL_LIGHT0 onwards in file order; positions are set
+// each frame in display
+void initialiseLights()
+{
+	int lightCount = min((int)sceneFile.header->lightCount, SCENE_LIGHTS);
+	for (int i = 0; i < lightCount; i++)
+	{
+		const SceneLightDesc* light = &sceneFile.lights[i];
+		float colour[4] = { light->params.light.r, light->params.light.g, light->params.light.b, 1 };
+		glLightfv(GL_LIGHT0 + i, GL_DIFFUSE, colour);
+		glLightfv(GL_LIGHT0 + i, GL_SPECULAR, colour);
+		glEnable(GL_LIGHT0 + i);
+	}
+}
 
-	glLightfv(GL_LIGHT1, GL_DIFFUSE, grey);
-	glLightfv(GL_LIGHT1, GL_SPECULAR, grey);
-	glLightfv(GL_LIGHT1, GL_POSITION, innerLightPos);
+// Dust fills the space under the ceiling light from the start; sparks
+// are only emitted by cradle impacts
+void initialiseParticles()
+{
+	if (strcmp(particleMode, "off") == 0) particleMaterial = -1;
+	if (particleMaterial < 0) return;
+	initialiseParticlePool(&dustParticles, DUST_CAPACITY, vec3(0, -0.5, 0), 0.1, 1, 0.95, 0.8);
+	initialiseParticlePool(&sparkParticles, SPARK_CAPACITY, vec3(0, -200, 0), 1, 1, 0.7, 0.3);
+	Vec3 centre = museumNode >= 0 ? mat4GetTranslation(worldMatrix(&scene, museumNode)) : vec3(0, 0, 0);
+	ParticleEmitter dust = { centre + vec3(0, 45, 0), vec3(35, 40, 35), vec3(0, 0, 0), 3, 120, 10, 4, 0 };
+	ParticleEmitter sparks = { vec3(0, 0, 0), vec3(0.5, 0.5, 0.5), vec3(0, 20, 0), 40, 0, 0.4, 0.2, 0 };
+	dustEmitter = dust;
+	sparkEmitter = sparks;
+	for (int i = 0; museumNode >= 0 && i < 100; i++)
+	{
+		emitParticles(&dustParticles, &dustEmitter, 0.1);
+		advanceParticles(&dustParticles, 0.1);
+	}
+}
 
-	drawSkybox();
+// Registers an exhibit for picking: its platform joins the static
+// collider and its moving parts the sphere collider
+void addExhibitCollision(int node, const char* name, const vector<int>& parts)
+{
+	int owner = (int)exhibitNames.size();
+	exhibitNames.push_back(name);
+	Vec3 platform = vec3(platformDesc->params.platform.width, platformDesc->params.platform.height, platformDesc->params.platform.depth);
+	addColliderBox(&sceneCollider, worldMatrix(&scene, node) * mat4Scale(platform), owner);
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		addColliderSphere(&exhibitParts, scene.worldCentre[parts[i]], scene.worldRadius[parts[i]], owner);
+		exhibitPartNodes.push_back(parts[i]);
+	}
+}
 
-	drawFloor();
+// World-space walls, pillars and platforms for the camera to collide
+// with and picking rays to stop at, built once from the scene graph.
+// The museum floor and roof are left out: the camera stays between them.
+void initialiseCollision()
+{
+	for (size_t i = 0; i < museumWallNodes.size(); i++)
+	{
+		if (museumWallNodes[i] >= 0) addColliderMesh(&sceneCollider, &museumWallMesh, worldMatrix(&scene, museumWallNodes[i]), -1);
+	}
+	for (size_t i = 0; i < museumPillarNodes.size(); i++)
+	{
+		addColliderMesh(&sceneCollider, &museumPillarMesh, worldMatrix(&scene, museumPillarNodes[i]), -1);
+	}
 
-	// Shadows
-	float lightPos[3] = {120, 90, 0};
-	float shadowMatrix[16] = {
-		lightPos[1], 0, 0, 0,
-		-lightPos[0], 0, -lightPos[2], -1,
-		0, 0, lightPos[1], 0,
-		0, 0, 0, lightPos[1]
-	};
+	for (size_t i = 0; i < travellerExhibits.size(); i++)
+	{
+		addExhibitCollision(travellerExhibits[i].node, travellerExhibits[i].name, travellerExhibits[i].travellers);
+	}
+	for (size_t i = 0; i < mobiusExhibits.size(); i++)
+	{
+		vector<int> parts = mobiusExhibits[i].balls;
+		parts.push_back(mobiusExhibits[i].strip);
+		addExhibitCollision(mobiusExhibits[i].node, mobiusExhibits[i].name, parts);
+	}
+	for (size_t i = 0; i < cradleExhibits.size(); i++)
+	{
+		vector<int> parts(cradleExhibits[i].balls, cradleExhibits[i].balls + CRADLE_BALLS);
+		addExhibitCollision(cradleExhibits[i].node, cradleExhibits[i].name, parts);
+	}
+	buildTriangleCollider(&sceneCollider);
+	buildSphereCollider(&exhibitParts);
+}
 
-	glDisable(GL_LIGHTING);
-	glPushMatrix();
-		glTranslatef(0, 5.1, 0);
-		glMultMatrixf(shadowMatrix);
-		drawMobiusStrip(true);
-	glPopMatrix();
-	
-	glPushMatrix();
-		glTranslatef(0, 0.01, 0);
-		lightPos[0] = 0;
-		lightPos[1] = 500;
-		lightPos[2] = -500;
-		shadowMatrix[0] = lightPos[1];
-		shadowMatrix[4] = -lightPos[0];
-		shadowMatrix[6] = -lightPos[2];
-		shadowMatrix[10] = lightPos[1];
-		shadowMatrix[15] = lightPos[1];
-
-		glMultMatrixf(shadowMatrix);
-		drawMuseum(true);
-	glPopMatrix();
-	
-
-	// glPushMatrix();
-	// 	glTranslatef(0, 5.1, 0);
-	// 	lightPos[0] = -120;
-	// 	lightPos[1] = 90;
-	// 	lightPos[2] = 0;
-	// 	shadowMatrix[0] = lightPos[1];
-	// 	shadowMatrix[4] = -lightPos[0];
-	// 	shadowMatrix[6] = -lightPos[2];
-	// 	shadowMatrix[10] = lightPos[1];
-	// 	shadowMatrix[15] = lightPos[1];
-
-	// 	glMultMatrixf(shadowMatrix);
-	// 	drawNewtonsCradle(true);
-	// glPopMatrix();
-	
-	glPushMatrix();
-		glTranslatef(0, 5.1, 0);
-		lightPos[0] = 0;
-		lightPos[1] = 90;
-		lightPos[2] = 120;
-		shadowMatrix[0] = lightPos[1];
-		shadowMatrix[4] = -lightPos[0];
-		shadowMatrix[6] = -lightPos[2];
-		shadowMatrix[10] = lightPos[1];
-		shadowMatrix[15] = lightPos[1];
-
-		glMultMatrixf(shadowMatrix);
-		drawMetatravellers(true);
-	glPopMatrix();
-	glEnable(GL_LIGHTING);
+// Everything that does not need a GL context: scene lookups, the scene
+// graph and the meshes. Expects sceneFile to be loaded.
+void initialiseScene()
+{
+	floorDesc = findSceneMesh(&sceneFile, "floor");
+	platformDesc = findSceneMesh(&sceneFile, "platform");
+	pillarDesc = findSceneMesh(&sceneFile, "pillar");
+	cam_z = -floorDesc->params.floor.halfZ / 2;
+
+	findMaterials();
+	initialiseSceneGraph();
+	initialiseSkybox();
+	initialiseFloor();
+	if (museumNode >= 0)
+	{
+		initialiseMuseumWalls();
+		initialiseMuseumFloor();
+	}
+	initialisePillars();
+	initialisePlatform();
+	initialiseMobiusStrip();
+	initialiseCollision();
+	initialiseParticles();
+	projection = mat4Perspective(FIELD_OF_VIEW, 1, NEAR_PLANE, FAR_PLANE);
+}
+
+// Canned flythroughs, built from the loaded scene so they follow the
+// museum and exhibits wherever the scene file puts them:
+//     approach   from far outside up to the entrance (side 0, facing -z)
+//     inside     a sweep around the inside of the museum
+//     exhibits   a close-up of each exhibit in turn
+//     tour       all three, one after another
+bool buildCannedCameraPath(const string& name, CameraPath* path)
+{
+	Vec3 centre = museumNode >= 0 ? mat4GetTranslation(worldMatrix(&scene, museumNode)) : vec3(0, 0, 0);
+	float radius = museumNode >= 0 ? museumRadius : 180;
+
+	if (name == "approach")
+	{
+		Vec3 target = centre + vec3(0, 40, 0);
+		addCameraKey(path, 0, centre + vec3(0, 120, -6 * radius), target);
+		addCameraKey(path, 6, centre + vec3(0, 60, -2.2 * radius), target);
+		addCameraKey(path, 10, centre + vec3(0, 45, -1.1 * radius), centre + vec3(0, 35, 0));
+		return true;
+	}
+	if (name == "inside")
+	{
+		// Standing off-centre and looking across at the far walls
+		for (int i = 0; i <= 8; i++)
+		{
+			float a = deg2rad(90 + i * 45);
+			Vec3 direction = vec3(cos(a), 0, sin(a));
+			addCameraKey(path, i * 1.5, centre - direction * (0.2 * radius) + vec3(0, 50, 0), centre + direction * (0.9 * radius) + vec3(0, 30, 0));
+		}
+		return true;
+	}
+	if (name == "exhibits")
+	{
+		vector<int> nodes;
+		for (size_t i = 0; i < travellerExhibits.size(); i++) nodes.push_back(travellerExhibits[i].node);
+		for (size_t i = 0; i < mobiusExhibits.size(); i++) nodes.push_back(mobiusExhibits[i].node);
+		for (size_t i = 0; i < cradleExhibits.size(); i++) nodes.push_back(cradleExhibits[i].node);
+
+		// Two seconds to move and two to hold, viewed from the museum's centre
+		// side. Between exhibits the camera looks halfway round, so the view
+		// turns instead of sweeping across the floor.
+		Vec3 lastOutward = vec3(0, 0, 1);
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			Vec3 position = mat4GetTranslation(worldMatrix(&scene, nodes[i]));
+			Vec3 outward = vec3(position.x - centre.x, 0, position.z - centre.z);
+			outward = length(outward) > 0 ? outward * (1 / length(outward)) : vec3(0, 0, 1);
+			if (i > 0)
+			{
+				Vec3 halfway = lastOutward + outward;
+				halfway = length(halfway) > 0.1 ? halfway * (1 / length(halfway)) : vec3(-outward.z, 0, outward.x);
+				addCameraKey(path, i * 4 - 1, centre + vec3(0, 50, 0), centre + halfway * radius + vec3(0, 30, 0));
+			}
+			Vec3 eye = position - outward * 90 + vec3(0, 45, 0), target = position + vec3(0, 25, 0);
+			addCameraKey(path, i * 4, eye, target);
+			addCameraKey(path, i * 4 + 2, eye, target);
+			lastOutward = outward;
+		}
+		return !nodes.empty();
+	}
+	if (name == "tour")
+	{
+		const char* parts[3] = { "approach", "inside", "exhibits" };
+		for (int i = 0; i < 3; i++)
+		{
+			CameraPath part;
+			if (buildCannedCameraPath(parts[i], &part)) appendCameraPath(path, &part, 2);
+		}
+		return true;
+	}
+	return false;
+}
+
+// Bakes the museums' walls, pillars and floors against everything that
+// never moves: the collision geometry plus the floors and roofs. The
+// scene lights are baked in; the cradle spotlights only light what is
+// drawn lit. Needs a current GL context for the upload.
+void initialiseLightmaps()
+{
+	if (!lightmapsEnabled || museumNode < 0) return;
+	float angle = 360.0 / museumSides;
+	float wallLength = tan(deg2rad(angle / 2)) * museumRadius * 2;
+	float pillarDistance = museumRadius / sin(deg2rad(angle));
+	float pillarRadius = pillarDesc->params.pillar.radius, pillarHeight = pillarDesc->params.pillar.height;
+
+	// Both faces of a wall share one mesh facing into the museum, so the
+	// outer face is lit from behind
+	museumWallCharts.assign(museumWallNodes.size(), -1);
+	for (size_t i = 0; i < museumWallNodes.size(); i++)
+	{
+		if (museumWallNodes[i] < 0) continue;
+		museumWallCharts[i] = addLightmapChart(&lightmap, &museumWallMesh, worldMatrix(&scene, museumWallNodes[i]), wallLength, 100, i % 2 == 1);
+	}
+	for (size_t i = 0; i < museumPillarNodes.size(); i++)
+	{
+		museumPillarCharts.push_back(addLightmapChart(&lightmap, &museumPillarMesh, worldMatrix(&scene, museumPillarNodes[i]),
+			TWO_PI * pillarRadius, pillarHeight, false));
+	}
 
-	// Draw
-	glPushMatrix();
-		glEnable(GL_LIGHT0);
-		drawMuseum(false);
-		glDisable(GL_LIGHT0);
+	TriangleCollider occluders = sceneCollider;
+	for (size_t m = 0; m < museumNodes.size(); m++)
+	{
+		Mat4 world = worldMatrix(&scene, museumNodes[m]);
+		museumFloorCharts.push_back(addLightmapChart(&lightmap, &museumFloorMesh, world, pillarDistance * 2, pillarDistance * 2, false));
+		addColliderMesh(&occluders, &museumFloorMesh, world, -1);
+		addColliderMesh(&occluders, primitiveMesh(PRIMITIVE_CONE, 0, museumSides, museumSides), world * mat4Translation(vec3(0, 100, 0))
+			* mat4Rotation(-90, vec3(1, 0, 0)) * mat4Scale(vec3(pillarDistance + 20, pillarDistance + 20, 100)), -1);
+	}
+	buildTriangleCollider(&occluders);
 
-		drawMetatravellers(false);
-		drawMobiusStrip(false);
-		drawNewtonsCradle(false);
-		drawCeilingLight();
-	glPopMatrix();
+	int lightCount = min((int)sceneFile.header->lightCount, SCENE_LIGHTS);
+	for (int i = 0; i < lightCount; i++)
+	{
+		const SceneLightDesc* light = &sceneFile.lights[i];
+		addLightmapLight(&lightmap, vec3(light->params.light.x, light->params.light.y, light->params.light.z),
+			vec3(light->params.light.r, light->params.light.g, light->params.light.b), light->type == SCENE_LIGHT_POINT);
+	}
 
-	glutSwapBuffers();
+	auto start = chrono::steady_clock::now();
+	bakeLightmap(&lightmap, &occluders);
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	lightmapTexture = uploadLightmap(&lightmap);
+	cout << "lightmaps: " << lightmap.charts.size() << " charts in a " << lightmap.size << "x" << lightmap.size << " atlas at "
+		<< lightmap.texelsPerUnit << " texels per unit, " << lightmap.texelsBaked << " texels and " << lightmap.rays
+		<< " rays in " << ms << " ms on " << workerCount() << " threads" << endl;
+}
+
+// Gives each mobius strip and cradle a reflection probe at the height
+// of its balls, with the probe's cube map appended to the materials
+void initialiseReflections()
+{
+	if (probeFacesPerFrame <= 0) return;
+	initialiseReflectionProbes(&reflectionProbes, probeSize, probeFacesPerFrame);
+	for (size_t i = 0; i < mobiusExhibits.size(); i++)
+	{
+		Vec3 position = mat4GetTranslation(worldMatrix(&scene, mobiusExhibits[i].node)) + vec3(0, 20, 0);
+		mobiusExhibits[i].reflection = (int)texIds.size();
+		texIds.push_back(addReflectionProbe(&reflectionProbes, position));
+	}
+	for (size_t i = 0; i < cradleExhibits.size(); i++)
+	{
+		Vec3 position = mat4GetTranslation(worldMatrix(&scene, cradleExhibits[i].node)) + vec3(0, 10, 0);
+		cradleExhibits[i].reflection = (int)texIds.size();
+		texIds.push_back(addReflectionProbe(&reflectionProbes, position));
+	}
+}
+
+// Sets up input recording or replay and the camera path from the
+// command line options
+void initialiseInput()
+{
+	if (inputReplayPath) loadInputLog(&inputLog, inputReplayPath);
+	if (inputRecordPath) startInputRecording(&inputLog, inputRecordPath, SIMULATION_STEP);
+	if (cameraPathName && !buildCannedCameraPath(cameraPathName, &cameraPath)) loadCameraPath(&cameraPath, cameraPathName);
+	if (cameraPathSavePath) saveCameraPath(&cameraPath, cameraPathSavePath);
 }
 
 void initialize()
 {
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 
+	if (!sceneFile.header) loadSceneFile(&sceneFile, scenePath);	// unless one was generated
+	initialiseScene();
 	loadTextures();
-	initialisePillars();
-	initialiseMetatravellers();
-	initialiseMobiusStrip();
+	initialiseLightmaps();
+	initialiseLights();
+	initialiseJobSystem(&jobs, workerCount());
+	initialiseProfiler(&profiler, profilePath);
+	initialiseInput();
+	int mode, samples;
+	parseAntiAliasing(antiAliasingOption ? antiAliasingOption : (headless ? "off" : "msaa4"), &mode, &samples);
+	setAntiAliasing(&antiAliasing, mode, samples, WINDOW_SIZE, WINDOW_SIZE);
+	if (resolutionTargetMs > 0) initialiseDynamicResolution(&resolution, WINDOW_SIZE, WINDOW_SIZE, resolutionTargetMs);
+	if (capturePath) beginCapture(&frameCapture, capturePath, WINDOW_SIZE, WINDOW_SIZE, 1000 / SIMULATION_STEP);
+	initialiseReflections();
+	startSimulation();
 
 	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-	glEnable(GL_LIGHT1);
 	glEnable(GL_LIGHT2);
 	glEnable(GL_LIGHT3);
 	glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
@@ -1242,12 +1839,359 @@ void initialize()
 	glEnable(GL_NORMALIZE);
 
 	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(60, 1, 10, 5000);
+	glLoadMatrixf(projection.m);
+}
+
+// Adds 'exhibits' exhibits on a grid, cycling through the three kinds,
+// to the scene file given with --scene (the museum by default), and
+// times a frame of animation, scene graph update and parallel recording
+// for each thread count from 1 to the core count. Recording never
+// touches GL, so no window is needed.
+void benchmarkRecording(int exhibits, int maxThreads)
+{
+	ifstream in(scenePath);
+	if (!in)
+	{
+		cout << "*** Error opening scene file " << scenePath << endl;
+		exit(1);
+	}
+	string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	text += "\n";
+	const char* types[3] = { "travellers", "mobius", "cradle" };
+	int columns = (int)ceil(sqrt((double)exhibits));
+	for (int i = 0; i < exhibits; i++)
+	{
+		char line[128];
+		float x = (i % columns - columns / 2) * 100.0f, z = (i / columns - columns / 2) * 100.0f;
+		snprintf(line, sizeof(line), "node bench%d %s - %g 0 %g 0\n", i, types[i % 3], x, z);
+		text += line;
+	}
+	loadSceneText(&sceneFile, text, "bench");
+	initialiseScene();
+
+	// Look across the whole grid so nothing is culled
+	Mat4 view = mat4LookAt(vec3(0, 3000, -3000), vec3(0, 0, 0), vec3(0, 1, 0));
+	const int frames = 200;
+	FrameState state;
+	double baseline = 0;
+	cout << "exhibits: " << travellerExhibits.size() + mobiusExhibits.size() + cradleExhibits.size() << endl;
+	for (int threads = 1; threads <= maxThreads; threads++)
+	{
+		initialiseJobSystem(&jobs, threads);
+		auto start = chrono::steady_clock::now();
+		size_t commands = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (size_t e = 0; e < travellerExhibits.size(); e++)
+			{
+				advanceTravellers(&travellerExhibits[e].batch, 0.01);
+			}
+			mobiusStripBallAngle = (mobiusStripBallAngle + 1) % 720;
+			advanceCradles(&cradle, 0.01);
+			updateSceneAnimation();
+			captureFrameState(&state);
+			recordFrame(&state, view, projection, &frameLists, false);
+		}
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frames;
+		for (size_t i = 0; i < frameLists.size(); i++)
+		{
+			commands += frameLists[i].commands.size();
+		}
+		shutdownJobSystem(&jobs);
+
+		if (threads == 1) baseline = ms;
+		cout << "threads: " << threads << ", frame: " << ms << " ms, speed-up: " << baseline / ms
+			<< ", commands: " << commands << endl;
+	}
+}
+
+// Times the camera's collision queries and picking rays against the
+// scene's walls, pillars and platforms, repeated on a grid up to
+// 'copies' times. Needs no window.
+void benchmarkCollision(int copies)
+{
+	loadSceneFile(&sceneFile, scenePath);
+	initialiseScene();
+	cout << "scene triangles: " << sceneCollider.owner.size() << ", exhibit parts: " << exhibitParts.owner.size() << endl;
+	benchmarkTriangleCollider(&sceneCollider, copies, cam_y, CAMERA_RADIUS, MOVE_SPEED * 2.5);
+}
+
+// Renders 'frames' frames offscreen, one simulation step each, and
+// reports frame times. Frame i always shows simulation step i + 1, so
+// runs are repeatable. With a pattern such as "frames/%04d.png" every
+// frame is also written out; writing is not included in the timings.
+void runHeadless(int frames, const char* framePattern)
+{
+	HeadlessContext context;
+	createHeadlessContext(&context, WINDOW_SIZE, WINDOW_SIZE);
+	headless = true;
+	strokeTextEnabled = false;
+	initialize();
+
+	// Zero frames runs the camera path to its end
+	if (frames <= 0) frames = (int)(cameraPathDuration(&cameraPath) * 1000 / SIMULATION_STEP) + 1;
+
+	vector<double> times;
+	vector<unsigned char> rgb;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		auto start = chrono::steady_clock::now();
+		display();
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+		if (framePattern)
+		{
+			char path[256];
+			snprintf(path, sizeof(path), framePattern, frame);
+			readHeadlessFrame(&context, &rgb);
+			savePNG(path, context.width, context.height, rgb.data());
+		}
+	}
+	shutdown();
+	destroyHeadlessContext(&context);
+
+	// The first frame pays for shader compilation and texture uploads
+	cout << "frames: " << frames << " at " << WINDOW_SIZE << "x" << WINDOW_SIZE << ", first frame: " << times[0] << " ms" << endl;
+	if (frames > 1)
+	{
+		vector<double> sorted(times.begin() + 1, times.end());
+		sort(sorted.begin(), sorted.end());
+		double total = 0;
+		for (size_t i = 0; i < sorted.size(); i++) total += sorted[i];
+		double average = total / sorted.size();
+		cout << "frame time: average " << average << " ms (" << 1000 / average << " fps), min " << sorted.front()
+			<< " ms, median " << sorted[sorted.size() / 2] << " ms, 95th " << sorted[(sorted.size() * 95) / 100]
+			<< " ms, max " << sorted.back() << " ms" << endl;
+	}
+	printGLCounters("gl calls, last frame", &glLastCounters);
+	printGLCounters("gl calls, worst frame", &glPeakCounters);
+	cout << "mesh vertex data: " << meshBytesDrawn / frames / 1024.0 << " KB a frame, "
+		<< meshFloatBytesDrawn / frames / 1024.0 << " KB as floats" << endl;
+	printProcessMemory("memory");
+
+	if (glBudgetPath)
+	{
+		GLCounters budget;
+		loadGLBudget(glBudgetPath, &budget);
+		if (!checkGLBudget(&glPeakCounters, &budget)) exit(1);
+		cout << "gl calls within budget " << glBudgetPath << endl;
+	}
+}
+
+// Scene text for stress tests: the scene file's materials, meshes and
+// lights, with its nodes replaced by 'museums' museums and the given
+// numbers of each exhibit, one to a grid cell. Each museum holds one
+// exhibit of each kind where the museum scene has them; the rest stand
+// in the open. Nodes keep the parameters of the scene file's first node
+// of their type. The floor grows to fit with the same number of tiles.
+string generateStressScene(int museums, int travellers, int mobius, int cradles)
+{
+	ifstream in(scenePath);
+	if (!in)
+	{
+		cout << "*** Error opening scene file " << scenePath << endl;
+		exit(1);
+	}
+	const char* types[4] = { "museum", "travellers", "mobius", "cradle" };
+	string params[4], text, line;
+	while (getline(in, line))
+	{
+		istringstream tokens(line);
+		string keyword, name, type, skip;
+		tokens >> keyword >> name >> type;
+		if (keyword == "mesh" && type == "floor") continue;
+		if (keyword != "node")
+		{
+			text += line + "\n";
+			continue;
+		}
+		for (int i = 0; i < 4; i++)
+		{
+			if (type != types[i] || !params[i].empty()) continue;
+			for (int j = 0; j < 5; j++) tokens >> skip;	// parent x y z yaw
+			getline(tokens >> ws, params[i]);
+		}
+	}
+
+	// x, z and yaw of each exhibit inside a museum
+	const float slots[3][3] = { { 0, 120, 0 }, { 120, 0, 90 }, { -120, 0, -90 } };
+	int counts[3] = { travellers, mobius, cradles };
+	int cells = museums;
+	for (int i = 0; i < 3; i++) cells += max(0, counts[i] - museums);
+	int columns = max(1, (int)ceil(sqrt((double)cells)));
+	float half = maxf(1000, (columns / 2.0f + 1) * STRESS_CELL);
+	int tile = max(10, (int)(half / 100));
+
+	char buffer[256];
+	text += "\n# Generated: " + to_string(museums) + " museums, " + to_string(travellers) + " travellers, "
+		+ to_string(mobius) + " mobius, " + to_string(cradles) + " cradles\n";
+	snprintf(buffer, sizeof(buffer), "mesh floor floor half_x=%g half_z=%g tile=%d tex_scale=%g\n", half, half, tile, 80.0 / tile);
+	text += buffer;
+	int cell = 0;
+	for (int m = 0; m < museums; m++, cell++)
+	{
+		float x = (cell % columns - (columns - 1) / 2.0f) * STRESS_CELL, z = (cell / columns - (columns - 1) / 2.0f) * STRESS_CELL;
+		snprintf(buffer, sizeof(buffer), "node museum%d museum - %g 0 %g 0 ", m, x, z);
+		text += buffer + params[0] + "\n";
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		for (int e = 0; e < counts[i]; e++)
+		{
+			if (e < museums)
+			{
+				snprintf(buffer, sizeof(buffer), "node %s%d %s museum%d %g 0 %g %g ", types[i + 1], e, types[i + 1], e,
+					slots[i][0], slots[i][1], slots[i][2]);
+			}
+			else
+			{
+				float x = (cell % columns - (columns - 1) / 2.0f) * STRESS_CELL, z = (cell / columns - (columns - 1) / 2.0f) * STRESS_CELL;
+				snprintf(buffer, sizeof(buffer), "node %s%d %s - %g 0 %g 0 ", types[i + 1], e, types[i + 1], x, z);
+				cell++;
+			}
+			text += buffer + params[i + 1] + "\n";
+		}
+	}
+	return text;
+}
+
+// Renders generated scenes of 1, 2, 4 ... times the given counts, one
+// step per child process so each step's memory figures are its own and
+// a step that crashes is reported instead of ending the run
+void benchmarkStressScenes(int steps, int museums, int travellers, int mobius, int cradles)
+{
+	for (int step = 0; step < steps; step++)
+	{
+		int scale = 1 << step;
+		cout << "step " << step + 1 << ": " << museums * scale << " museums, " << travellers * scale << " travellers, "
+			<< mobius * scale << " mobius, " << cradles * scale << " cradles" << endl;
+		pid_t child = fork();
+		if (child == 0)
+		{
+			string text = generateStressScene(museums * scale, travellers * scale, mobius * scale, cradles * scale);
+			loadSceneText(&sceneFile, text, "stress");
+			runHeadless(STRESS_FRAMES, 0);
+			cout << flush;
+			_exit(0);
+		}
+		int status = 0;
+		if (child < 0 || waitpid(child, &status, 0) != child)
+		{
+			cout << "*** Error running step " << step + 1 << endl;
+			exit(1);
+		}
+		if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0)
+		{
+			cout << "step " << step + 1 << " failed: " << (WIFSIGNALED(status) ? "signal " : "exit code ")
+				<< (WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status)) << endl;
+			return;
+		}
+	}
+}
+
+// Renders 'frames' frames offscreen in each anti-aliasing mode in turn
+// and compares their frame times. The first frame of each mode, which
+// creates its targets, is not timed.
+void benchmarkAntiAliasing(int frames)
+{
+	HeadlessContext context;
+	createHeadlessContext(&context, WINDOW_SIZE, WINDOW_SIZE);
+	headless = true;
+	strokeTextEnabled = false;
+	initialize();
+
+	const char* modes[5] = { "off", "msaa2", "msaa4", "msaa8", "fxaa" };
+	double baseline = 0;
+	for (int m = 0; m < 5; m++)
+	{
+		int mode, samples;
+		parseAntiAliasing(modes[m], &mode, &samples);
+		setAntiAliasing(&antiAliasing, mode, samples, WINDOW_SIZE, WINDOW_SIZE);
+		display();
+
+		vector<double> times;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			auto start = chrono::steady_clock::now();
+			display();
+			times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		}
+		sort(times.begin(), times.end());
+		double total = 0;
+		for (size_t i = 0; i < times.size(); i++) total += times[i];
+		double average = total / times.size();
+		if (m == 0) baseline = average;
+		cout << "aa: " << antiAliasingName(&antiAliasing) << ", frame: " << average << " ms average, "
+			<< times[times.size() / 2] << " ms median, " << times[(times.size() * 95) / 100] << " ms 95th, "
+			<< average - baseline << " ms over off" << endl;
+	}
+	shutdown();
+	destroyHeadlessContext(&context);
+}
+
+// Times a pool of 'count' particles: the update on its own (see
+// benchmarkParticles), then the update plus drawing the pool as one
+// point sprite batch into an offscreen window
+void benchmarkParticleDrawing(int count, int frames)
+{
+	benchmarkParticles(count);
+
+	HeadlessContext context;
+	createHeadlessContext(&context, WINDOW_SIZE, WINDOW_SIZE);
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	loadTGA("textures/particle.tga");
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glEnable(GL_DEPTH_TEST);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(mat4Perspective(FIELD_OF_VIEW, 1, NEAR_PLANE, FAR_PLANE).m);
+	glMatrixMode(GL_MODELVIEW);
+
+	ParticlePool pool;
+	initialiseParticlePool(&pool, count, vec3(0, -98, 0), 0.5, 1, 0.7, 0.3);
+	ParticleEmitter emitter = { vec3(0, 50, 0), vec3(50, 50, 50), vec3(0, 20, 0), 30, 0, 2, 1, 0 };
+	ParticleVertices vertices;
+	CommandList list;
+	Mat4 view = mat4LookAt(vec3(0, 50, -300), vec3(0, 50, 0), vec3(0, 1, 0));
+	double updateMs = 0, drawMs = 0;
+	for (int frame = 0; frame <= frames; frame++)
+	{
+		spawnParticles(&pool, &emitter, pool.capacity - pool.count);
+		auto start = chrono::steady_clock::now();
+		advanceParticles(&pool, 1 / 60.0f);
+		writeParticleVertices(&pool, &vertices);
+		auto updated = chrono::steady_clock::now();
+
+		clearCommandList(&list);
+		recordEnable(&list, RENDER_STATE_TEXTURE);
+		recordTextureMode(&list, TEXTURE_MODE_MODULATE);
+		recordMaterial(&list, 0);
+		recordMatrix(&list, view);
+		recordParticles(&list, vertices.data.data(), vertices.count, 2, 100, true);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		ReplayState replay;
+		forgetReplayState(&replay);
+		replayCommandList(&list, &texture, &replay);
+		glFinish();
+
+		// The first frame warms up the driver
+		if (frame == 0) continue;
+		updateMs += chrono::duration<double, milli>(updated - start).count();
+		drawMs += chrono::duration<double, milli>(chrono::steady_clock::now() - updated).count();
+	}
+	cout << "draw: " << vertices.count << " particles in one call at " << WINDOW_SIZE << "x" << WINDOW_SIZE << ", update "
+		<< updateMs / frames << " ms + draw " << drawMs / frames << " ms = " << (updateMs + drawMs) / frames << " ms/frame" << endl;
+
+	freeParticlePool(&pool);
+	glDeleteTextures(1, &texture);
+	destroyHeadlessContext(&context);
 }
 
 void special(int key, int x, int y)
 {
+	InputState before = readInput();
 	switch (key)
 	{
 		case GLUT_KEY_LEFT:
@@ -1266,10 +2210,12 @@ void special(int key, int x, int y)
 			speedModifier = 2.5;
 			break;
 	}
+	if (!sameInput(before, readInput())) noteInputChange(&inputLatency);
 }
 
 void specialUp(int key, int x, int y)
 {
+	InputState before = readInput();
 	switch (key)
 	{
 		case GLUT_KEY_LEFT:
@@ -1288,6 +2234,7 @@ void specialUp(int key, int x, int y)
 			speedModifier = 1;
 			break;
 	}
+	if (!sameInput(before, readInput())) noteInputChange(&inputLatency);
 }
 
 void keyboard(unsigned char key, int x, int y)
@@ -1297,16 +2244,146 @@ void keyboard(unsigned char key, int x, int y)
 		case 'e':
 			metatravellerRingsEnabled = !metatravellerRingsEnabled;
 			break;
+		case 'p':
+			profilerOverlayEnabled = !profilerOverlayEnabled;
+			break;
 	}
 	glutPostRedisplay();
 }
 
+void mouse(int button, int buttonState, int x, int y)
+{
+	if (button != GLUT_LEFT_BUTTON || buttonState != GLUT_DOWN) return;
+	pickX = x;
+	pickY = y;
+	glutPostRedisplay();
+}
+
+// Value following 'name' anywhere on the command line, or null
+const char* findOption(int argc, char** argv, const char* name)
+{
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], name) == 0) return argv[i + 1];
+	}
+	return 0;
+}
+
 int main(int argc, char** argv)
 {
+   if (argc > 3 && strcmp(argv[1], "--compile-scene") == 0)
+   {
+      compileSceneFile(argv[2], argv[3]);
+      return 0;
+   }
+   // Options that combine with the modes below
+   if (findOption(argc, argv, "--scene")) scenePath = findOption(argc, argv, "--scene");
+   if (findOption(argc, argv, "--pipeline-depth")) pipelineDepth = atoi(findOption(argc, argv, "--pipeline-depth"));
+   profilePath = findOption(argc, argv, "--profile");
+   glBudgetPath = findOption(argc, argv, "--gl-budget");
+   cameraPathName = findOption(argc, argv, "--camera-path");
+   cameraPathSavePath = findOption(argc, argv, "--save-camera-path");
+   inputRecordPath = findOption(argc, argv, "--record-input");
+   inputReplayPath = findOption(argc, argv, "--replay-input");
+   capturePath = findOption(argc, argv, "--capture");
+   if (findOption(argc, argv, "--dynamic-resolution")) resolutionTargetMs = atof(findOption(argc, argv, "--dynamic-resolution"));
+   antiAliasingOption = findOption(argc, argv, "--aa");
+   if (findOption(argc, argv, "--probe-faces")) probeFacesPerFrame = atoi(findOption(argc, argv, "--probe-faces"));
+   if (findOption(argc, argv, "--particles")) particleMode = findOption(argc, argv, "--particles");
+   if (findOption(argc, argv, "--probe-size")) probeSize = atoi(findOption(argc, argv, "--probe-size"));
+   if (findOption(argc, argv, "--input-path")) perFrameInput = strcmp(findOption(argc, argv, "--input-path"), "tick") != 0;
+   if (findOption(argc, argv, "--lightmaps")) lightmapsEnabled = strcmp(findOption(argc, argv, "--lightmaps"), "off") != 0;
+   const char* vertexFormat = findOption(argc, argv, "--vertex-format");
+   if (vertexFormat && strcmp(vertexFormat, "packed") == 0) meshVertexFormat = MESH_FORMAT_PACKED;
+   meshOrderOption = findOption(argc, argv, "--mesh-order");
+   if (meshOrderOption && strcmp(meshOrderOption, "generated") == 0) meshIndexOrder = MESH_ORDER_GENERATED;
+   int mode, samples;
+   if (antiAliasingOption && !parseAntiAliasing(antiAliasingOption, &mode, &samples))
+   {
+      cout << "*** Error: unknown anti-aliasing mode " << antiAliasingOption << " (off, msaa2, msaa4, msaa8 or fxaa)" << endl;
+      return 1;
+   }
+   if (strcmp(particleMode, "on") != 0 && strcmp(particleMode, "sorted") != 0 && strcmp(particleMode, "off") != 0)
+   {
+      cout << "*** Error: unknown particle mode " << particleMode << " (on, sorted or off)" << endl;
+      return 1;
+   }
+   if (vertexFormat && strcmp(vertexFormat, "packed") != 0 && strcmp(vertexFormat, "float") != 0)
+   {
+      cout << "*** Error: unknown vertex format " << vertexFormat << " (float or packed)" << endl;
+      return 1;
+   }
+   if (meshOrderOption && strcmp(meshOrderOption, "generated") != 0 && strcmp(meshOrderOption, "optimised") != 0)
+   {
+      cout << "*** Error: unknown mesh order " << meshOrderOption << " (generated or optimised)" << endl;
+      return 1;
+   }
+
+   if (argc > 2 && strcmp(argv[1], "--bench-cradles") == 0)
+   {
+      benchmarkCradles(atoi(argv[2]), CRADLE_LENGTH, GRAVITY / (CRADLE_LENGTH / 100.0));
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-math") == 0)
+   {
+      benchmarkMath(atoi(argv[2]));
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-particles") == 0)
+   {
+      benchmarkParticleDrawing(atoi(argv[2]), 20);
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-travellers") == 0)
+   {
+      benchmarkTravellers(atoi(argv[2]), 20, 5, METATRAVELLER_SPIRALS, deg2rad(METATRAVELLER_SPEED * 100.0));
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-record") == 0)
+   {
+      // The thread count is optional, so options such as --scene may follow directly
+      bool hasThreads = argc > 3 && strncmp(argv[3], "--", 2) != 0;
+      benchmarkRecording(atoi(argv[2]), hasThreads ? atoi(argv[3]) : workerCount());
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-collision") == 0)
+   {
+      benchmarkCollision(atoi(argv[2]));
+      return 0;
+   }
+   if (argc > 6 && strcmp(argv[1], "--generate-scene") == 0)
+   {
+      ofstream out(argv[2]);
+      out << generateStressScene(atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), atoi(argv[6]));
+      if (!out)
+      {
+         cout << "*** Error writing scene file " << argv[2] << endl;
+         return 1;
+      }
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-stress") == 0)
+   {
+      bool hasCounts = argc > 6 && argv[3][0] != '-';
+      benchmarkStressScenes(atoi(argv[2]), hasCounts ? atoi(argv[3]) : 1, hasCounts ? atoi(argv[4]) : 1,
+         hasCounts ? atoi(argv[5]) : 1, hasCounts ? atoi(argv[6]) : 1);
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--bench-aa") == 0)
+   {
+      benchmarkAntiAliasing(atoi(argv[2]));
+      return 0;
+   }
+   if (argc > 2 && strcmp(argv[1], "--headless") == 0)
+   {
+      runHeadless(atoi(argv[2]), argc > 3 && argv[3][0] != '-' ? argv[3] : 0);
+      return 0;
+   }
+
    glutInit(&argc, argv);
-   glutSetOption(GLUT_MULTISAMPLE, 4);
-   glutInitDisplayMode (GLUT_DOUBLE | GLUT_DEPTH | GLUT_MULTISAMPLE);
-   glutInitWindowSize (800, 800); 
+   // Anti-aliasing happens offscreen, see AntiAlias.h
+   glutInitDisplayMode (GLUT_DOUBLE | GLUT_DEPTH);
+   glutInitWindowSize (WINDOW_SIZE, WINDOW_SIZE); 
    glutInitWindowPosition (10, 10);
    glutCreateWindow ("Museum");
    initialize();
@@ -1315,7 +2392,9 @@ int main(int argc, char** argv)
    glutSpecialFunc(special);
    glutSpecialUpFunc(specialUp);
    glutKeyboardFunc(keyboard);
-   glutTimerFunc(10, timer, 0);
+   glutMouseFunc(mouse);
+   glutCloseFunc(shutdown);
+   glutTimerFunc(SIMULATION_STEP, timer, 0);
    glutMainLoop();
    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+//=====================================================================
+// AntiAlias.h
+// Selectable anti-aliasing for the scene: none, MSAA with 2, 4 or 8
+// samples, or FXAA. MSAA draws into a multisampled framebuffer object
+// that is resolved with a blit; FXAA draws into a single-sampled one
+// and filters it onto the output in one fragment shader pass, which
+// costs one full-screen pass instead of multiplying the work of every
+// triangle.
+// The stage wraps whatever framebuffer and viewport are current when a
+// frame begins, so it can sit inside other offscreen stages such as the
+// dynamic resolution target. Its targets are allocated once at the
+// largest size drawn; only the viewport's part is used.
+// Needs GL_GLEXT_PROTOTYPES defined before the first GL include.
+//=====================================================================
+
+#if !defined(H_ANTIALIAS)
+#define H_ANTIALIAS
+
+#include <iostream>
+#include <string>
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+using namespace std;
+
+#define AA_OFF 0
+#define AA_MSAA 1
+#define AA_FXAA 2
+
+typedef struct {
+	int mode;
+	int samples;				// MSAA only
+	int width;					// largest size drawn
+	int height;
+	GLuint framebuffer;
+	GLuint colour;				// multisampled renderbuffer, or texture for FXAA
+	GLuint depth;
+	GLuint program;				// FXAA
+	GLint texelLocation;
+	GLint extentLocation;
+	GLint output;				// framebuffer bound when the frame began
+	GLint viewport[4];
+} AntiAliasing;
+
+// The classic FXAA: luma at the four diagonal neighbours gives the
+// edge direction, and the pixel is blended along it unless that would
+// leave the local luma range. Lookups are kept inside the used part
+// of the texture.
+const char* fxaaShader =
+	"#version 120\n"
+	"uniform sampler2D scene;\n"
+	"uniform vec2 texel;\n"
+	"uniform vec2 extent;\n"
+	"vec3 sampleScene(vec2 uv) { return texture2D(scene, clamp(uv, texel * 0.5, extent - texel * 0.5)).rgb; }\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 uv = gl_TexCoord[0].xy;\n"
+	"	vec3 luma = vec3(0.299, 0.587, 0.114);\n"
+	"	float nw = dot(sampleScene(uv + vec2(-1.0, -1.0) * texel), luma);\n"
+	"	float ne = dot(sampleScene(uv + vec2(1.0, -1.0) * texel), luma);\n"
+	"	float sw = dot(sampleScene(uv + vec2(-1.0, 1.0) * texel), luma);\n"
+	"	float se = dot(sampleScene(uv + vec2(1.0, 1.0) * texel), luma);\n"
+	"	float m = dot(sampleScene(uv), luma);\n"
+	"	float lumaMin = min(m, min(min(nw, ne), min(sw, se)));\n"
+	"	float lumaMax = max(m, max(max(nw, ne), max(sw, se)));\n"
+	"	vec2 dir = vec2(-((nw + ne) - (sw + se)), (nw + sw) - (ne + se));\n"
+	"	float reduce = max((nw + ne + sw + se) * (0.25 / 8.0), 1.0 / 128.0);\n"
+	"	float scale = 1.0 / (min(abs(dir.x), abs(dir.y)) + reduce);\n"
+	"	dir = clamp(dir * scale, vec2(-8.0), vec2(8.0)) * texel;\n"
+	"	vec3 a = 0.5 * (sampleScene(uv + dir * (1.0 / 3.0 - 0.5)) + sampleScene(uv + dir * (2.0 / 3.0 - 0.5)));\n"
+	"	vec3 b = a * 0.5 + 0.25 * (sampleScene(uv - dir * 0.5) + sampleScene(uv + dir * 0.5));\n"
+	"	float lumaB = dot(b, luma);\n"
+	"	gl_FragColor = vec4(lumaB < lumaMin || lumaB > lumaMax ? a : b, 1.0);\n"
+	"}\n";
+
+// Accepts off, msaa2, msaa4, msaa8 and fxaa
+bool parseAntiAliasing(const string& name, int* mode, int* samples)
+{
+	*samples = 0;
+	if (name == "off") *mode = AA_OFF;
+		else if (name == "fxaa") *mode = AA_FXAA;
+		else if (name == "msaa2" || name == "msaa4" || name == "msaa8")
+		{
+			*mode = AA_MSAA;
+			*samples = name[4] - '0';
+		}
+		else return false;
+	return true;
+}
+
+string antiAliasingName(const AntiAliasing* aa)
+{
+	if (aa->mode == AA_MSAA) return "msaa" + to_string(aa->samples);
+	return aa->mode == AA_FXAA ? "fxaa" : "off";
+}
+
+GLuint compileFxaaProgram()
+{
+	char log[1024];
+	GLint status;
+	GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader, 1, &fxaaShader, 0);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), 0, log);
+		cout << "*** Error compiling the FXAA shader: " << log << endl;
+		exit(1);
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		glGetProgramInfoLog(program, sizeof(log), 0, log);
+		cout << "*** Error linking the FXAA shader: " << log << endl;
+		exit(1);
+	}
+	return program;
+}
+
+void releaseAntiAliasing(AntiAliasing* aa)
+{
+	if (aa->mode == AA_OFF) return;
+	glDeleteFramebuffers(1, &aa->framebuffer);
+	glDeleteRenderbuffers(1, &aa->depth);
+	if (aa->mode == AA_MSAA) glDeleteRenderbuffers(1, &aa->colour);
+		else
+		{
+			glDeleteTextures(1, &aa->colour);
+			glDeleteProgram(aa->program);
+		}
+	aa->mode = AA_OFF;
+}
+
+// Switches mode, replacing the previous mode's targets. Needs a current
+// GL context. MSAA sample counts above the driver's limit are lowered.
+void setAntiAliasing(AntiAliasing* aa, int mode, int samples, int width, int height)
+{
+	releaseAntiAliasing(aa);
+	aa->mode = mode;
+	aa->width = width;
+	aa->height = height;
+	if (mode == AA_OFF) return;
+
+	GLint output;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+	glGenFramebuffers(1, &aa->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, aa->framebuffer);
+	glGenRenderbuffers(1, &aa->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, aa->depth);
+
+	if (mode == AA_MSAA)
+	{
+		GLint maxSamples;
+		glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+		if (samples > maxSamples)
+		{
+			cout << "anti-aliasing: " << samples << " samples requested, " << maxSamples << " supported" << endl;
+			samples = maxSamples;
+		}
+		aa->samples = samples;
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+		glGenRenderbuffers(1, &aa->colour);
+		glBindRenderbuffer(GL_RENDERBUFFER, aa->colour);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, aa->colour);
+	}
+	else
+	{
+		aa->samples = 0;
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glGenTextures(1, &aa->colour);
+		glBindTexture(GL_TEXTURE_2D, aa->colour);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, aa->colour, 0);
+
+		aa->program = compileFxaaProgram();
+		aa->texelLocation = glGetUniformLocation(aa->program, "texel");
+		aa->extentLocation = glGetUniformLocation(aa->program, "extent");
+		glUseProgram(aa->program);
+		glUniform1i(glGetUniformLocation(aa->program, "scene"), 0);
+		glUseProgram(0);
+	}
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, aa->depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cout << "*** Error creating the " << antiAliasingName(aa) << " target: incomplete framebuffer" << endl;
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, output);
+}
+
+// Redirects drawing into the anti-aliasing target at the current
+// viewport; call before clearing
+void beginAntiAliasingFrame(AntiAliasing* aa)
+{
+	if (aa->mode == AA_OFF) return;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &aa->output);
+	glGetIntegerv(GL_VIEWPORT, aa->viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, aa->framebuffer);
+}
+
+// Resolves or filters the frame into the framebuffer that was bound
+// when it began
+void endAntiAliasingFrame(AntiAliasing* aa)
+{
+	if (aa->mode == AA_OFF) return;
+	int width = aa->viewport[2], height = aa->viewport[3];
+	if (aa->mode == AA_MSAA)
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, aa->framebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, aa->output);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, aa->output);
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, aa->output);
+	float u = (float)width / aa->width, v = (float)height / aa->height;
+	glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glBindTexture(GL_TEXTURE_2D, aa->colour);
+	glUseProgram(aa->program);
+	glUniform2f(aa->texelLocation, 1.0f / aa->width, 1.0f / aa->height);
+	glUniform2f(aa->extentLocation, u, v);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glBegin(GL_QUADS);
+		glTexCoord2f(0, 0); glVertex2f(-1, -1);
+		glTexCoord2f(u, 0); glVertex2f(1, -1);
+		glTexCoord2f(u, v); glVertex2f(1, 1);
+		glTexCoord2f(0, v); glVertex2f(-1, 1);
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glUseProgram(0);
+	glPopAttrib();
+}
+
+#endif
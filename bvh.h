@@ -0,0 +1,277 @@
+//=====================================================================
+// Bvh.h
+// Bounding volume hierarchy over axis-aligned boxes, for collision and
+// picking queries. The tree is built top down with a binned surface
+// area heuristic: at each node the items' centres are sorted into
+// BVH_BINS bins along each axis and the split with the lowest
+// (items x box area) on both sides wins, unless keeping the node as a
+// leaf is cheaper once the cost of visiting the extra node is added.
+// Nodes are stored with both children after their parent, so refitting
+// for moved items is one backward pass that keeps the tree's shape and
+// only grows or shrinks its boxes.
+// The tree holds item indices only; queries call back with each item
+// whose leaf passes the caller's box test.
+//=====================================================================
+
+#if !defined(H_BVH)
+#define H_BVH
+
+#include <vector>
+#include <algorithm>
+#include <float.h>
+#include "vecmath.h"
+using namespace std;
+
+#define BVH_BINS 12
+#define BVH_TRAVERSAL_COST 1	// of visiting a node, against 1 for testing an item
+#define BVH_LEAF_SIZE 2			// leaves at or below this size are never split
+#define BVH_MAX_LEAF_SIZE 16	// leaves above this size are split even when the heuristic says not to
+#define BVH_MAX_DEPTH 48		// keeps the query stack bounded
+
+typedef struct {
+	Vec3 min, max;
+} Bounds;
+
+typedef struct {
+	Bounds bounds;
+	int first;			// first item for a leaf, else the left child; the right child follows it
+	int count;			// items in a leaf, 0 for an inner node
+} BvhNode;
+
+typedef struct {
+	vector<BvhNode> nodes;		// root first; empty when there are no items
+	vector<int> items;			// item indices, grouped by leaf
+	int depth;					// deepest leaf, for diagnostics
+} Bvh;
+
+inline Bounds emptyBounds()
+{
+	Bounds b = { vec3(FLT_MAX, FLT_MAX, FLT_MAX), vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+	return b;
+}
+
+inline Bounds sphereBounds(Vec3 centre, float radius)
+{
+	Vec3 r = vec3(radius, radius, radius);
+	Bounds b = { centre - r, centre + r };
+	return b;
+}
+
+inline void growBounds(Bounds* b, Vec3 p)
+{
+	b->min = vmin(b->min, p);
+	b->max = vmax(b->max, p);
+}
+
+inline void growBounds(Bounds* b, const Bounds& other)
+{
+	b->min = vmin(b->min, other.min);
+	b->max = vmax(b->max, other.max);
+}
+
+inline Vec3 boundsCentre(const Bounds& b) { return (b.min + b.max) * 0.5f; }
+inline float axisOf(const Vec3& v, int axis) { return (&v.x)[axis]; }
+inline float centreOnAxis(const Bounds& b, int axis) { return (axisOf(b.min, axis) + axisOf(b.max, axis)) * 0.5f; }
+
+// Half the surface area, which is all the heuristic needs
+inline float boundsArea(const Bounds& b)
+{
+	Vec3 e = b.max - b.min;
+	if (e.x < 0) return 0;
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+inline bool boundsOverlap(const Bounds& a, const Bounds& b)
+{
+	return a.min.x <= b.max.x && a.max.x >= b.min.x
+		&& a.min.y <= b.max.y && a.max.y >= b.min.y
+		&& a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Slab test against a ray origin + direction * t for t in [0, maxT];
+// 'inverse' holds 1 / direction per axis
+inline bool rayHitsBounds(const Bounds& b, Vec3 origin, Vec3 inverse, float maxT)
+{
+	float x1 = (b.min.x - origin.x) * inverse.x, x2 = (b.max.x - origin.x) * inverse.x;
+	float y1 = (b.min.y - origin.y) * inverse.y, y2 = (b.max.y - origin.y) * inverse.y;
+	float z1 = (b.min.z - origin.z) * inverse.z, z2 = (b.max.z - origin.z) * inverse.z;
+	float near = maxf(maxf(minf(x1, x2), minf(y1, y2)), maxf(minf(z1, z2), 0));
+	float far = minf(minf(maxf(x1, x2), maxf(y1, y2)), minf(maxf(z1, z2), maxT));
+	return near <= far;
+}
+
+inline Vec3 inverseDirection(Vec3 d)
+{
+	return vec3(1 / d.x, 1 / d.y, 1 / d.z);
+}
+
+// Picks the cheapest binned split of items [first, first + count) and
+// partitions them around it. Returns how many items went to the left
+// child, or 0 to keep them as a leaf.
+int splitBvhNode(Bvh* bvh, const Bounds* bounds, int first, int count, const Bounds& nodeBounds)
+{
+	Bounds centres = emptyBounds();
+	for (int i = first; i < first + count; i++)
+	{
+		growBounds(&centres, boundsCentre(bounds[bvh->items[i]]));
+	}
+
+	float bestCost = (count - BVH_TRAVERSAL_COST) * boundsArea(nodeBounds);
+	int bestAxis = -1, bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float lo = axisOf(centres.min, axis), extent = axisOf(centres.max, axis) - lo;
+		if (extent <= 0) continue;
+		float scale = BVH_BINS / extent;
+
+		int binCounts[BVH_BINS] = { 0 };
+		Bounds binBounds[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; b++) binBounds[b] = emptyBounds();
+		for (int i = first; i < first + count; i++)
+		{
+			const Bounds& item = bounds[bvh->items[i]];
+			int bin = min((int)((centreOnAxis(item, axis) - lo) * scale), BVH_BINS - 1);
+			binCounts[bin]++;
+			growBounds(&binBounds[bin], item);
+		}
+
+		// Areas to the right of each split, then sweep from the left
+		float rightCost[BVH_BINS];
+		Bounds right = emptyBounds();
+		int rightCount = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--)
+		{
+			growBounds(&right, binBounds[b]);
+			rightCount += binCounts[b];
+			rightCost[b] = rightCount * boundsArea(right);
+		}
+		Bounds left = emptyBounds();
+		int leftCount = 0;
+		for (int b = 1; b < BVH_BINS; b++)
+		{
+			growBounds(&left, binBounds[b - 1]);
+			leftCount += binCounts[b - 1];
+			float cost = leftCount * boundsArea(left) + rightCost[b];
+			if (leftCount > 0 && leftCount < count && cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	int* items = &bvh->items[first];
+	if (bestAxis < 0)
+	{
+		// Nothing beats a leaf, or every centre coincides; large leaves
+		// are halved anyway so queries stay logarithmic
+		if (count <= BVH_MAX_LEAF_SIZE) return 0;
+		Vec3 e = centres.max - centres.min;
+		int axis = e.x >= e.y && e.x >= e.z ? 0 : (e.y >= e.z ? 1 : 2);
+		nth_element(items, items + count / 2, items + count, [&](int a, int b)
+			{ return centreOnAxis(bounds[a], axis) < centreOnAxis(bounds[b], axis); });
+		return count / 2;
+	}
+
+	float lo = axisOf(centres.min, bestAxis), scale = BVH_BINS / (axisOf(centres.max, bestAxis) - lo);
+	int* middle = partition(items, items + count, [&](int item)
+		{ return min((int)((centreOnAxis(bounds[item], bestAxis) - lo) * scale), BVH_BINS - 1) < bestSplit; });
+	return (int)(middle - items);
+}
+
+// Builds the tree over 'count' items with the given boxes
+void buildBvh(Bvh* bvh, const Bounds* bounds, int count)
+{
+	bvh->nodes.clear();
+	bvh->items.resize(count);
+	bvh->depth = 0;
+	for (int i = 0; i < count; i++) bvh->items[i] = i;
+	if (count == 0) return;
+
+	BvhNode root = { emptyBounds(), 0, count };
+	bvh->nodes.reserve(count * 2);
+	bvh->nodes.push_back(root);
+
+	// Nodes still to split, with their depths
+	vector<pair<int, int> > pending(1, make_pair(0, 0));
+	while (!pending.empty())
+	{
+		int index = pending.back().first, depth = pending.back().second;
+		pending.pop_back();
+		int first = bvh->nodes[index].first, itemCount = bvh->nodes[index].count;
+
+		Bounds nodeBounds = emptyBounds();
+		for (int i = first; i < first + itemCount; i++)
+		{
+			growBounds(&nodeBounds, bounds[bvh->items[i]]);
+		}
+		bvh->nodes[index].bounds = nodeBounds;
+		bvh->depth = max(bvh->depth, depth);
+
+		if (itemCount <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH) continue;
+		int leftCount = splitBvhNode(bvh, bounds, first, itemCount, nodeBounds);
+		if (leftCount == 0) continue;
+
+		int left = (int)bvh->nodes.size();
+		BvhNode leftNode = { nodeBounds, first, leftCount };
+		BvhNode rightNode = { nodeBounds, first + leftCount, itemCount - leftCount };
+		bvh->nodes.push_back(leftNode);
+		bvh->nodes.push_back(rightNode);
+		bvh->nodes[index].first = left;
+		bvh->nodes[index].count = 0;
+		pending.push_back(make_pair(left, depth + 1));
+		pending.push_back(make_pair(left + 1, depth + 1));
+	}
+}
+
+// Recomputes every box from the items' current boxes without changing
+// the tree. Cheap, but the tree degrades if items move far from where
+// they were built; rebuild then.
+void refitBvh(Bvh* bvh, const Bounds* bounds)
+{
+	for (int i = (int)bvh->nodes.size() - 1; i >= 0; i--)
+	{
+		BvhNode* node = &bvh->nodes[i];
+		if (node->count == 0)
+		{
+			node->bounds = bvh->nodes[node->first].bounds;
+			growBounds(&node->bounds, bvh->nodes[node->first + 1].bounds);
+			continue;
+		}
+		node->bounds = emptyBounds();
+		for (int j = node->first; j < node->first + node->count; j++)
+		{
+			growBounds(&node->bounds, bounds[bvh->items[j]]);
+		}
+	}
+}
+
+// Calls visit(item) for each item in a leaf whose box, and every box
+// above it, passes enter(bounds). 'enter' may tighten as items are
+// visited, e.g. a ray's end moving in to its nearest hit.
+template <typename Enter, typename Visit>
+void queryBvh(const Bvh* bvh, Enter enter, Visit visit)
+{
+	if (bvh->nodes.empty()) return;
+	int stack[BVH_MAX_DEPTH + 2];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BvhNode* node = &bvh->nodes[stack[--top]];
+		if (!enter(node->bounds)) continue;
+		if (node->count == 0)
+		{
+			stack[top++] = node->first + 1;
+			stack[top++] = node->first;
+			continue;
+		}
+		for (int i = node->first; i < node->first + node->count; i++)
+		{
+			visit(bvh->items[i]);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,157 @@
+//=====================================================================
+// CameraPath.h
+// Scripted camera paths: keyframes of eye and target positions at
+// times in seconds, interpolated with a cubic Hermite spline whose
+// tangents are Catmull-Rom differences scaled for uneven key spacing.
+// Two keys at the same place hold the camera still between them.
+// Paths are stored as text, one key per line:
+//     key <seconds> <eye x y z> <target x y z>
+//=====================================================================
+
+#if !defined(H_CAMERAPATH)
+#define H_CAMERAPATH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "vecmath.h"
+using namespace std;
+
+typedef struct {
+	float time;
+	Vec3 eye;
+	Vec3 target;
+} CameraKey;
+
+typedef struct {
+	vector<CameraKey> keys;		// in time order
+} CameraPath;
+
+void addCameraKey(CameraPath* path, float time, Vec3 eye, Vec3 target)
+{
+	CameraKey key = { time, eye, target };
+	path->keys.push_back(key);
+}
+
+float cameraPathDuration(const CameraPath* path)
+{
+	return path->keys.empty() ? 0 : path->keys.back().time;
+}
+
+// Appends 'tail' so that its first key comes 'gap' seconds after the
+// last key of 'path'
+void appendCameraPath(CameraPath* path, const CameraPath* tail, float gap)
+{
+	float offset = path->keys.empty() ? 0 : cameraPathDuration(path) + gap;
+	for (size_t i = 0; i < tail->keys.size(); i++)
+	{
+		const CameraKey& k = tail->keys[i];
+		addCameraKey(path, k.time + offset, k.eye, k.target);
+	}
+}
+
+void loadCameraPath(CameraPath* path, const char* filename)
+{
+	ifstream file(filename);
+	if (!file)
+	{
+		cout << "*** Error opening camera path: " << filename << endl;
+		exit(1);
+	}
+	string line;
+	int number = 0;
+	while (getline(file, line))
+	{
+		number++;
+		size_t comment = line.find('#');
+		if (comment != string::npos) line.erase(comment);
+		istringstream tokens(line);
+		string keyword;
+		if (!(tokens >> keyword)) continue;
+
+		CameraKey k;
+		if (keyword != "key" || !(tokens >> k.time >> k.eye.x >> k.eye.y >> k.eye.z >> k.target.x >> k.target.y >> k.target.z)
+			|| (!path->keys.empty() && k.time < path->keys.back().time))
+		{
+			cout << "*** Error in camera path " << filename << ":" << number << ": expected key lines in time order" << endl;
+			exit(1);
+		}
+		path->keys.push_back(k);
+	}
+	if (path->keys.empty())
+	{
+		cout << "*** Error in camera path " << filename << ": no keys" << endl;
+		exit(1);
+	}
+}
+
+void saveCameraPath(const CameraPath* path, const char* filename)
+{
+	ofstream file(filename);
+	if (!file)
+	{
+		cout << "*** Error opening camera path: " << filename << endl;
+		exit(1);
+	}
+	file << "# seconds  eye x y z  target x y z" << endl;
+	for (size_t i = 0; i < path->keys.size(); i++)
+	{
+		const CameraKey& k = path->keys[i];
+		file << "key " << k.time << "  " << k.eye.x << " " << k.eye.y << " " << k.eye.z
+			<< "  " << k.target.x << " " << k.target.y << " " << k.target.z << endl;
+	}
+}
+
+bool sameCameraKey(const CameraKey& a, const CameraKey& b)
+{
+	return length(a.eye - b.eye) == 0 && length(a.target - b.target) == 0;
+}
+
+// Tangent per unit time at key i; one-sided at the ends, and zero next
+// to a hold so the camera eases in and out of it
+Vec3 cameraTangent(const CameraPath* path, int i, bool isEye)
+{
+	int last = (int)path->keys.size() - 1;
+	if ((i > 0 && sameCameraKey(path->keys[i], path->keys[i - 1]))
+		|| (i < last && sameCameraKey(path->keys[i], path->keys[i + 1]))) return vec3(0, 0, 0);
+	int a = i > 0 ? i - 1 : i, b = i < last ? i + 1 : i;
+	float dt = path->keys[b].time - path->keys[a].time;
+	if (dt <= 0) return vec3(0, 0, 0);
+	Vec3 pa = isEye ? path->keys[a].eye : path->keys[a].target;
+	Vec3 pb = isEye ? path->keys[b].eye : path->keys[b].target;
+	return (pb - pa) * (1 / dt);
+}
+
+// Holds the first and last keys outside the path's time range
+void evaluateCameraPath(const CameraPath* path, float time, Vec3* eye, Vec3* target)
+{
+	const vector<CameraKey>& keys = path->keys;
+	if (time <= keys.front().time || keys.size() == 1)
+	{
+		*eye = keys.front().eye;
+		*target = keys.front().target;
+		return;
+	}
+	if (time >= keys.back().time)
+	{
+		*eye = keys.back().eye;
+		*target = keys.back().target;
+		return;
+	}
+
+	int i = 0;
+	while (keys[i + 1].time <= time) i++;
+	const CameraKey& k0 = keys[i];
+	const CameraKey& k1 = keys[i + 1];
+	float dt = k1.time - k0.time;
+	float u = (time - k0.time) / dt;
+	float u2 = u * u, u3 = u2 * u;
+	float h00 = 2 * u3 - 3 * u2 + 1, h10 = u3 - 2 * u2 + u;
+	float h01 = -2 * u3 + 3 * u2, h11 = u3 - u2;
+	*eye = k0.eye * h00 + cameraTangent(path, i, true) * (h10 * dt) + k1.eye * h01 + cameraTangent(path, i + 1, true) * (h11 * dt);
+	*target = k0.target * h00 + cameraTangent(path, i, false) * (h10 * dt) + k1.target * h01 + cameraTangent(path, i + 1, false) * (h11 * dt);
+}
+
+#endif
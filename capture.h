@@ -0,0 +1,257 @@
+//=====================================================================
+// Capture.h
+// Frame capture without stalling the renderer.
+// Each frame is read with glReadPixels into one of a ring of pixel pack
+// buffers, which returns as soon as the copy is queued. A buffer is
+// only mapped when its turn comes round again, CAPTURE_BUFFERS frames
+// later, by which time the GPU has long finished with it. The pixels
+// are then copied out and handed to an encoder thread that converts
+// and writes them, so file output never runs on the render thread.
+// The render thread only waits if the encoder falls CAPTURE_QUEUE
+// frames behind; frames are never dropped.
+// The output format follows the pattern's extension: ".tga" and ".png"
+// write an image sequence (the pattern takes the frame number, as in
+// "frames/%05d.tga"); anything else appends raw 8-bit RGB frames to a
+// single video file.
+// Needs GL_GLEXT_PROTOTYPES defined before the first GL include.
+//=====================================================================
+
+#if !defined(H_CAPTURE)
+#define H_CAPTURE
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+#include "loadTGA.h"
+#include "savePNG.h"
+using namespace std;
+
+#define CAPTURE_BUFFERS 3		// pixel pack buffers in the ring
+#define CAPTURE_QUEUE 8			// frames waiting for the encoder
+
+#define CAPTURE_TGA 0
+#define CAPTURE_PNG 1
+#define CAPTURE_RAW 2
+
+typedef struct {
+	long number;
+	vector<unsigned char> bgra;		// rows bottom to top, as read
+} CapturedFrame;
+
+typedef struct {
+	bool enabled;
+	string pattern;
+	int format;
+	int width;
+	int height;
+	int framesPerSecond;			// for playing raw video back
+	GLuint buffers[CAPTURE_BUFFERS];
+	long bufferFrames[CAPTURE_BUFFERS];	// frame read into each, or -1
+	long frameNumber;
+
+	thread encoder;
+	mutex lock;
+	condition_variable changed;
+	deque<CapturedFrame> queue;
+	vector<vector<unsigned char> > spare;	// pixel storage for reuse
+	bool stopping;
+	long written;
+	long stalls;					// frames the render thread waited for the encoder
+	ofstream video;
+} FrameCapture;
+
+bool hasExtension(const string& path, const char* extension)
+{
+	size_t length = strlen(extension);
+	return path.size() > length && path.compare(path.size() - length, length, extension) == 0;
+}
+
+// Converts a frame and writes it out; runs on the encoder thread
+void encodeCapturedFrame(FrameCapture* capture, const CapturedFrame* frame, vector<unsigned char>* rgb)
+{
+	int width = capture->width, height = capture->height;
+	size_t rowSize = (size_t)width * 3;
+	rgb->resize(rowSize * height);
+
+	// TGA keeps GL's bottom-up rows; PNG and video are top down
+	bool flip = capture->format != CAPTURE_TGA;
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* in = &frame->bgra[(size_t)y * width * 4];
+		unsigned char* out = &(*rgb)[(flip ? height - 1 - y : y) * rowSize];
+		for (int x = 0; x < width; x++)
+		{
+			out[x * 3] = in[x * 4 + 2];
+			out[x * 3 + 1] = in[x * 4 + 1];
+			out[x * 3 + 2] = in[x * 4];
+		}
+	}
+
+	if (capture->format == CAPTURE_RAW)
+	{
+		capture->video.write((const char*)rgb->data(), rgb->size());
+		return;
+	}
+	char path[256];
+	snprintf(path, sizeof(path), capture->pattern.c_str(), (int)frame->number);
+	if (capture->format == CAPTURE_TGA) saveTGA(path, width, height, rgb->data());
+		else savePNG(path, width, height, rgb->data());
+}
+
+void runCaptureEncoder(FrameCapture* capture)
+{
+	vector<unsigned char> rgb;
+	while (true)
+	{
+		CapturedFrame frame;
+		{
+			unique_lock<mutex> guard(capture->lock);
+			capture->changed.wait(guard, [capture] { return !capture->queue.empty() || capture->stopping; });
+			if (capture->queue.empty()) return;
+			frame.number = capture->queue.front().number;
+			frame.bgra.swap(capture->queue.front().bgra);
+			capture->queue.pop_front();
+		}
+		capture->changed.notify_all();
+
+		encodeCapturedFrame(capture, &frame, &rgb);
+
+		lock_guard<mutex> guard(capture->lock);
+		capture->spare.push_back(vector<unsigned char>());
+		capture->spare.back().swap(frame.bgra);
+		capture->written++;
+	}
+}
+
+// Captures the bottom-left width x height of the read framebuffer from
+// now on. Needs a current GL context.
+void beginCapture(FrameCapture* capture, const char* pattern, int width, int height, int framesPerSecond)
+{
+	capture->pattern = pattern;
+	capture->format = hasExtension(capture->pattern, ".tga") ? CAPTURE_TGA
+		: hasExtension(capture->pattern, ".png") ? CAPTURE_PNG : CAPTURE_RAW;
+	if (capture->format == CAPTURE_RAW)
+	{
+		capture->video.open(pattern, ios::out | ios::binary);
+		if (!capture->video)
+		{
+			cout << "*** Error opening capture file: " << pattern << endl;
+			exit(1);
+		}
+	}
+	else if (capture->pattern.find('%') == string::npos)
+	{
+		cout << "*** Error: capture pattern needs a frame number, as in frames/%05d.tga: " << pattern << endl;
+		exit(1);
+	}
+
+	capture->width = width;
+	capture->height = height;
+	capture->framesPerSecond = framesPerSecond;
+	glGenBuffers(CAPTURE_BUFFERS, capture->buffers);
+	for (int i = 0; i < CAPTURE_BUFFERS; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, 0, GL_STREAM_READ);
+		capture->bufferFrames[i] = -1;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	capture->frameNumber = 0;
+	capture->stopping = false;
+	capture->written = 0;
+	capture->stalls = 0;
+	capture->enabled = true;
+	capture->encoder = thread(runCaptureEncoder, capture);
+}
+
+// Maps a filled buffer, copies its pixels out and queues them for the
+// encoder, waiting only if the encoder's queue is full
+void collectCaptureBuffer(FrameCapture* capture, int buffer)
+{
+	CapturedFrame frame;
+	frame.number = capture->bufferFrames[buffer];
+	{
+		unique_lock<mutex> guard(capture->lock);
+		if (!capture->spare.empty())
+		{
+			frame.bgra.swap(capture->spare.back());
+			capture->spare.pop_back();
+		}
+	}
+	size_t size = (size_t)capture->width * capture->height * 4;
+	frame.bgra.resize(size);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[buffer]);
+	const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (pixels) memcpy(frame.bgra.data(), pixels, size);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture->bufferFrames[buffer] = -1;
+
+	{
+		unique_lock<mutex> guard(capture->lock);
+		if (capture->queue.size() >= CAPTURE_QUEUE)
+		{
+			capture->stalls++;
+			capture->changed.wait(guard, [capture] { return capture->queue.size() < CAPTURE_QUEUE; });
+		}
+		capture->queue.push_back(CapturedFrame());
+		capture->queue.back().number = frame.number;
+		capture->queue.back().bgra.swap(frame.bgra);
+	}
+	capture->changed.notify_all();
+}
+
+// Call once per frame after drawing and before swapping buffers
+void captureFrame(FrameCapture* capture)
+{
+	if (!capture->enabled) return;
+	int buffer = capture->frameNumber % CAPTURE_BUFFERS;
+	if (capture->bufferFrames[buffer] >= 0) collectCaptureBuffer(capture, buffer);
+
+	// BGRA is the layout most drivers can copy without converting
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[buffer]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, capture->width, capture->height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture->bufferFrames[buffer] = capture->frameNumber++;
+}
+
+// Collects the frames still in flight, waits for the encoder to write
+// everything and releases the buffers
+void finishCapture(FrameCapture* capture)
+{
+	if (!capture->enabled) return;
+	for (long n = capture->frameNumber - CAPTURE_BUFFERS; n < capture->frameNumber; n++)
+	{
+		if (n >= 0 && capture->bufferFrames[n % CAPTURE_BUFFERS] == n) collectCaptureBuffer(capture, n % CAPTURE_BUFFERS);
+	}
+	{
+		lock_guard<mutex> guard(capture->lock);
+		capture->stopping = true;
+	}
+	capture->changed.notify_all();
+	capture->encoder.join();
+	glDeleteBuffers(CAPTURE_BUFFERS, capture->buffers);
+	capture->enabled = false;
+
+	cout << "capture: " << capture->written << " frames to " << capture->pattern
+		<< ", encoder stalls: " << capture->stalls << endl;
+	if (capture->format == CAPTURE_RAW)
+	{
+		capture->video.close();
+		cout << "play with: ffplay -f rawvideo -pixel_format rgb24 -video_size " << capture->width << "x" << capture->height
+			<< " -framerate " << capture->framesPerSecond << " " << capture->pattern << endl;
+	}
+}
+
+#endif
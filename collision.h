@@ -0,0 +1,421 @@
+//=====================================================================
+// Collision.h
+// World-space collision and picking against triangles and spheres,
+// each kept in a Bvh (see Bvh.h).
+// A TriangleCollider holds static geometry, built once at load. A
+// sphere moving through it is swept rather than stepped: each triangle
+// gives the earliest time the sphere touches its face, one of its
+// edges (a capsule) or one of its corners (a sphere), so a fast sphere
+// cannot tunnel through a thin wall. slideSphere stops at the first
+// contact and carries on with what is left of the motion along the
+// surface, the usual behaviour for a walking camera.
+// A SphereCollider holds moving spheres, such as animated parts,
+// refitted rather than rebuilt when they move.
+// Every triangle and sphere carries an owner id that queries report
+// back, -1 for none.
+//=====================================================================
+
+#if !defined(H_COLLISION)
+#define H_COLLISION
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include "vecmath.h"
+#include "bvh.h"
+#include "mesh.h"
+using namespace std;
+
+#define COLLISION_SKIN 0.01f		// gap left between a swept sphere and what it hits
+#define COLLISION_SLIDES 4			// contacts resolved per slideSphere
+
+typedef struct {
+	vector<Vec3> corners;			// three per triangle
+	vector<int> owner;				// per triangle
+	vector<Bounds> bounds;			// per triangle
+	Bvh bvh;
+} TriangleCollider;
+
+typedef struct {
+	vector<Vec3> centres;
+	vector<float> radii;
+	vector<int> owner;
+	vector<Bounds> bounds;
+	Bvh bvh;
+} SphereCollider;
+
+typedef struct {
+	float t;					// fraction of the motion travelled before contact
+	Vec3 normal;				// away from the contact, towards the sphere's centre
+	int triangle;
+} SweepHit;
+
+void addColliderTriangle(TriangleCollider* collider, Vec3 a, Vec3 b, Vec3 c, int owner)
+{
+	collider->corners.push_back(a);
+	collider->corners.push_back(b);
+	collider->corners.push_back(c);
+	collider->owner.push_back(owner);
+}
+
+void addColliderMesh(TriangleCollider* collider, const Mesh* mesh, const Mat4& world, int owner)
+{
+	const float* v = mesh->vertices.data();
+	for (size_t i = 0; i + 2 < mesh->indices.size(); i += 3)
+	{
+		Vec3 corners[3];
+		for (int j = 0; j < 3; j++)
+		{
+			const float* p = v + mesh->indices[i + j] * MESH_VERTEX_FLOATS + 5;
+			corners[j] = transformPoint(world, vec3(p[0], p[1], p[2]));
+		}
+		addColliderTriangle(collider, corners[0], corners[1], corners[2], owner);
+	}
+}
+
+// A unit cube centred on the origin, as drawn by glutSolidCube(1)
+void addColliderBox(TriangleCollider* collider, const Mat4& world, int owner)
+{
+	static const int faces[6][4] = {
+		{ 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+	Vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+	{
+		corners[i] = transformPoint(world, vec3(i & 4 ? 0.5f : -0.5f, i & 2 ? 0.5f : -0.5f, i & 1 ? 0.5f : -0.5f));
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		addColliderTriangle(collider, corners[faces[i][0]], corners[faces[i][1]], corners[faces[i][2]], owner);
+		addColliderTriangle(collider, corners[faces[i][0]], corners[faces[i][2]], corners[faces[i][3]], owner);
+	}
+}
+
+// Builds the tree once every triangle has been added
+void buildTriangleCollider(TriangleCollider* collider)
+{
+	int count = (int)collider->owner.size();
+	collider->bounds.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		Bounds b = emptyBounds();
+		for (int j = 0; j < 3; j++) growBounds(&b, collider->corners[i * 3 + j]);
+		collider->bounds[i] = b;
+	}
+	buildBvh(&collider->bvh, collider->bounds.data(), count);
+}
+
+int addColliderSphere(SphereCollider* collider, Vec3 centre, float radius, int owner)
+{
+	collider->centres.push_back(centre);
+	collider->radii.push_back(radius);
+	collider->owner.push_back(owner);
+	collider->bounds.push_back(sphereBounds(centre, radius));
+	return (int)collider->owner.size() - 1;
+}
+
+void moveColliderSphere(SphereCollider* collider, int sphere, Vec3 centre, float radius)
+{
+	collider->centres[sphere] = centre;
+	collider->radii[sphere] = radius;
+	collider->bounds[sphere] = sphereBounds(centre, radius);
+}
+
+void buildSphereCollider(SphereCollider* collider)
+{
+	buildBvh(&collider->bvh, collider->bounds.data(), (int)collider->bounds.size());
+}
+
+// After moveColliderSphere; keeps the tree built at load
+void refitSphereCollider(SphereCollider* collider)
+{
+	refitBvh(&collider->bvh, collider->bounds.data());
+}
+
+// Earliest t in [0, *t) at which a point moving from 'start' by
+// 'motion' comes within 'radius' of 'p'
+bool sweepPoint(Vec3 start, Vec3 motion, float radius, Vec3 p, float* t, Vec3* normal)
+{
+	Vec3 offset = start - p;
+	float a = dot(motion, motion), b = dot(offset, motion), c = dot(offset, offset) - radius * radius;
+	if (c < 0)
+	{
+		// Already touching: only motion further in counts
+		if (b >= 0 || *t <= 0) return false;
+		*t = 0;
+		*normal = normalize(offset);
+		return true;
+	}
+	float discriminant = b * b - a * c;
+	if (a <= 0 || discriminant < 0) return false;
+	float time = (-b - sqrtf(discriminant)) / a;
+	if (time < 0 || time >= *t) return false;
+	*t = time;
+	*normal = normalize(offset + motion * time);
+	return true;
+}
+
+// As sweepPoint, against the segment pq without its end points
+bool sweepSegment(Vec3 start, Vec3 motion, float radius, Vec3 p, Vec3 q, float* t, Vec3* normal)
+{
+	Vec3 axis = q - p;
+	float axisLength2 = dot(axis, axis);
+	if (axisLength2 <= 0) return false;
+
+	// Work in the plane across the segment
+	Vec3 offset = start - p;
+	float offsetAlong = dot(offset, axis), motionAlong = dot(motion, axis);
+	Vec3 o = offset - axis * (offsetAlong / axisLength2);
+	Vec3 m = motion - axis * (motionAlong / axisLength2);
+	float a = dot(m, m), b = dot(o, m), c = dot(o, o) - radius * radius;
+	float time;
+	if (c < 0)
+	{
+		if (b >= 0 || *t <= 0) return false;
+		time = 0;
+	}
+	else
+	{
+		float discriminant = b * b - a * c;
+		if (a <= 0 || discriminant < 0) return false;
+		time = (-b - sqrtf(discriminant)) / a;
+		if (time < 0 || time >= *t) return false;
+	}
+	float along = (offsetAlong + motionAlong * time) / axisLength2;
+	if (along < 0 || along > 1) return false;
+	*t = time;
+	*normal = normalize(o + m * time);
+	return true;
+}
+
+inline bool pointInTriangle(Vec3 p, Vec3 a, Vec3 b, Vec3 c, Vec3 faceNormal)
+{
+	return dot(cross(b - a, p - a), faceNormal) >= 0
+		&& dot(cross(c - b, p - b), faceNormal) >= 0
+		&& dot(cross(a - c, p - c), faceNormal) >= 0;
+}
+
+// Earliest t in [0, *t) at which a sphere moving from 'start' by
+// 'motion' touches triangle abc, from either side
+bool sweepSphereTriangle(Vec3 start, Vec3 motion, float radius, Vec3 a, Vec3 b, Vec3 c, float* t, Vec3* normal)
+{
+	Vec3 face = cross(b - a, c - a);
+	Vec3 n = normalize(face);
+	float distance = dot(start - a, n);
+	if (distance < 0)
+	{
+		n = -n;
+		distance = -distance;
+	}
+	float approach = dot(motion, n);
+
+	// The face: a touch inside the triangle is always the earliest
+	if (approach < 0)
+	{
+		float time = distance >= radius ? (distance - radius) / -approach : 0;
+		if (time < *t && pointInTriangle(start + motion * time - n * (distance + approach * time), a, b, c, face))
+		{
+			*t = time;
+			*normal = n;
+			return true;
+		}
+	}
+
+	bool hit = false;
+	hit |= sweepSegment(start, motion, radius, a, b, t, normal);
+	hit |= sweepSegment(start, motion, radius, b, c, t, normal);
+	hit |= sweepSegment(start, motion, radius, c, a, t, normal);
+	hit |= sweepPoint(start, motion, radius, a, t, normal);
+	hit |= sweepPoint(start, motion, radius, b, t, normal);
+	hit |= sweepPoint(start, motion, radius, c, t, normal);
+	return hit;
+}
+
+// First contact of a sphere moving from 'start' by 'motion'
+bool sweepSphere(const TriangleCollider* collider, Vec3 start, Vec3 motion, float radius, SweepHit* hit)
+{
+	Bounds swept = sphereBounds(start, radius);
+	growBounds(&swept, sphereBounds(start + motion, radius));
+	hit->t = 1;
+	hit->triangle = -1;
+	queryBvh(&collider->bvh,
+		[&](const Bounds& b) { return boundsOverlap(b, swept); },
+		[&](int i)
+		{
+			const Vec3* c = &collider->corners[i * 3];
+			if (sweepSphereTriangle(start, motion, radius, c[0], c[1], c[2], &hit->t, &hit->normal)) hit->triangle = i;
+		});
+	return hit->triangle >= 0;
+}
+
+// Moves a sphere as far as it can go, sliding along whatever it hits.
+// With 'up' given, contacts only push across it, so a sphere walking
+// level is stopped by the edge of a low step instead of riding up it.
+Vec3 slideSphere(const TriangleCollider* collider, Vec3 position, Vec3 motion, float radius, Vec3 up = vec3(0, 0, 0))
+{
+	for (int i = 0; i < COLLISION_SLIDES; i++)
+	{
+		if (dot(motion, motion) <= 1e-8f) break;
+		SweepHit hit;
+		if (!sweepSphere(collider, position, motion, radius, &hit)) return position + motion;
+		Vec3 normal = normalize(hit.normal - up * dot(hit.normal, up));
+
+		// Stop short of the contact and keep the motion along the surface
+		position += motion * hit.t + normal * COLLISION_SKIN;
+		Vec3 remaining = motion * (1 - hit.t);
+		motion = remaining - normal * dot(remaining, normal);
+	}
+	return position;
+}
+
+// Two-sided Moller-Trumbore; distances are in units of 'direction'
+bool rayTriangle(Vec3 origin, Vec3 direction, Vec3 a, Vec3 b, Vec3 c, float* t)
+{
+	Vec3 e1 = b - a, e2 = c - a;
+	Vec3 p = cross(direction, e2);
+	float determinant = dot(e1, p);
+	if (fabsf(determinant) < 1e-12f) return false;
+	float inverse = 1 / determinant;
+	Vec3 s = origin - a;
+	float u = dot(s, p) * inverse;
+	if (u < 0 || u > 1) return false;
+	Vec3 q = cross(s, e1);
+	float v = dot(direction, q) * inverse;
+	if (v < 0 || u + v > 1) return false;
+	float time = dot(e2, q) * inverse;
+	if (time < 0 || time >= *t) return false;
+	*t = time;
+	return true;
+}
+
+// Nearest triangle along the ray within *t, or -1; *t becomes its distance
+int raycastTriangles(const TriangleCollider* collider, Vec3 origin, Vec3 direction, float* t)
+{
+	Vec3 inverse = inverseDirection(direction);
+	int nearest = -1;
+	queryBvh(&collider->bvh,
+		[&](const Bounds& b) { return rayHitsBounds(b, origin, inverse, *t); },
+		[&](int i)
+		{
+			const Vec3* c = &collider->corners[i * 3];
+			if (rayTriangle(origin, direction, c[0], c[1], c[2], t)) nearest = i;
+		});
+	return nearest;
+}
+
+// The same without the tree, for comparison
+int raycastTrianglesBruteForce(const TriangleCollider* collider, Vec3 origin, Vec3 direction, float* t)
+{
+	int nearest = -1;
+	for (size_t i = 0; i < collider->owner.size(); i++)
+	{
+		const Vec3* c = &collider->corners[i * 3];
+		if (rayTriangle(origin, direction, c[0], c[1], c[2], t)) nearest = (int)i;
+	}
+	return nearest;
+}
+
+// Nearest sphere along the ray within *t, or -1
+int raycastSpheres(const SphereCollider* collider, Vec3 origin, Vec3 direction, float* t)
+{
+	Vec3 inverse = inverseDirection(direction);
+	int nearest = -1;
+	queryBvh(&collider->bvh,
+		[&](const Bounds& b) { return rayHitsBounds(b, origin, inverse, *t); },
+		[&](int i)
+		{
+			Vec3 normal;
+			if (sweepPoint(origin, direction, collider->radii[i], collider->centres[i], t, &normal)) nearest = i;
+		});
+	return nearest;
+}
+
+// Times building, refitting and querying copies of 'base' laid out on a
+// grid, for 1, 4, 16 ... up to 'maxCopies' copies. Rays run level
+// through the grid at 'height'; sweeps move a sphere of 'radius' by up
+// to 'step' from random points at the same height.
+void benchmarkTriangleCollider(const TriangleCollider* base, int maxCopies, float height, float radius, float step)
+{
+	Bounds extent = emptyBounds();
+	for (size_t i = 0; i < base->corners.size(); i++) growBounds(&extent, base->corners[i]);
+	Vec3 size = extent.max - extent.min;
+	float spacing = maxf(size.x, size.z);
+	const int queries = 10000;
+	unsigned int random = 12345;
+	auto next = [&]()
+	{
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+		return (random & 0xFFFFFF) / (float)0x1000000;
+	};
+	auto ms = [](chrono::steady_clock::time_point start)
+	{
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	};
+
+	for (int side = 1; side * side <= maxCopies; side *= 2)
+	{
+		TriangleCollider collider;
+		for (int gx = 0; gx < side; gx++)
+		{
+			for (int gz = 0; gz < side; gz++)
+			{
+				Vec3 offset = vec3(gx * spacing, 0, gz * spacing);
+				for (size_t i = 0; i < base->owner.size(); i++)
+				{
+					const Vec3* c = &base->corners[i * 3];
+					addColliderTriangle(&collider, c[0] + offset, c[1] + offset, c[2] + offset, base->owner[i]);
+				}
+			}
+		}
+		auto start = chrono::steady_clock::now();
+		buildTriangleCollider(&collider);
+		double buildMs = ms(start);
+		start = chrono::steady_clock::now();
+		refitBvh(&collider.bvh, collider.bounds.data());
+		double refitMs = ms(start);
+
+		vector<Vec3> origins(queries), directions(queries);
+		for (int i = 0; i < queries; i++)
+		{
+			origins[i] = vec3(extent.min.x + next() * spacing * side, height, extent.min.z + next() * spacing * side);
+			float angle = next() * 2 * M_PI;
+			directions[i] = vec3(cosf(angle), 0, sinf(angle));
+		}
+
+		int hits = 0;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < queries; i++)
+		{
+			float t = spacing;
+			if (raycastTriangles(&collider, origins[i], directions[i], &t) >= 0) hits++;
+		}
+		double rayUs = ms(start) * 1000 / queries;
+
+		// Brute force gets slow quickly; a sample is enough
+		int bruteQueries = max(1, min(queries, (int)(2e7 / collider.owner.size()))), bruteHits = 0;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < bruteQueries; i++)
+		{
+			float t = spacing;
+			if (raycastTrianglesBruteForce(&collider, origins[i], directions[i], &t) >= 0) bruteHits++;
+		}
+		double bruteUs = ms(start) * 1000 / bruteQueries;
+
+		int contacts = 0;
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < queries; i++)
+		{
+			SweepHit hit;
+			if (sweepSphere(&collider, origins[i] + vec3(0, radius - height, 0), directions[i] * step, radius, &hit)) contacts++;
+		}
+		double sweepUs = ms(start) * 1000 / queries;
+
+		cout << "copies: " << side * side << ", triangles: " << collider.owner.size() << ", nodes: " << collider.bvh.nodes.size()
+			<< ", depth: " << collider.bvh.depth << ", build: " << buildMs << " ms, refit: " << refitMs << " ms" << endl;
+		cout << "    ray: " << rayUs << " us (brute force " << bruteUs << " us), hits: " << hits << " (" << bruteHits << " of the first " << bruteQueries << ")"
+			<< ", sweep: " << sweepUs << " us, contacts: " << contacts << endl;
+	}
+}
+
+#endif
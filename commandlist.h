@@ -0,0 +1,363 @@
+//=====================================================================
+// CommandList.h
+// API-agnostic draw command lists.
+// Recording only appends plain records (absolute transforms, colours,
+// state changes and draw calls) and never touches the graphics API, so
+// lists can be built on any thread. A list is replayed on the GL thread
+// by replayCommandList; materials are scene material indices that the
+// replay maps to texture names. Solids replay as cached primitive
+// meshes rather than GLUT calls, so replay works without a GLUT window.
+// Lists are recorded independently, so each sets the state it needs
+// up front; replay tracks what earlier lists set and skips the state
+// changes and binds that are already in place.
+//=====================================================================
+
+#if !defined(H_COMMANDLIST)
+#define H_COMMANDLIST
+
+#include <vector>
+#include <GL/freeglut.h>
+#include "vecmath.h"
+#include "mesh.h"
+#include "primitives.h"
+using namespace std;
+
+#define COMMAND_MATRIX 0		// arg = index into matrices, loaded as the modelview
+#define COMMAND_COLOUR 1		// values = rgba
+#define COMMAND_ENABLE 2		// arg = RENDER_STATE_*
+#define COMMAND_DISABLE 3
+#define COMMAND_MATERIAL 4		// arg = scene material index
+#define COMMAND_TEXTURE_MODE 5	// arg = TEXTURE_MODE_*
+#define COMMAND_MESH 6			// mesh
+#define COMMAND_SPHERE 7		// values = radius, slices, stacks
+#define COMMAND_TORUS 8			// values = inner radius, outer radius, sides, rings
+#define COMMAND_CYLINDER 9		// values = radius, height, slices, stacks
+#define COMMAND_CONE 10			// values = base radius, height, slices, stacks
+#define COMMAND_CUBE 11			// values = size
+#define COMMAND_TEXT 12			// text, centred on x = 0
+#define COMMAND_SPOTLIGHT 13	// arg = light index, values = cutoff, exponent; at the current origin facing -y
+#define COMMAND_REFLECTION 14	// arg = cube map material index or -1 for off, matrix = eye to world rotation
+#define COMMAND_PARTICLES 15	// arg = count, particles, values = size, size distance, additive
+#define COMMAND_LIGHTMAP 16		// arg = 1 for on, 0 for off
+#define COMMAND_LIGHTMAP_CHART 17	// matrix = the chart's lightmap texture matrix
+
+#define RENDER_STATE_TEXTURE 0
+#define RENDER_STATE_LIGHTING 1
+#define RENDER_STATE_LIGHT0 2	// RENDER_STATE_LIGHT0 + i for light i
+#define RENDER_STATE_COUNT (RENDER_STATE_LIGHT0 + 8)
+
+#define TEXTURE_MODE_REPLACE 0
+#define TEXTURE_MODE_MODULATE 1
+
+typedef struct {
+	int type;
+	int arg;
+	float values[4];
+	union {
+		const Mesh* mesh;
+		const unsigned char* text;
+		int matrix;				// index into matrices
+		const float* particles;	// 8 floats each: rgba, xyz, unused
+	};
+} DrawCommand;
+
+typedef struct {
+	vector<DrawCommand> commands;
+	vector<Mat4> matrices;
+} CommandList;
+
+// Keeps the allocations, so steady-state recording does not allocate
+void clearCommandList(CommandList* list)
+{
+	list->commands.clear();
+	list->matrices.clear();
+}
+
+inline DrawCommand* recordCommand(CommandList* list, int type, int arg)
+{
+	list->commands.push_back(DrawCommand());
+	DrawCommand* c = &list->commands.back();
+	c->type = type;
+	c->arg = arg;
+	c->mesh = 0;
+	return c;
+}
+
+inline void recordValues(CommandList* list, int type, float a, float b, float c, float d)
+{
+	DrawCommand* command = recordCommand(list, type, 0);
+	command->values[0] = a;
+	command->values[1] = b;
+	command->values[2] = c;
+	command->values[3] = d;
+}
+
+inline void recordMatrix(CommandList* list, const Mat4& m)
+{
+	recordCommand(list, COMMAND_MATRIX, (int)list->matrices.size());
+	list->matrices.push_back(m);
+}
+
+inline void recordColour(CommandList* list, float r, float g, float b, float a = 1)
+{
+	recordValues(list, COMMAND_COLOUR, r, g, b, a);
+}
+
+inline void recordColour(CommandList* list, const float* rgba)
+{
+	recordValues(list, COMMAND_COLOUR, rgba[0], rgba[1], rgba[2], rgba[3]);
+}
+
+inline void recordEnable(CommandList* list, int state) { recordCommand(list, COMMAND_ENABLE, state); }
+inline void recordDisable(CommandList* list, int state) { recordCommand(list, COMMAND_DISABLE, state); }
+inline void recordMaterial(CommandList* list, int material) { recordCommand(list, COMMAND_MATERIAL, material); }
+inline void recordTextureMode(CommandList* list, int mode) { recordCommand(list, COMMAND_TEXTURE_MODE, mode); }
+inline void recordMesh(CommandList* list, const Mesh* mesh) { recordCommand(list, COMMAND_MESH, 0)->mesh = mesh; }
+inline void recordSphere(CommandList* list, float radius, int slices, int stacks) { recordValues(list, COMMAND_SPHERE, radius, slices, stacks, 0); }
+inline void recordTorus(CommandList* list, float inner, float outer, int sides, int rings) { recordValues(list, COMMAND_TORUS, inner, outer, sides, rings); }
+inline void recordCylinder(CommandList* list, float radius, float height, int slices, int stacks) { recordValues(list, COMMAND_CYLINDER, radius, height, slices, stacks); }
+inline void recordCone(CommandList* list, float base, float height, int slices, int stacks) { recordValues(list, COMMAND_CONE, base, height, slices, stacks); }
+inline void recordCube(CommandList* list, float size) { recordValues(list, COMMAND_CUBE, size, 0, 0, 0); }
+inline void recordText(CommandList* list, const unsigned char* text) { recordCommand(list, COMMAND_TEXT, 0)->text = text; }
+
+// Reflects a cube map off the following geometry until turned off with
+// recordReflectionOff. 'view' is the pass's view matrix; reflections are
+// looked up in world space.
+inline void recordReflection(CommandList* list, int cubeMap, const Mat4& view)
+{
+	Mat4 eyeToWorld = mat4Identity();
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++) eyeToWorld.m[i * 4 + j] = view.m[j * 4 + i];
+	}
+	recordCommand(list, COMMAND_REFLECTION, cubeMap)->matrix = (int)list->matrices.size();
+	list->matrices.push_back(eyeToWorld);
+}
+
+inline void recordReflectionOff(CommandList* list) { recordCommand(list, COMMAND_REFLECTION, -1); }
+
+// Modulates the following meshes by the lightmap, through their
+// lightmap coordinates, until turned off with recordLightmapOff. Each
+// mesh's chart is chosen with recordLightmapChart. The lightmap is
+// bound to the second texture unit when it is uploaded and nothing else
+// uses that unit, so these only switch it on and off (see Lightmap.h).
+inline void recordLightmap(CommandList* list) { recordCommand(list, COMMAND_LIGHTMAP, 1); }
+inline void recordLightmapOff(CommandList* list) { recordCommand(list, COMMAND_LIGHTMAP, 0); }
+
+inline void recordLightmapChart(CommandList* list, const Mat4& chart)
+{
+	recordCommand(list, COMMAND_LIGHTMAP_CHART, 0)->matrix = (int)list->matrices.size();
+	list->matrices.push_back(chart);
+}
+
+// Draws 'count' particle vertices as point sprites textured with the
+// current material, 'size' pixels across at 'sizeDistance' from the eye
+// and scaled with distance. Particles are blended, additively or by
+// alpha, and do not write depth. The vertices must outlive the list.
+inline void recordParticles(CommandList* list, const float* vertices, int count, float size, float sizeDistance, bool isAdditive)
+{
+	DrawCommand* c = recordCommand(list, COMMAND_PARTICLES, count);
+	c->particles = vertices;
+	c->values[0] = size;
+	c->values[1] = sizeDistance;
+	c->values[2] = isAdditive ? 1 : 0;
+}
+
+inline void recordSpotlight(CommandList* list, int light, float cutoff, float exponent)
+{
+	DrawCommand* command = recordCommand(list, COMMAND_SPOTLIGHT, light);
+	command->values[0] = cutoff;
+	command->values[1] = exponent;
+}
+
+//-- OpenGL replay ------------------------------------------------------
+
+// GLUT's stroke font refuses to draw before glutInit, so headless
+// contexts turn text off
+bool strokeTextEnabled = true;
+
+// The state replayed lists have set, carried from one list to the next;
+// -1 where unknown. Forget it before the first list of a pass and after
+// anything other than replay changes this state.
+typedef struct {
+	int caps[RENDER_STATE_COUNT];	// RENDER_STATE_*, 1 enabled or 0 disabled
+	long texture;					// bound to GL_TEXTURE_2D on unit 0
+	int textureMode;				// TEXTURE_MODE_*
+	long cubeMap;					// bound to GL_TEXTURE_CUBE_MAP on unit 0
+	int reflection;					// 1 while reflection texgen is on
+	int lightmap;					// 1 while the lightmap unit is on
+} ReplayState;
+
+void forgetReplayState(ReplayState* state)
+{
+	for (int i = 0; i < RENDER_STATE_COUNT; i++) state->caps[i] = -1;
+	state->texture = state->cubeMap = -1;
+	state->textureMode = state->reflection = state->lightmap = -1;
+}
+
+// Updates a tracked value; false if it already had that value
+inline bool changeReplayState(int* tracked, int value)
+{
+	if (*tracked == value) return false;
+	*tracked = value;
+	return true;
+}
+
+inline bool changeReplayState(long* tracked, long value)
+{
+	if (*tracked == value) return false;
+	*tracked = value;
+	return true;
+}
+
+GLenum renderStateCap(int state)
+{
+	if (state == RENDER_STATE_TEXTURE) return GL_TEXTURE_2D;
+	if (state == RENDER_STATE_LIGHTING) return GL_LIGHTING;
+	return GL_LIGHT0 + (state - RENDER_STATE_LIGHT0);
+}
+
+inline void drawScaledMesh(const Mesh* mesh, float x, float y, float z)
+{
+	glPushMatrix();
+		glScalef(x, y, z);
+		drawMesh(mesh);
+	glPopMatrix();
+}
+
+// Must run on the GL thread with the modelview matrix mode selected
+void replayCommandList(const CommandList* list, const GLuint* textures, ReplayState* state)
+{
+	float white[4] = { 1, 1, 1, 1 };
+	float origin[4] = { 0, 0, 0, 1 };
+	float down[3] = { 0, -1, 0 };
+
+	for (size_t i = 0; i < list->commands.size(); i++)
+	{
+		const DrawCommand& c = list->commands[i];
+		const float* v = c.values;
+		switch (c.type)
+		{
+			case COMMAND_MATRIX:
+				glLoadMatrixf(list->matrices[c.arg].m);
+				break;
+			case COMMAND_COLOUR:
+				glColor4f(v[0], v[1], v[2], v[3]);
+				break;
+			case COMMAND_ENABLE:
+				if (changeReplayState(&state->caps[c.arg], 1)) glEnable(renderStateCap(c.arg));
+				break;
+			case COMMAND_DISABLE:
+				if (changeReplayState(&state->caps[c.arg], 0)) glDisable(renderStateCap(c.arg));
+				break;
+			case COMMAND_MATERIAL:
+				if (changeReplayState(&state->texture, (long)textures[c.arg])) glBindTexture(GL_TEXTURE_2D, textures[c.arg]);
+				break;
+			case COMMAND_TEXTURE_MODE:
+				if (!changeReplayState(&state->textureMode, c.arg)) break;
+				glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, c.arg == TEXTURE_MODE_REPLACE ? GL_REPLACE : GL_MODULATE);
+				break;
+			case COMMAND_MESH:
+				drawMesh(c.mesh);
+				break;
+			case COMMAND_SPHERE:
+				drawScaledMesh(primitiveMesh(PRIMITIVE_SPHERE, 0, (int)v[1], (int)v[2]), v[0], v[0], v[0]);
+				break;
+			case COMMAND_TORUS:
+				drawScaledMesh(primitiveMesh(PRIMITIVE_TORUS, v[0] / v[1], (int)v[2], (int)v[3]), v[1], v[1], v[1]);
+				break;
+			case COMMAND_CYLINDER:
+				drawScaledMesh(primitiveMesh(PRIMITIVE_CYLINDER, 0, (int)v[2], (int)v[3]), v[0], v[0], v[1]);
+				break;
+			case COMMAND_CONE:
+				drawScaledMesh(primitiveMesh(PRIMITIVE_CONE, 0, (int)v[2], (int)v[3]), v[0], v[0], v[1]);
+				break;
+			case COMMAND_CUBE:
+				drawScaledMesh(primitiveMesh(PRIMITIVE_CUBE, 0, 0, 0), v[0], v[0], v[0]);
+				break;
+			case COMMAND_TEXT:
+				if (!strokeTextEnabled) break;
+				glTranslatef(-glutStrokeLength(GLUT_STROKE_ROMAN, c.text) / 2.0f, 0, 0);
+				glutStrokeString(GLUT_STROKE_ROMAN, c.text);
+				break;
+			case COMMAND_SPOTLIGHT:
+				glLightfv(GL_LIGHT0 + c.arg, GL_DIFFUSE, white);
+				glLightfv(GL_LIGHT0 + c.arg, GL_SPECULAR, white);
+				glLightfv(GL_LIGHT0 + c.arg, GL_POSITION, origin);
+				glLightfv(GL_LIGHT0 + c.arg, GL_SPOT_DIRECTION, down);
+				glLightf(GL_LIGHT0 + c.arg, GL_SPOT_CUTOFF, v[0]);
+				glLightf(GL_LIGHT0 + c.arg, GL_SPOT_EXPONENT, v[1]);
+				break;
+			case COMMAND_REFLECTION:
+				// The texture matrix is only ever not the identity while
+				// reflection is on
+				if (c.arg < 0)
+				{
+					if (!changeReplayState(&state->reflection, 0)) break;
+					glMatrixMode(GL_TEXTURE);
+					glLoadIdentity();
+					glDisable(GL_TEXTURE_GEN_S);
+					glDisable(GL_TEXTURE_GEN_T);
+					glDisable(GL_TEXTURE_GEN_R);
+					glDisable(GL_TEXTURE_CUBE_MAP);
+				}
+				else
+				{
+					glMatrixMode(GL_TEXTURE);
+					glLoadMatrixf(list->matrices[c.matrix].m);
+					if (changeReplayState(&state->reflection, 1))
+					{
+						glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
+						glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
+						glTexGeni(GL_R, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP);
+						glEnable(GL_TEXTURE_GEN_S);
+						glEnable(GL_TEXTURE_GEN_T);
+						glEnable(GL_TEXTURE_GEN_R);
+						glEnable(GL_TEXTURE_CUBE_MAP);
+					}
+					if (changeReplayState(&state->cubeMap, (long)textures[c.arg])) glBindTexture(GL_TEXTURE_CUBE_MAP, textures[c.arg]);
+				}
+				glMatrixMode(GL_MODELVIEW);
+				break;
+			case COMMAND_LIGHTMAP:
+				if (!changeReplayState(&state->lightmap, c.arg)) break;
+				glActiveTexture(GL_TEXTURE1);
+				if (c.arg) glEnable(GL_TEXTURE_2D);
+					else glDisable(GL_TEXTURE_2D);
+				glActiveTexture(GL_TEXTURE0);
+				break;
+			case COMMAND_LIGHTMAP_CHART:
+				glActiveTexture(GL_TEXTURE1);
+				glMatrixMode(GL_TEXTURE);
+				glLoadMatrixf(list->matrices[c.matrix].m);
+				glMatrixMode(GL_MODELVIEW);
+				glActiveTexture(GL_TEXTURE0);
+				break;
+			case COMMAND_PARTICLES:
+			{
+				float attenuation[3] = { 0, 0, 1 / (v[1] * v[1]) };
+				glPointSize(v[0]);
+				glPointParameterfv(GL_POINT_DISTANCE_ATTENUATION, attenuation);
+				glEnable(GL_POINT_SPRITE);
+				glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_TRUE);
+				glEnable(GL_BLEND);
+				glBlendFunc(GL_SRC_ALPHA, v[2] != 0 ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+				glDepthMask(GL_FALSE);
+				glEnableClientState(GL_COLOR_ARRAY);
+				glEnableClientState(GL_VERTEX_ARRAY);
+				glColorPointer(4, GL_FLOAT, 8 * sizeof(float), c.particles);
+				glVertexPointer(3, GL_FLOAT, 8 * sizeof(float), c.particles + 4);
+				glDrawArrays(GL_POINTS, 0, c.arg);
+				glDisableClientState(GL_COLOR_ARRAY);
+				glDisableClientState(GL_VERTEX_ARRAY);
+				glDepthMask(GL_TRUE);
+				glDisable(GL_BLEND);
+				glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_FALSE);
+				glDisable(GL_POINT_SPRITE);
+				break;
+			}
+		}
+	}
+}
+
+#endif
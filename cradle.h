@@ -0,0 +1,175 @@
+//=====================================================================
+// Cradle.h
+// Impulse-based Newton's cradle simulation.
+// Each ball is a rigid pendulum integrated at a fixed substep, and
+// neighbouring balls exchange momentum through elastic impulses when
+// they touch. State is stored structure-of-arrays ([ball][cradle]) so
+// four cradles are stepped at once with the vecmath f4 type, and large
+// batches are split across worker threads.
+//=====================================================================
+
+#if !defined(H_CRADLE)
+#define H_CRADLE
+
+#include <iostream>
+#include <chrono>
+#include "vecmath.h"
+#include "parallel.h"
+using namespace std;
+
+#define CRADLE_BALLS 5
+#define CRADLE_BALL_RADIUS 3
+#define CRADLE_BALL_SPACING 6
+#define CRADLE_SUBSTEP 0.001f
+#define CRADLE_LANES 4
+#define CRADLE_PARALLEL_THRESHOLD 4096
+
+typedef struct {
+	int count;			// number of cradles
+	int capacity;		// count rounded up to a multiple of CRADLE_LANES
+	float stiffness;	// g / l, in 1/s^2
+	float length;		// string length in scene units, used for contacts
+	float restitution;	// 1 = perfectly elastic
+	float accumulator;	// simulated time not yet consumed by a substep
+	float* angles[CRADLE_BALLS];		// radians, [ball][cradle]
+	float* velocities[CRADLE_BALLS];	// radians per second
+} CradleBatch;
+
+void initialiseCradleBatch(CradleBatch* batch, int count, float length, float stiffness)
+{
+	batch->count = count;
+	batch->capacity = ((count + CRADLE_LANES - 1) / CRADLE_LANES) * CRADLE_LANES;
+	batch->stiffness = stiffness;
+	batch->length = length;
+	batch->restitution = 1;
+	batch->accumulator = 0;
+	for (int b = 0; b < CRADLE_BALLS; b++)
+	{
+		batch->angles[b] = new float[batch->capacity]();
+		batch->velocities[b] = new float[batch->capacity]();
+	}
+}
+
+void freeCradleBatch(CradleBatch* batch)
+{
+	for (int b = 0; b < CRADLE_BALLS; b++)
+	{
+		delete[] batch->angles[b];
+		delete[] batch->velocities[b];
+	}
+	batch->count = 0;
+	batch->capacity = 0;
+}
+
+// Odd polynomial for sin(x). Pendulum angles stay well inside
+// [-pi/2, pi/2], where the error is below 1e-4 rad.
+inline f4 cradleSin(f4 x)
+{
+	f4 x2 = f4Mul(x, x);
+	f4 p = f4Sub(f4Splat(1 / 120.0f), f4Mul(x2, f4Splat(1 / 5040.0f)));
+	p = f4Sub(f4Splat(1 / 6.0f), f4Mul(x2, p));
+	return f4Mul(x, f4Sub(f4Splat(1), f4Mul(x2, p)));
+}
+
+// Steps cradles [begin, end) by 'substeps' fixed substeps. 'begin' and
+// 'end' must be multiples of CRADLE_LANES.
+void stepCradleRange(CradleBatch* batch, int begin, int end, int substeps)
+{
+	const f4 dt = f4Splat(CRADLE_SUBSTEP);
+	const f4 k = f4Splat(batch->stiffness * CRADLE_SUBSTEP);
+	// Contact when the bobs are closer than two radii along x
+	const f4 contactSin = f4Splat((CRADLE_BALL_SPACING - 2 * CRADLE_BALL_RADIUS) / batch->length);
+	const f4 impulseScale = f4Splat((1 + batch->restitution) * 0.5f);
+
+	for (int c = begin; c < end; c += CRADLE_LANES)
+	{
+		f4 a[CRADLE_BALLS], v[CRADLE_BALLS], s[CRADLE_BALLS];
+		for (int b = 0; b < CRADLE_BALLS; b++)
+		{
+			a[b] = f4Load(batch->angles[b] + c);
+			v[b] = f4Load(batch->velocities[b] + c);
+			s[b] = cradleSin(a[b]);
+		}
+
+		for (int step = 0; step < substeps; step++)
+		{
+			// Semi-implicit Euler for each pendulum. Impulses only change
+			// velocities, so s[] still holds sin(angle) from the last step.
+			for (int b = 0; b < CRADLE_BALLS; b++)
+			{
+				v[b] = f4Sub(v[b], f4Mul(k, s[b]));
+				a[b] = f4Madd(v[b], dt, a[b]);
+				s[b] = cradleSin(a[b]);
+			}
+
+			// Sequential impulses; one sweep per ball lets a hit travel
+			// the full length of the row within a substep
+			for (int iter = 0; iter < CRADLE_BALLS; iter++)
+			{
+				for (int i = 0; i < CRADLE_BALLS - 1; i++)
+				{
+					f4 touching = f4GreaterEqual(f4Sub(s[i], s[i + 1]), contactSin);
+					f4 approaching = f4Greater(v[i], v[i + 1]);
+					f4 j = f4Mul(impulseScale, f4Sub(v[i], v[i + 1]));
+					j = f4And(j, f4And(touching, approaching));
+					v[i] = f4Sub(v[i], j);
+					v[i + 1] = f4Add(v[i + 1], j);
+				}
+			}
+		}
+
+		for (int b = 0; b < CRADLE_BALLS; b++)
+		{
+			f4Store(batch->angles[b] + c, a[b]);
+			f4Store(batch->velocities[b] + c, v[b]);
+		}
+	}
+}
+
+// Advances every cradle in the batch by 'elapsed' seconds, carrying any
+// remainder smaller than a substep over to the next call.
+void advanceCradles(CradleBatch* batch, float elapsed)
+{
+	batch->accumulator += elapsed;
+	int substeps = (int)(batch->accumulator / CRADLE_SUBSTEP);
+	if (substeps <= 0) return;
+	batch->accumulator -= substeps * CRADLE_SUBSTEP;
+
+	if (batch->capacity < CRADLE_PARALLEL_THRESHOLD)
+	{
+		stepCradleRange(batch, 0, batch->capacity, substeps);
+		return;
+	}
+	parallelFor(batch->capacity, CRADLE_PARALLEL_THRESHOLD / 4, CRADLE_LANES,
+		[batch, substeps](int begin, int end) { stepCradleRange(batch, begin, end, substeps); });
+}
+
+// Steps 'count' cradles through ten seconds of simulated time and
+// reports the throughput in cradles stepped per second.
+void benchmarkCradles(int count, float length, float stiffness)
+{
+	CradleBatch batch;
+	initialiseCradleBatch(&batch, count, length, stiffness);
+	for (int c = 0; c < count; c++)
+	{
+		batch.angles[CRADLE_BALLS - 1][c] = 0.785f * (c % 7 + 1) / 7.0f;
+	}
+
+	const float simulated = 10;
+	auto start = chrono::steady_clock::now();
+	for (int frame = 0; frame < 1000; frame++)
+	{
+		advanceCradles(&batch, simulated / 1000);
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	double substeps = simulated / CRADLE_SUBSTEP;
+
+	cout << "cradles: " << count << ", threads: " << workerCount() << endl;
+	cout << "wall time: " << seconds << " s for " << simulated << " s simulated" << endl;
+	cout << "cradle substeps/s: " << (count * substeps) / seconds << endl;
+	cout << "cradles steppable in real time: " << (count * simulated) / seconds << endl;
+
+	freeCradleBatch(&batch);
+}
+
+#endif
@@ -0,0 +1,245 @@
+//=====================================================================
+// GLCounters.h
+// Counts the GL calls made each frame: draw calls, vertices submitted,
+// texture binds, state changes and matrix stack operations, with
+// redundant binds and state changes counted separately. Redundancy is
+// judged against a shadow copy of the state the counted calls set,
+// kept per texture unit; glPushAttrib and glPopAttrib forget it, so the
+// next change after them is never reported as redundant.
+// Include right after the GL headers and before any code that calls
+// GL: the entry points below are replaced by counting wrappers for the
+// rest of the translation unit. Calls GLUT makes internally are not
+// seen.
+// Frame counters can be checked against a budget file of "key value"
+// lines using the counter names printed by printGLCounters.
+//=====================================================================
+
+#if !defined(H_GLCOUNTERS)
+#define H_GLCOUNTERS
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <GL/freeglut.h>
+using namespace std;
+
+#define GL_COUNTER_COUNT 7
+
+typedef struct {
+	long values[GL_COUNTER_COUNT];
+} GLCounters;
+
+#define GL_COUNTER_DRAW_CALLS 0
+#define GL_COUNTER_VERTICES 1
+#define GL_COUNTER_TEXTURE_BINDS 2
+#define GL_COUNTER_REDUNDANT_BINDS 3
+#define GL_COUNTER_STATE_CHANGES 4
+#define GL_COUNTER_REDUNDANT_STATE 5
+#define GL_COUNTER_MATRIX_OPS 6
+
+const char* glCounterNames[GL_COUNTER_COUNT] = {
+	"draw_calls", "vertices", "texture_binds", "redundant_binds",
+	"state_changes", "redundant_state_changes", "matrix_ops"
+};
+
+GLCounters glFrameCounters;			// the frame being drawn
+GLCounters glLastCounters;			// the last finished frame
+GLCounters glPeakCounters;			// per counter, the worst finished frame
+
+// Shadowed state, keyed by name and the active texture unit; absent
+// entries are unknown. Keying state that is not per unit by the unit
+// too only misses some redundancy, never invents it.
+unordered_map<GLenum, bool> glShadowCaps;
+unordered_map<GLenum, GLuint> glShadowTextures;
+unordered_map<GLenum, GLint> glShadowTexEnv;
+GLenum glShadowUnit = 0;
+
+inline void countGL(int counter, long amount = 1) { glFrameCounters.values[counter] += amount; }
+inline GLenum shadowKey(GLenum name) { return name + glShadowUnit * 0x10000; }
+
+inline void countedCap(GLenum cap, bool enable)
+{
+	countGL(GL_COUNTER_STATE_CHANGES);
+	unordered_map<GLenum, bool>::iterator it = glShadowCaps.find(shadowKey(cap));
+	if (it != glShadowCaps.end() && it->second == enable) countGL(GL_COUNTER_REDUNDANT_STATE);
+	glShadowCaps[shadowKey(cap)] = enable;
+	if (enable) glEnable(cap);
+		else glDisable(cap);
+}
+
+inline void countedBindTexture(GLenum target, GLuint texture)
+{
+	countGL(GL_COUNTER_TEXTURE_BINDS);
+	unordered_map<GLenum, GLuint>::iterator it = glShadowTextures.find(shadowKey(target));
+	if (it != glShadowTextures.end() && it->second == texture) countGL(GL_COUNTER_REDUNDANT_BINDS);
+	glShadowTextures[shadowKey(target)] = texture;
+	glBindTexture(target, texture);
+}
+
+inline void countedTexEnvi(GLenum target, GLenum name, GLint value)
+{
+	countGL(GL_COUNTER_STATE_CHANGES);
+	unordered_map<GLenum, GLint>::iterator it = glShadowTexEnv.find(shadowKey(name));
+	if (target == GL_TEXTURE_ENV && it != glShadowTexEnv.end() && it->second == value) countGL(GL_COUNTER_REDUNDANT_STATE);
+	if (target == GL_TEXTURE_ENV) glShadowTexEnv[shadowKey(name)] = value;
+	glTexEnvi(target, name, value);
+}
+
+inline void countedActiveTexture(GLenum unit)
+{
+	countGL(GL_COUNTER_STATE_CHANGES);
+	glShadowUnit = unit - GL_TEXTURE0;
+	glActiveTexture(unit);
+}
+
+inline void forgetGLState()
+{
+	glShadowCaps.clear();
+	glShadowTextures.clear();
+	glShadowTexEnv.clear();
+}
+
+inline void countedPushAttrib(GLbitfield mask)
+{
+	countGL(GL_COUNTER_STATE_CHANGES);
+	forgetGLState();
+	glPushAttrib(mask);
+}
+
+inline void countedPopAttrib()
+{
+	countGL(GL_COUNTER_STATE_CHANGES);
+	forgetGLState();
+	glPopAttrib();
+}
+
+inline void countedDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+	countGL(GL_COUNTER_DRAW_CALLS);
+	countGL(GL_COUNTER_VERTICES, count);
+	glDrawElements(mode, count, type, indices);
+}
+
+inline void countedDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	countGL(GL_COUNTER_DRAW_CALLS);
+	countGL(GL_COUNTER_VERTICES, count);
+	glDrawArrays(mode, first, count);
+}
+
+void resetGLCounters(GLCounters* counters)
+{
+	for (int i = 0; i < GL_COUNTER_COUNT; i++) counters->values[i] = 0;
+}
+
+void beginGLCountersFrame()
+{
+	resetGLCounters(&glFrameCounters);
+}
+
+void endGLCountersFrame()
+{
+	glLastCounters = glFrameCounters;
+	for (int i = 0; i < GL_COUNTER_COUNT; i++)
+	{
+		if (glFrameCounters.values[i] > glPeakCounters.values[i]) glPeakCounters.values[i] = glFrameCounters.values[i];
+	}
+}
+
+void printGLCounters(const char* label, const GLCounters* counters)
+{
+	cout << label << ":";
+	for (int i = 0; i < GL_COUNTER_COUNT; i++)
+	{
+		cout << " " << glCounterNames[i] << "=" << counters->values[i];
+	}
+	cout << endl;
+}
+
+// Reads "key value" lines; counters that are not listed are unlimited
+void loadGLBudget(const char* path, GLCounters* budget)
+{
+	for (int i = 0; i < GL_COUNTER_COUNT; i++) budget->values[i] = -1;
+
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "*** Error opening GL budget file: " << path << endl;
+		exit(1);
+	}
+	string line;
+	int number = 0;
+	while (getline(file, line))
+	{
+		number++;
+		size_t comment = line.find('#');
+		if (comment != string::npos) line.erase(comment);
+		istringstream tokens(line);
+		string key;
+		long value;
+		if (!(tokens >> key)) continue;
+		if (!(tokens >> value))
+		{
+			cout << "*** Error in GL budget " << path << ":" << number << ": expected a number after '" << key << "'" << endl;
+			exit(1);
+		}
+		int counter = -1;
+		for (int i = 0; i < GL_COUNTER_COUNT; i++)
+		{
+			if (key == glCounterNames[i]) counter = i;
+		}
+		if (counter < 0)
+		{
+			cout << "*** Error in GL budget " << path << ":" << number << ": unknown counter '" << key << "'" << endl;
+			exit(1);
+		}
+		budget->values[counter] = value;
+	}
+}
+
+// Prints every counter over budget; true if all are within it
+bool checkGLBudget(const GLCounters* counters, const GLCounters* budget)
+{
+	bool withinBudget = true;
+	for (int i = 0; i < GL_COUNTER_COUNT; i++)
+	{
+		if (budget->values[i] < 0 || counters->values[i] <= budget->values[i]) continue;
+		cout << "*** GL budget exceeded: " << glCounterNames[i] << " " << counters->values[i]
+			<< " > " << budget->values[i] << endl;
+		withinBudget = false;
+	}
+	return withinBudget;
+}
+
+// Counting replacements for the rest of the translation unit
+#define glEnable(cap) countedCap(cap, true)
+#define glDisable(cap) countedCap(cap, false)
+#define glBindTexture(target, texture) countedBindTexture(target, texture)
+#define glTexEnvi(target, name, value) countedTexEnvi(target, name, value)
+#define glActiveTexture(unit) countedActiveTexture(unit)
+#define glPushAttrib(mask) countedPushAttrib(mask)
+#define glPopAttrib() countedPopAttrib()
+#define glDrawElements(mode, count, type, indices) countedDrawElements(mode, count, type, indices)
+#define glDrawArrays(mode, first, count) countedDrawArrays(mode, first, count)
+#define glBegin(mode) (countGL(GL_COUNTER_DRAW_CALLS), glBegin(mode))
+#define glVertex2i(x, y) (countGL(GL_COUNTER_VERTICES), glVertex2i(x, y))
+#define glVertex2f(x, y) (countGL(GL_COUNTER_VERTICES), glVertex2f(x, y))
+#define glVertex3f(x, y, z) (countGL(GL_COUNTER_VERTICES), glVertex3f(x, y, z))
+#define glRecti(x1, y1, x2, y2) (countGL(GL_COUNTER_DRAW_CALLS), countGL(GL_COUNTER_VERTICES, 4), glRecti(x1, y1, x2, y2))
+#define glColor3f(r, g, b) (countGL(GL_COUNTER_STATE_CHANGES), glColor3f(r, g, b))
+#define glColor4f(r, g, b, a) (countGL(GL_COUNTER_STATE_CHANGES), glColor4f(r, g, b, a))
+#define glLightf(light, name, value) (countGL(GL_COUNTER_STATE_CHANGES), glLightf(light, name, value))
+#define glLightfv(light, name, values) (countGL(GL_COUNTER_STATE_CHANGES), glLightfv(light, name, values))
+#define glMatrixMode(mode) (countGL(GL_COUNTER_MATRIX_OPS), glMatrixMode(mode))
+#define glLoadIdentity() (countGL(GL_COUNTER_MATRIX_OPS), glLoadIdentity())
+#define glLoadMatrixf(m) (countGL(GL_COUNTER_MATRIX_OPS), glLoadMatrixf(m))
+#define glMultMatrixf(m) (countGL(GL_COUNTER_MATRIX_OPS), glMultMatrixf(m))
+#define glPushMatrix() (countGL(GL_COUNTER_MATRIX_OPS), glPushMatrix())
+#define glPopMatrix() (countGL(GL_COUNTER_MATRIX_OPS), glPopMatrix())
+#define glTranslatef(x, y, z) (countGL(GL_COUNTER_MATRIX_OPS), glTranslatef(x, y, z))
+#define glRotatef(angle, x, y, z) (countGL(GL_COUNTER_MATRIX_OPS), glRotatef(angle, x, y, z))
+#define glScalef(x, y, z) (countGL(GL_COUNTER_MATRIX_OPS), glScalef(x, y, z))
+
+#endif
@@ -0,0 +1,140 @@
+//=====================================================================
+// Headless.h
+// Offscreen OpenGL context through EGL, for running the renderer on
+// machines without a display (CI, render nodes, Mesa llvmpipe).
+// Mesa's surfaceless platform is used when available; otherwise the
+// default display with a small pbuffer just to make the context
+// current. Rendering always goes to a framebuffer object of the
+// requested size, read back with readHeadlessFrame.
+// Needs GL_GLEXT_PROTOTYPES defined before the first GL include.
+//=====================================================================
+
+#if !defined(H_HEADLESS)
+#define H_HEADLESS
+
+#include <iostream>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+using namespace std;
+
+typedef struct {
+	EGLDisplay display;
+	EGLContext context;
+	EGLSurface surface;		// EGL_NO_SURFACE when surfaceless
+	GLuint framebuffer;
+	GLuint colour;
+	GLuint depth;
+	int width;
+	int height;
+} HeadlessContext;
+
+void headlessError(const char* message)
+{
+	cout << "*** Error creating headless context: " << message << " (EGL error 0x" << hex << eglGetError() << dec << ")" << endl;
+	exit(1);
+}
+
+EGLDisplay openHeadlessDisplay(bool* isSurfaceless)
+{
+	const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+	{
+		EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+		if (display != EGL_NO_DISPLAY && eglInitialize(display, 0, 0))
+		{
+			*isSurfaceless = true;
+			return display;
+		}
+	}
+
+	*isSurfaceless = false;
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) headlessError("no EGL display");
+	return display;
+}
+
+// Creates a compatibility-profile context with a width x height colour
+// and depth framebuffer bound for drawing
+void createHeadlessContext(HeadlessContext* headless, int width, int height)
+{
+	bool isSurfaceless;
+	headless->display = openHeadlessDisplay(&isSurfaceless);
+	if (!eglBindAPI(EGL_OPENGL_API)) headlessError("desktop OpenGL is not supported");
+
+	EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, isSurfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config = 0;
+	EGLint configCount = 0;
+	eglChooseConfig(headless->display, configAttributes, &config, 1, &configCount);
+	if (configCount < 1 && !isSurfaceless) headlessError("no pbuffer config");
+
+	// Surfaceless displays may offer no configs at all; contexts then
+	// need none (EGL_KHR_no_config_context)
+	headless->context = eglCreateContext(headless->display, configCount > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, 0);
+	if (headless->context == EGL_NO_CONTEXT) headlessError("no context");
+
+	headless->surface = EGL_NO_SURFACE;
+	if (!isSurfaceless)
+	{
+		EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		headless->surface = eglCreatePbufferSurface(headless->display, config, pbufferAttributes);
+		if (headless->surface == EGL_NO_SURFACE) headlessError("no pbuffer");
+	}
+	if (!eglMakeCurrent(headless->display, headless->surface, headless->surface, headless->context)) headlessError("cannot make the context current");
+
+	headless->width = width;
+	headless->height = height;
+	glGenRenderbuffers(1, &headless->colour);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless->colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &headless->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, headless->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &headless->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, headless->framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless->colour);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headless->depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) headlessError("incomplete framebuffer");
+	glViewport(0, 0, width, height);
+
+	cout << "headless: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION)
+		<< (isSurfaceless ? ", surfaceless" : ", pbuffer") << endl;
+}
+
+void destroyHeadlessContext(HeadlessContext* headless)
+{
+	glDeleteFramebuffers(1, &headless->framebuffer);
+	glDeleteRenderbuffers(1, &headless->colour);
+	glDeleteRenderbuffers(1, &headless->depth);
+	eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (headless->surface != EGL_NO_SURFACE) eglDestroySurface(headless->display, headless->surface);
+	eglDestroyContext(headless->display, headless->context);
+	eglTerminate(headless->display);
+}
+
+// Reads the framebuffer as RGB rows from top to bottom
+void readHeadlessFrame(const HeadlessContext* headless, vector<unsigned char>* rgb)
+{
+	size_t rowSize = (size_t)headless->width * 3;
+	vector<unsigned char> rows(rowSize * headless->height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, headless->width, headless->height, GL_RGB, GL_UNSIGNED_BYTE, rows.data());
+
+	rgb->resize(rows.size());
+	for (int y = 0; y < headless->height; y++)
+	{
+		memcpy(&(*rgb)[y * rowSize], &rows[(headless->height - 1 - y) * rowSize], rowSize);
+	}
+}
+
+#endif
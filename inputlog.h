@@ -0,0 +1,170 @@
+//=====================================================================
+// InputLog.h
+// Records and replays the input that drives the simulation.
+// Input is sampled once per simulation step, so a log of the steps at
+// which it changed reproduces a run exactly, independent of frame
+// rate or timing. Each line holds the step, its time in milliseconds
+// (for reading only) and the full input state from that step on:
+//     input <step> <ms> <forward> <back> <left> <right> <speed> <rings>
+// Also measures input latency: each change of the camera input is
+// timestamped and matched to the first frame whose input was sampled
+// after it; the latency runs to the end of that frame's buffer swap.
+//=====================================================================
+
+#if !defined(H_INPUTLOG)
+#define H_INPUTLOG
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+using namespace std;
+
+typedef struct {
+	int forward;		// 1 or 0
+	int back;			// -1 or 0
+	int left;			// -1 or 0
+	int right;			// 1 or 0
+	float speed;		// movement multiplier
+	bool rings;
+} InputState;
+
+typedef struct {
+	long step;
+	InputState state;
+} InputEvent;
+
+typedef struct {
+	bool isRecording;
+	bool isReplaying;
+	float stepMs;				// simulated time per step
+	ofstream output;
+	InputState recorded;		// last state written
+	long recordedSteps;
+	vector<InputEvent> events;	// replay, in step order
+	size_t next;
+	InputState replayed;
+} InputLog;
+
+bool sameInput(const InputState& a, const InputState& b)
+{
+	return a.forward == b.forward && a.back == b.back && a.left == b.left && a.right == b.right
+		&& a.speed == b.speed && a.rings == b.rings;
+}
+
+void startInputRecording(InputLog* log, const char* path, float stepMs)
+{
+	log->output.open(path);
+	if (!log->output)
+	{
+		cout << "*** Error opening input log: " << path << endl;
+		exit(1);
+	}
+	log->output << "# step ms forward back left right speed rings" << endl;
+	log->isRecording = true;
+	log->recordedSteps = 0;
+	log->stepMs = stepMs;
+}
+
+// Logs the state if it differs from the last one written
+void recordInput(InputLog* log, long step, const InputState& state)
+{
+	if (!log->isRecording) return;
+	if (log->recordedSteps == 0 || !sameInput(state, log->recorded))
+	{
+		log->output << "input " << step << " " << step * log->stepMs << " " << state.forward << " " << state.back << " "
+			<< state.left << " " << state.right << " " << state.speed << " " << (state.rings ? 1 : 0) << endl;
+		log->recorded = state;
+	}
+	log->recordedSteps++;
+}
+
+void loadInputLog(InputLog* log, const char* path)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "*** Error opening input log: " << path << endl;
+		exit(1);
+	}
+	string line;
+	int number = 0;
+	while (getline(file, line))
+	{
+		number++;
+		size_t comment = line.find('#');
+		if (comment != string::npos) line.erase(comment);
+		istringstream tokens(line);
+		string keyword;
+		if (!(tokens >> keyword)) continue;
+
+		InputEvent e;
+		double ms;
+		int rings;
+		InputState& s = e.state;
+		if (keyword != "input" || !(tokens >> e.step >> ms >> s.forward >> s.back >> s.left >> s.right >> s.speed >> rings)
+			|| (!log->events.empty() && e.step < log->events.back().step))
+		{
+			cout << "*** Error in input log " << path << ":" << number << ": expected input lines in step order" << endl;
+			exit(1);
+		}
+		s.rings = rings != 0;
+		log->events.push_back(e);
+	}
+	log->isReplaying = true;
+	log->next = 0;
+}
+
+// Replaces the live input with the logged state for this step. Before
+// the first event the live input is kept.
+void replayInput(InputLog* log, long step, InputState* state)
+{
+	if (!log->isReplaying) return;
+	while (log->next < log->events.size() && log->events[log->next].step <= step)
+	{
+		log->replayed = log->events[log->next].state;
+		log->next++;
+	}
+	if (log->next > 0) *state = log->replayed;
+}
+
+typedef chrono::steady_clock::time_point InputTime;
+
+typedef struct {
+	deque<InputTime> pending;	// changes no displayed frame has sampled yet
+	vector<double> samples;		// ms, since the last report
+} InputLatency;
+
+// Call from the input callbacks when the input state has changed
+void noteInputChange(InputLatency* latency)
+{
+	latency->pending.push_back(chrono::steady_clock::now());
+}
+
+// Resolves the changes made before a frame's input was sampled, now
+// that the frame has been swapped
+void resolveInputLatency(InputLatency* latency, InputTime sampled, InputTime swapped)
+{
+	while (!latency->pending.empty() && latency->pending.front() <= sampled)
+	{
+		latency->samples.push_back(chrono::duration<double, milli>(swapped - latency->pending.front()).count());
+		latency->pending.pop_front();
+	}
+}
+
+// Prints percentiles and resets once 'events' changes are resolved
+void reportInputLatency(InputLatency* latency, size_t events)
+{
+	vector<double>& s = latency->samples;
+	if (s.empty() || s.size() < events) return;
+	sort(s.begin(), s.end());
+	cout << "input latency: " << s.size() << " changes, median " << s[s.size() / 2] << " ms, 90th "
+		<< s[(s.size() * 90) / 100] << " ms, 99th " << s[(s.size() * 99) / 100] << " ms, max " << s.back() << " ms" << endl;
+	s.clear();
+}
+
+#endif
@@ -0,0 +1,163 @@
+//=====================================================================
+// Jobs.h
+// Work-stealing job system.
+// Each thread owns a deque of jobs. Owners push and pop at the back,
+// so recently spawned work stays hot in cache, and idle threads steal
+// from the front of other deques. Completion is tracked with counters:
+// the thread that waits on a counter keeps running jobs until it drops
+// to zero, so waiting never blocks a core.
+//=====================================================================
+
+#if !defined(H_JOBS)
+#define H_JOBS
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+using namespace std;
+
+typedef struct {
+	function<void()> fn;
+	atomic<int>* counter;		// decremented when the job finishes
+} Job;
+
+typedef struct {
+	mutex lock;
+	deque<Job> jobs;
+} JobQueue;
+
+typedef struct {
+	vector<thread> workers;
+	JobQueue* queues;			// queue 0 belongs to the thread that created the system
+	int queueCount;
+	atomic<bool> running;
+	atomic<int> queued;			// jobs pushed but not yet taken
+	mutex sleepLock;
+	condition_variable wake;
+} JobSystem;
+
+// Index of the calling thread's queue; threads outside the system use 0
+thread_local int jobQueueIndex = 0;
+
+bool popJob(JobQueue* queue, Job* job, bool fromFront)
+{
+	lock_guard<mutex> guard(queue->lock);
+	if (queue->jobs.empty()) return false;
+	if (fromFront)
+	{
+		*job = move(queue->jobs.front());
+		queue->jobs.pop_front();
+	}
+	else
+	{
+		*job = move(queue->jobs.back());
+		queue->jobs.pop_back();
+	}
+	return true;
+}
+
+// Takes from the calling thread's own queue first, then steals
+bool takeJob(JobSystem* system, Job* job)
+{
+	int own = jobQueueIndex;
+	if (popJob(&system->queues[own], job, false))
+	{
+		system->queued--;
+		return true;
+	}
+	for (int i = 1; i < system->queueCount; i++)
+	{
+		if (popJob(&system->queues[(own + i) % system->queueCount], job, true))
+		{
+			system->queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void runJob(Job* job)
+{
+	job->fn();
+	if (job->counter) (*job->counter)--;
+}
+
+void jobWorker(JobSystem* system, int index)
+{
+	jobQueueIndex = index;
+	while (system->running)
+	{
+		Job job;
+		if (takeJob(system, &job))
+		{
+			runJob(&job);
+			continue;
+		}
+		unique_lock<mutex> guard(system->sleepLock);
+		system->wake.wait(guard, [system] { return system->queued > 0 || !system->running; });
+	}
+}
+
+// Starts 'threads - 1' workers; the creating thread is the remaining one
+void initialiseJobSystem(JobSystem* system, int threads)
+{
+	if (threads < 1) threads = 1;
+	system->queueCount = threads;
+	system->queues = new JobQueue[threads];
+	system->running = true;
+	system->queued = 0;
+	jobQueueIndex = 0;
+	for (int i = 1; i < threads; i++)
+	{
+		system->workers.push_back(thread(jobWorker, system, i));
+	}
+}
+
+void shutdownJobSystem(JobSystem* system)
+{
+	{
+		lock_guard<mutex> guard(system->sleepLock);
+		system->running = false;
+	}
+	system->wake.notify_all();
+	for (size_t i = 0; i < system->workers.size(); i++)
+	{
+		system->workers[i].join();
+	}
+	system->workers.clear();
+	delete[] system->queues;
+	system->queues = 0;
+}
+
+// Queues fn on the calling thread's deque and counts it against 'counter'
+void submitJob(JobSystem* system, atomic<int>* counter, function<void()> fn)
+{
+	if (counter) (*counter)++;
+	JobQueue* queue = &system->queues[jobQueueIndex];
+	{
+		lock_guard<mutex> guard(queue->lock);
+		queue->jobs.push_back({ move(fn), counter });
+	}
+	{
+		lock_guard<mutex> guard(system->sleepLock);
+		system->queued++;
+	}
+	system->wake.notify_one();
+}
+
+// Runs queued jobs until every job counted against 'counter' has finished
+void waitForJobs(JobSystem* system, atomic<int>* counter)
+{
+	while (*counter > 0)
+	{
+		Job job;
+		if (takeJob(system, &job)) runJob(&job);
+			else this_thread::yield();
+	}
+}
+
+#endif
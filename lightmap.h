@@ -0,0 +1,375 @@
+//=====================================================================
+// Lightmap.h
+// Lighting baked into textures for static geometry. Each lightmapped
+// surface is a chart: a mesh whose lightmap coordinates cover it once
+// (see Mesh.h), placed in the world, with its own rectangle of a shared
+// atlas. Baking rasterises each chart's triangles in lightmap space to
+// find the world position and normal under every texel centre, then
+// traces rays from there against a TriangleCollider: one shadow ray per
+// light, and a fixed set of cosine-weighted hemisphere rays for ambient
+// occlusion. Texels are independent, so they are spread across threads.
+// The lighting model is the fixed-function one the rest of the scene
+// uses, GL's global ambient plus unattenuated diffuse light, so baked
+// surfaces sit alongside lit ones; only the ambient is occluded.
+// Charts keep a texel of padding, filled from their edges after
+// baking, so bilinear filtering never reads a neighbouring chart.
+//=====================================================================
+
+#if !defined(H_LIGHTMAP)
+#define H_LIGHTMAP
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include <GL/freeglut.h>
+#include "vecmath.h"
+#include "mesh.h"
+#include "collision.h"
+#include "parallel.h"
+using namespace std;
+
+#define LIGHTMAP_TEXELS_PER_UNIT 0.5f	// before any halving to fit the atlas
+#define LIGHTMAP_MIN_SIZE 128
+#define LIGHTMAP_MAX_SIZE 2048
+#define LIGHTMAP_PADDING 1				// texels around each chart
+#define LIGHTMAP_AO_RAYS 16
+#define LIGHTMAP_AO_DISTANCE 60			// occluders further away do not darken
+#define LIGHTMAP_AMBIENT 0.2f			// GL's default global ambient
+#define LIGHTMAP_BIAS 0.05f				// rays start this far off the surface
+#define LIGHTMAP_SUN_DISTANCE 10000		// length of shadow rays towards directional lights
+
+typedef struct {
+	Vec3 vector;			// towards a directional light, or a point light's position
+	Vec3 colour;
+	bool isPoint;
+} LightmapLight;
+
+typedef struct {
+	const Mesh* mesh;
+	Mat4 world;
+	float normalSign;		// -1 to light the backs of the mesh's faces
+	float extent[2];		// world units covered by the lightmap coordinates
+	int width, height;		// texels, without padding
+	int x, y;				// padded rectangle's corner in the atlas
+} LightmapChart;
+
+typedef struct {
+	Vec3 position, normal;
+	int texel;				// index into the atlas
+} LightmapSample;
+
+typedef struct {
+	vector<LightmapChart> charts;
+	vector<LightmapLight> lights;
+	int size;						// atlas width and height
+	float texelsPerUnit;
+	vector<unsigned char> texels;	// RGB
+	long texelsBaked, rays;
+} Lightmap;
+
+// Lightmap coordinates from the positions' extent along two axes, for
+// flat surfaces
+void planarLightmapCoords(Mesh* mesh, int uAxis, int vAxis)
+{
+	int count = (int)(mesh->vertices.size() / MESH_VERTEX_FLOATS);
+	float lo[2] = { FLT_MAX, FLT_MAX }, hi[2] = { -FLT_MAX, -FLT_MAX };
+	int axes[2] = { uAxis, vAxis };
+	for (int i = 0; i < count; i++)
+	{
+		const float* p = &mesh->vertices[i * MESH_VERTEX_FLOATS + 5];
+		for (int a = 0; a < 2; a++)
+		{
+			lo[a] = minf(lo[a], p[axes[a]]);
+			hi[a] = maxf(hi[a], p[axes[a]]);
+		}
+	}
+	mesh->lightmapCoords.resize(count * 2);
+	for (int i = 0; i < count; i++)
+	{
+		const float* p = &mesh->vertices[i * MESH_VERTEX_FLOATS + 5];
+		for (int a = 0; a < 2; a++)
+		{
+			mesh->lightmapCoords[i * 2 + a] = hi[a] > lo[a] ? (p[axes[a]] - lo[a]) / (hi[a] - lo[a]) : 0;
+		}
+	}
+}
+
+// The texture coordinates, for meshes whose texture already covers
+// them once
+void textureLightmapCoords(Mesh* mesh)
+{
+	int count = (int)(mesh->vertices.size() / MESH_VERTEX_FLOATS);
+	mesh->lightmapCoords.resize(count * 2);
+	for (int i = 0; i < count; i++)
+	{
+		mesh->lightmapCoords[i * 2] = mesh->vertices[i * MESH_VERTEX_FLOATS];
+		mesh->lightmapCoords[i * 2 + 1] = mesh->vertices[i * MESH_VERTEX_FLOATS + 1];
+	}
+}
+
+// Returns the chart's index. 'width' and 'height' are the surface's
+// size in world units along its lightmap coordinates.
+int addLightmapChart(Lightmap* lightmap, const Mesh* mesh, const Mat4& world, float width, float height, bool isBack)
+{
+	LightmapChart chart = { mesh, world, isBack ? -1.0f : 1.0f, { width, height }, 0, 0, 0, 0 };
+	lightmap->charts.push_back(chart);
+	return (int)lightmap->charts.size() - 1;
+}
+
+void addLightmapLight(Lightmap* lightmap, Vec3 vector, Vec3 colour, bool isPoint)
+{
+	LightmapLight light = { isPoint ? vector : normalize(vector), colour, isPoint };
+	lightmap->lights.push_back(light);
+}
+
+// Shelf packing, tallest charts first; false if they do not fit
+bool packLightmapCharts(Lightmap* lightmap, int size, float texelsPerUnit)
+{
+	vector<int> order(lightmap->charts.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		LightmapChart* chart = &lightmap->charts[i];
+		chart->width = max(2, (int)ceil(chart->extent[0] * texelsPerUnit));
+		chart->height = max(2, (int)ceil(chart->extent[1] * texelsPerUnit));
+		order[i] = (int)i;
+	}
+	sort(order.begin(), order.end(), [&](int a, int b) { return lightmap->charts[a].height > lightmap->charts[b].height; });
+
+	int x = 0, y = 0, shelf = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		LightmapChart* chart = &lightmap->charts[order[i]];
+		int w = chart->width + LIGHTMAP_PADDING * 2, h = chart->height + LIGHTMAP_PADDING * 2;
+		if (x + w > size)
+		{
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		if (x + w > size || y + h > size) return false;
+		chart->x = x;
+		chart->y = y;
+		x += w;
+		shelf = max(shelf, h);
+	}
+	return true;
+}
+
+// Picks the smallest atlas that holds every chart, lowering the texel
+// density when even the largest does not
+void layoutLightmap(Lightmap* lightmap)
+{
+	for (float density = LIGHTMAP_TEXELS_PER_UNIT; ; density /= 2)
+	{
+		for (int size = LIGHTMAP_MIN_SIZE; size <= LIGHTMAP_MAX_SIZE; size *= 2)
+		{
+			if (!packLightmapCharts(lightmap, size, density)) continue;
+			lightmap->size = size;
+			lightmap->texelsPerUnit = density;
+			return;
+		}
+	}
+}
+
+// The world position and normal under each texel centre the chart's
+// triangles cover; 'covered' marks them in the atlas
+void rasteriseLightmapChart(const Lightmap* lightmap, int index, vector<LightmapSample>* samples, vector<unsigned char>* covered)
+{
+	const LightmapChart* chart = &lightmap->charts[index];
+	const Mesh* mesh = chart->mesh;
+	const float* uv = mesh->lightmapCoords.data();
+	for (size_t i = 0; i + 2 < mesh->indices.size(); i += 3)
+	{
+		const float* v[3];
+		float px[3], py[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int vertex = mesh->indices[i + k];
+			v[k] = &mesh->vertices[vertex * MESH_VERTEX_FLOATS];
+			px[k] = uv[vertex * 2] * chart->width;
+			py[k] = uv[vertex * 2 + 1] * chart->height;
+		}
+		float area = (px[1] - px[0]) * (py[2] - py[0]) - (px[2] - px[0]) * (py[1] - py[0]);
+		if (fabsf(area) < 1e-8f) continue;
+
+		int x0 = max((int)floor(minf(px[0], minf(px[1], px[2]))), 0);
+		int x1 = min((int)ceil(maxf(px[0], maxf(px[1], px[2]))), chart->width - 1);
+		int y0 = max((int)floor(minf(py[0], minf(py[1], py[2]))), 0);
+		int y1 = min((int)ceil(maxf(py[0], maxf(py[1], py[2]))), chart->height - 1);
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				// Barycentric weights of the texel centre
+				float cx = x + 0.5f, cy = y + 0.5f, w[3];
+				for (int k = 0; k < 3; k++)
+				{
+					int a = (k + 1) % 3, b = (k + 2) % 3;
+					w[k] = ((px[b] - px[a]) * (cy - py[a]) - (cx - px[a]) * (py[b] - py[a])) / area;
+				}
+				if (w[0] < -1e-4f || w[1] < -1e-4f || w[2] < -1e-4f) continue;
+
+				int texel = (chart->y + LIGHTMAP_PADDING + y) * lightmap->size + chart->x + LIGHTMAP_PADDING + x;
+				if ((*covered)[texel]) continue;
+				(*covered)[texel] = 1;
+
+				Vec3 position = vec3(0, 0, 0), normal = vec3(0, 0, 0);
+				for (int k = 0; k < 3; k++)
+				{
+					normal += vec3(v[k][2], v[k][3], v[k][4]) * w[k];
+					position += vec3(v[k][5], v[k][6], v[k][7]) * w[k];
+				}
+				LightmapSample sample = { transformPoint(chart->world, position),
+					normalize(transformDirection(chart->world, normal)) * chart->normalSign, texel };
+				samples->push_back(sample);
+			}
+		}
+	}
+}
+
+// Cosine-weighted directions about +z, from a Hammersley set
+void lightmapHemisphere(Vec3* directions, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int bits = (unsigned int)i;
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+		float u = (i + 0.5f) / count, s, c;
+		sinCos(TWO_PI * bits * 2.3283064e-10f, &s, &c);
+		float r = sqrtf(u);
+		directions[i] = vec3(r * c, r * s, sqrtf(1 - u));
+	}
+}
+
+Vec3 bakeLightmapSample(const Lightmap* lightmap, const TriangleCollider* occluders, const LightmapSample& sample, const Vec3* hemisphere)
+{
+	Vec3 n = sample.normal;
+	Vec3 origin = sample.position + n * LIGHTMAP_BIAS;
+
+	// Each texel turns the hemisphere set by a different angle, which
+	// trades the banding of a fixed set for fine noise
+	Vec3 tangent = normalize(cross(fabsf(n.y) < 0.9f ? vec3(0, 1, 0) : vec3(1, 0, 0), n));
+	Vec3 bitangent = cross(n, tangent);
+	float turn = sample.texel * 0.618034f, s, c;
+	sinCos(TWO_PI * (turn - floorf(turn)), &s, &c);
+	int open = 0;
+	for (int i = 0; i < LIGHTMAP_AO_RAYS; i++)
+	{
+		Vec3 h = hemisphere[i];
+		Vec3 direction = tangent * (h.x * c - h.y * s) + bitangent * (h.x * s + h.y * c) + n * h.z;
+		float t = LIGHTMAP_AO_DISTANCE;
+		if (raycastTriangles(occluders, origin, direction, &t) < 0) open++;
+	}
+	Vec3 light = vec3(1, 1, 1) * (LIGHTMAP_AMBIENT * open / LIGHTMAP_AO_RAYS);
+
+	for (size_t i = 0; i < lightmap->lights.size(); i++)
+	{
+		const LightmapLight* l = &lightmap->lights[i];
+		Vec3 toLight = l->isPoint ? l->vector - origin : l->vector * LIGHTMAP_SUN_DISTANCE;
+		float diffuse = dot(n, normalize(toLight));
+		if (diffuse <= 0) continue;
+		float t = 1;
+		if (raycastTriangles(occluders, origin, toLight, &t) >= 0) continue;
+		light += l->colour * diffuse;
+	}
+	return light;
+}
+
+// Spreads covered texels into their uncovered neighbours, so filtering
+// at a chart's edge reads its own lighting
+void dilateLightmap(Lightmap* lightmap, vector<unsigned char>* covered, int passes)
+{
+	int size = lightmap->size;
+	for (int pass = 0; pass < passes; pass++)
+	{
+		vector<unsigned char> was = *covered;
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				if (was[y * size + x]) continue;
+				int sum[3] = { 0, 0, 0 }, count = 0;
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int nx = x + dx, ny = y + dy;
+						if (nx < 0 || ny < 0 || nx >= size || ny >= size || !was[ny * size + nx]) continue;
+						for (int k = 0; k < 3; k++) sum[k] += lightmap->texels[(ny * size + nx) * 3 + k];
+						count++;
+					}
+				}
+				if (count == 0) continue;
+				for (int k = 0; k < 3; k++) lightmap->texels[(y * size + x) * 3 + k] = (unsigned char)(sum[k] / count);
+				(*covered)[y * size + x] = 1;
+			}
+		}
+	}
+}
+
+// Lays out the atlas and bakes every chart. 'occluders' should hold all
+// the static geometry, charts included.
+void bakeLightmap(Lightmap* lightmap, const TriangleCollider* occluders)
+{
+	layoutLightmap(lightmap);
+	int size = lightmap->size;
+	lightmap->texels.assign(size * size * 3, 0);
+	vector<unsigned char> covered(size * size, 0);
+	vector<LightmapSample> samples;
+	for (size_t i = 0; i < lightmap->charts.size(); i++)
+	{
+		rasteriseLightmapChart(lightmap, (int)i, &samples, &covered);
+	}
+
+	Vec3 hemisphere[LIGHTMAP_AO_RAYS];
+	lightmapHemisphere(hemisphere, LIGHTMAP_AO_RAYS);
+	parallelFor((int)samples.size(), 256, 1, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			Vec3 light = bakeLightmapSample(lightmap, occluders, samples[i], hemisphere);
+			unsigned char* texel = &lightmap->texels[samples[i].texel * 3];
+			texel[0] = (unsigned char)(clampf(light.x, 0, 1) * 255 + 0.5f);
+			texel[1] = (unsigned char)(clampf(light.y, 0, 1) * 255 + 0.5f);
+			texel[2] = (unsigned char)(clampf(light.z, 0, 1) * 255 + 0.5f);
+		}
+	});
+	dilateLightmap(lightmap, &covered, LIGHTMAP_PADDING + 1);
+	lightmap->texelsBaked = (long)samples.size();
+	lightmap->rays = lightmap->texelsBaked * (LIGHTMAP_AO_RAYS + (long)lightmap->lights.size());
+}
+
+// Texture matrix taking a chart's lightmap coordinates to its texels in
+// the atlas
+Mat4 lightmapChartMatrix(const Lightmap* lightmap, int index)
+{
+	const LightmapChart* chart = &lightmap->charts[index];
+	float texel = 1.0f / lightmap->size;
+	return mat4Translation(vec3((chart->x + LIGHTMAP_PADDING) * texel, (chart->y + LIGHTMAP_PADDING) * texel, 0))
+		* mat4Scale(vec3(chart->width * texel, chart->height * texel, 1));
+}
+
+// Leaves the lightmap bound to the second texture unit, modulating
+// whatever the first unit outputs. Needs a current GL context.
+GLuint uploadLightmap(const Lightmap* lightmap)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, lightmap->size, lightmap->size, 0, GL_RGB, GL_UNSIGNED_BYTE, lightmap->texels.data());
+	glActiveTexture(GL_TEXTURE0);
+	return texture;
+}
+
+#endif
@@ -2,6 +2,8 @@
 // LoadTGA.h
 // Image loader for files in TGA format.
 // Assumption:  Uncompressed data.
+// Images own their pixels; a run of loads can decode into one reused
+// ImageArena instead of allocating a buffer per image.
 //
 // Author:
 // R. Mukundan, Department of Computer Science and Software Engineering
@@ -15,81 +17,165 @@
 
 #include <iostream>
 #include <fstream>
+#include <vector>
 #include <GL/freeglut.h>
 using namespace std;
 
 typedef struct {
 	int width;
 	int height;
-	char* data;
+	vector<char> data;		// owned: freed with the image
 	int nbytes;
 } ImageData;
 
-ImageData loadTGAImageData(const char* filename)
+// Scratch image for decoding into. Its buffer only ever grows, so once
+// it has held the largest image a run of loads allocates nothing; size
+// it up front with reserveImageArena. Not thread-safe: keep one per
+// thread when loading in parallel.
+typedef struct {
+	ImageData image;
+	int allocations;		// times the buffer had to grow
+	int loads;
+} ImageArena;
+
+// Unbuffered, so opening allocates nothing and pixels are read straight
+// into the image in one call
+void openTGA(ifstream& file, const char* filename)
+{
+	file.rdbuf()->pubsetbuf(0, 0);
+	file.open(filename, ios::in | ios::binary);
+}
+
+// Reads the 18-byte header; false if the file cannot be opened or is
+// not an uncompressed TGA
+bool readTGAHeader(ifstream& file, int* width, int* height, int* nbytes)
+{
+	unsigned char header[18];
+	if (!file.read((char*)header, 18)) return false;
+	if (header[2] != 2 && header[2] != 3) return false;	//2= colour (uncompressed),  3 = greyscale (uncompressed)
+	*width = header[12] | (header[13] << 8);
+	*height = header[14] | (header[15] << 8);
+	*nbytes = header[16] / 8;	//No. of bytes per pixels
+	return true;
+}
+
+// Bytes of pixel data in a TGA file, from its header only, or 0
+int tgaImageSize(const char* filename)
+{
+	ifstream file;
+	openTGA(file, filename);
+	int width, height, nbytes;
+	if (!file || !readTGAHeader(file, &width, &height, &nbytes)) return 0;
+	return width * height * nbytes;
+}
+
+void reserveImageArena(ImageArena* arena, int bytes)
+{
+	if ((size_t)bytes <= arena->image.data.capacity()) return;
+	arena->image.data.reserve(bytes);
+	arena->allocations++;
+}
+
+// Decodes into the arena's image, which stays valid until its next load
+const ImageData* loadTGAImageData(const char* filename, ImageArena* arena)
 {
-	char id, cmap, imgtype, bpp, c_garb;
-    char* imageData, temp;
-    short int s_garb, wid, hgt;
-    int nbytes, size, indx;
-    ifstream file( filename, ios::in | ios::binary);
+	ifstream file;
+	openTGA(file, filename);
 	if(!file)
 	{
 		cout << "*** Error opening image file: " << filename << endl;
 		exit(1);
 	}
-	file.read (&id, 1);
-	file.read (&cmap, 1);
-	file.read (&imgtype, 1);	
-	if(imgtype != 2 && imgtype != 3 )   //2= colour (uncompressed),  3 = greyscale (uncompressed)
+	ImageData* image = &arena->image;
+	if (!readTGAHeader(file, &image->width, &image->height, &image->nbytes))
 	{
-		cout << "*** Incompatible image type: " << (int)imgtype << endl;
+		cout << "*** Incompatible image type: " << filename << endl;
 		exit(1);
 	}
-	//Color map specification
-	file.read ((char*)&s_garb, 2);
-	file.read ((char*)&s_garb, 2);
-	file.read (&c_garb, 1);
-	//Image specification
-	file.read ((char*)&s_garb, 2);  //x origin
-	file.read ((char*)&s_garb, 2);  //y origin
-	file.read ((char*)&wid, 2);     //image width								    
-	file.read ((char*)&hgt, 2);     //image height
-	file.read (&bpp, 1);     //bits per pixel
-	file.read (&c_garb, 1);  //img descriptor
-	nbytes = bpp / 8;           //No. of bytes per pixels
-	size = wid * hgt * nbytes;  //Total number of bytes to be read
-	imageData = new char[size];
-	file.read(imageData, size);
-	if(nbytes > 2)   //swap R and B
+	int size = image->width * image->height * image->nbytes;	//Total number of bytes to be read
+	reserveImageArena(arena, size);
+	image->data.resize(size);
+	file.read(image->data.data(), size);
+	arena->loads++;
+
+	char* pixels = image->data.data();
+	if(image->nbytes > 2)   //swap R and B
 	{
-	    for(int i = 0; i < wid*hgt;  i++)
-	    {
-	        indx = i*nbytes;
-	        temp = imageData[indx];
-	        imageData[indx] = imageData[indx+2];
-	        imageData[indx+2] = temp;
-        }
-    }
-	return { wid, hgt, imageData, nbytes };
+		for(int i = 0; i < image->width * image->height; i++)
+		{
+			int indx = i * image->nbytes;
+			char temp = pixels[indx];
+			pixels[indx] = pixels[indx+2];
+			pixels[indx+2] = temp;
+		}
+	}
+	return image;
 }
 
-void loadTGA(const char* filename)
+// An image of its own, for keeping beyond the next load
+ImageData loadTGAImageData(const char* filename)
 {
-	ImageData imageData = loadTGAImageData(filename);
+	ImageArena arena = { ImageData(), 0, 0 };
+	loadTGAImageData(filename, &arena);
+	return move(arena.image);
+}
 
-	switch (imageData.nbytes)
+void uploadTGA(const ImageData* image)
+{
+	switch (image->nbytes)
 	{
 	     case 1:
-	         glTexImage2D(GL_TEXTURE_2D, 0, 1, imageData.width, imageData.height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, imageData.data);
+	         glTexImage2D(GL_TEXTURE_2D, 0, 1, image->width, image->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, image->data.data());
 	         break;
 	     case 3:
-	         glTexImage2D(GL_TEXTURE_2D, 0, 3, imageData.width, imageData.height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData.data);
+	         glTexImage2D(GL_TEXTURE_2D, 0, 3, image->width, image->height, 0, GL_RGB, GL_UNSIGNED_BYTE, image->data.data());
 	         break;
 	     case 4:
-	         glTexImage2D(GL_TEXTURE_2D, 0, 4, imageData.width, imageData.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData.data);
+	         glTexImage2D(GL_TEXTURE_2D, 0, 4, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->data.data());
 	         break;
      }
-     delete imageData.data;	         	         
+}
+
+void loadTGA(const char* filename, ImageArena* arena)
+{
+	uploadTGA(loadTGAImageData(filename, arena));
+}
+
+void loadTGA(const char* filename)
+{
+	ImageData image = loadTGAImageData(filename);
+	uploadTGA(&image);
+}
+
+// Writes an uncompressed 24-bit TGA. Rows are expected bottom to top,
+// as glReadPixels returns them, which is TGA's default origin.
+void saveTGA(const char* filename, int width, int height, const unsigned char* rgb)
+{
+	ofstream file(filename, ios::out | ios::binary);
+	if(!file)
+	{
+		cout << "*** Error opening image file: " << filename << endl;
+		exit(1);
+	}
+	unsigned char header[18] = { 0 };
+	header[2] = 2;					//colour (uncompressed)
+	header[12] = width & 0xff;
+	header[13] = (width >> 8) & 0xff;
+	header[14] = height & 0xff;
+	header[15] = (height >> 8) & 0xff;
+	header[16] = 24;				//bits per pixel
+	file.write((const char*)header, 18);
+
+	int size = width * height * 3;
+	char* imageData = new char[size];
+	for(int i = 0; i < width*height; i++)	//swap R and B
+	{
+		imageData[i*3] = rgb[i*3+2];
+		imageData[i*3+1] = rgb[i*3+1];
+		imageData[i*3+2] = rgb[i*3];
+	}
+	file.write(imageData, size);
+	delete[] imageData;
 }
 
 #endif
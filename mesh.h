@@ -0,0 +1,461 @@
+//=====================================================================
+// Mesh.h
+// Indexed mesh builder shared by the procedural geometry.
+// Positions are welded within a small tolerance, so faces that meet at
+// a seam share smooth normals even when their texture coordinates
+// differ. Normals are area-weighted face normals accumulated in a
+// single pass over the triangles. The result is an interleaved
+// GL_T2F_N3F_V3F vertex buffer and a triangle index buffer, plus
+// optional lightmap coordinates (see Lightmap.h) that drawMesh feeds to
+// the second texture unit.
+// Unless built in generation order, each mesh's triangles and vertices
+// are then reordered for the vertex cache, overdraw and vertex fetch
+// (see MeshOrder.h); the mesh keeps the ACMR of its generated order so
+// the gain can be reported.
+// With the packed vertex format each mesh also gets a 16-byte copy of
+// its vertices, which is what drawMesh submits: half-float texture
+// coordinates, 8-bit signed normalised normals, and 16-bit positions
+// scaled into the mesh's bounds. (Normal arrays would take 10:10:10:2
+// in the GL 3.3 spec, but Mesa refuses it without a fourth component,
+// which normals never have.) Positions are restored in the vertex stage
+// by multiplying the unpacking scale and offset onto the modelview
+// matrix; the scale is the same on every axis, so normals only need the
+// renormalisation GL_NORMALIZE already does. The float vertices stay
+// for the CPU side: collision, picking and lightmaps.
+//=====================================================================
+
+#if !defined(H_MESH)
+#define H_MESH
+
+#include <vector>
+#include <unordered_map>
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <GL/freeglut.h>
+#include "meshorder.h"
+using namespace std;
+
+#define MESH_WELD_TOLERANCE 1e-4f
+#define MESH_VERTEX_FLOATS 8	// s t  nx ny nz  x y z
+#define MESH_PACKED_RANGE 32767	// largest packed position, at the edge of the mesh's bounds
+
+#define MESH_FORMAT_FLOAT 0		// GL_T2F_N3F_V3F only, 32 bytes a vertex
+#define MESH_FORMAT_PACKED 1	// plus PackedVertex, 16 bytes a vertex
+
+#define MESH_ORDER_GENERATED 0	// triangles and vertices as the generator emitted them
+#define MESH_ORDER_OPTIMISED 1
+
+typedef struct {
+	unsigned short texCoord[2];	// half floats
+	signed char normal[4];		// xyz signed normalised; w pads
+	short position[4];			// xyz; w pads the vertex to 16 bytes
+} PackedVertex;
+
+typedef struct {
+	vector<float> vertices;			// GL_T2F_N3F_V3F interleaved
+	vector<unsigned int> indices;	// triangle list
+	vector<float> lightmapCoords;	// 2 per vertex, covering the surface once; empty if not lightmapped
+	vector<PackedVertex> packed;	// empty unless built with the packed format
+	float packOrigin[3];			// position = packOrigin + packed position * packScale
+	float packScale;
+	float generatedACMR;			// in the order the generator emitted the triangles
+} Mesh;
+
+int meshVertexFormat = MESH_FORMAT_FLOAT;	// MESH_FORMAT_*, for meshes built from now on
+int meshIndexOrder = MESH_ORDER_OPTIMISED;	// MESH_ORDER_*, likewise
+
+// Vertex data drawMesh has submitted, and what it would have been as
+// floats; lightmap coordinates count towards both
+long meshBytesDrawn = 0;
+long meshFloatBytesDrawn = 0;
+
+typedef struct {
+	long long x, y, z;	// position quantised to the weld tolerance
+} MeshPositionKey;
+
+struct MeshPositionKeyHash
+{
+	size_t operator()(const MeshPositionKey& k) const
+	{
+		return (size_t)(k.x * 73856093LL ^ k.y * 19349663LL ^ k.z * 83492791LL);
+	}
+};
+
+struct MeshPositionKeyEqual
+{
+	bool operator()(const MeshPositionKey& a, const MeshPositionKey& b) const
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+typedef struct {
+	int position;
+	float s, t;
+	float normal[3];
+	bool hasNormal;
+} MeshVertexKey;
+
+struct MeshVertexKeyHash
+{
+	size_t operator()(const MeshVertexKey& k) const
+	{
+		size_t h = (size_t)k.position * 2654435761u;
+		unsigned int bits[5];
+		memcpy(bits, &k.s, sizeof(float));
+		memcpy(bits + 1, &k.t, sizeof(float));
+		memcpy(bits + 2, k.normal, 3 * sizeof(float));
+		for (int i = 0; i < 5; i++)
+		{
+			h ^= bits[i] + 0x9e3779b9 + (h << 6) + (h >> 2);
+		}
+		return h;
+	}
+};
+
+struct MeshVertexKeyEqual
+{
+	bool operator()(const MeshVertexKey& a, const MeshVertexKey& b) const
+	{
+		return a.position == b.position && a.s == b.s && a.t == b.t && a.hasNormal == b.hasNormal
+			&& a.normal[0] == b.normal[0] && a.normal[1] == b.normal[1] && a.normal[2] == b.normal[2];
+	}
+};
+
+typedef struct {
+	vector<float> positions;						// welded, 3 floats each
+	unordered_map<MeshPositionKey, int, MeshPositionKeyHash, MeshPositionKeyEqual> positionLookup;
+	vector<MeshVertexKey> vertices;
+	unordered_map<MeshVertexKey, int, MeshVertexKeyHash, MeshVertexKeyEqual> vertexLookup;
+	vector<unsigned int> indices;
+} MeshBuilder;
+
+int addMeshPosition(MeshBuilder* builder, float x, float y, float z)
+{
+	MeshPositionKey key = {
+		(long long)floor(x / MESH_WELD_TOLERANCE + 0.5),
+		(long long)floor(y / MESH_WELD_TOLERANCE + 0.5),
+		(long long)floor(z / MESH_WELD_TOLERANCE + 0.5)
+	};
+	unordered_map<MeshPositionKey, int, MeshPositionKeyHash, MeshPositionKeyEqual>::iterator it = builder->positionLookup.find(key);
+	if (it != builder->positionLookup.end()) return it->second;
+
+	int index = (int)(builder->positions.size() / 3);
+	builder->positions.push_back(x);
+	builder->positions.push_back(y);
+	builder->positions.push_back(z);
+	builder->positionLookup[key] = index;
+	return index;
+}
+
+int addMeshVertex(MeshBuilder* builder, const MeshVertexKey& key)
+{
+	unordered_map<MeshVertexKey, int, MeshVertexKeyHash, MeshVertexKeyEqual>::iterator it = builder->vertexLookup.find(key);
+	if (it != builder->vertexLookup.end()) return it->second;
+
+	int index = (int)builder->vertices.size();
+	builder->vertices.push_back(key);
+	builder->vertexLookup[key] = index;
+	return index;
+}
+
+// Adds a vertex whose normal is generated from the surrounding faces.
+int addMeshVertex(MeshBuilder* builder, float x, float y, float z, float s, float t)
+{
+	MeshVertexKey key = { addMeshPosition(builder, x, y, z), s, t, { 0, 0, 0 }, false };
+	return addMeshVertex(builder, key);
+}
+
+// Adds a vertex with a fixed normal, e.g. one computed analytically.
+int addMeshVertex(MeshBuilder* builder, float x, float y, float z, float nx, float ny, float nz, float s, float t)
+{
+	MeshVertexKey key = { addMeshPosition(builder, x, y, z), s, t, { nx, ny, nz }, true };
+	return addMeshVertex(builder, key);
+}
+
+void addMeshTriangle(MeshBuilder* builder, int a, int b, int c)
+{
+	builder->indices.push_back(a);
+	builder->indices.push_back(b);
+	builder->indices.push_back(c);
+}
+
+// Counter-clockwise quad a-b-c-d
+void addMeshQuad(MeshBuilder* builder, int a, int b, int c, int d)
+{
+	addMeshTriangle(builder, a, b, c);
+	addMeshTriangle(builder, a, c, d);
+}
+
+//-- Packed vertices ------------------------------------------------------
+
+// Rounds to nearest; out of range values become infinity
+inline unsigned short floatToHalf(float f)
+{
+	unsigned int bits;
+	memcpy(&bits, &f, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000, mantissa = bits & 0x7FFFFF;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	if (exponent >= 31) return (unsigned short)(sign | 0x7C00);
+	if (exponent <= 0)
+	{
+		// Subnormal, or too small for a half at all
+		if (exponent < -10) return (unsigned short)sign;
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1) half++;
+		return (unsigned short)(sign | half);
+	}
+	// A carry out of the mantissa correctly bumps the exponent
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000) half++;
+	return (unsigned short)half;
+}
+
+inline float halfToFloat(unsigned short h)
+{
+	int exponent = (h >> 10) & 0x1F, mantissa = h & 0x3FF;
+	float f = exponent == 0 ? ldexpf((float)mantissa, -24)
+		: (exponent == 31 ? INFINITY : ldexpf((float)(mantissa | 0x400), exponent - 25));
+	return h & 0x8000 ? -f : f;
+}
+
+inline void packNormal(const float* n, signed char* out)
+{
+	for (int i = 0; i < 3; i++) out[i] = (signed char)lroundf(fmaxf(-1, fminf(1, n[i])) * 127);
+	out[3] = 0;
+}
+
+inline void unpackNormal(const signed char* packed, float* n)
+{
+	for (int i = 0; i < 3; i++) n[i] = fmaxf(packed[i] / 127.0f, -1);
+}
+
+// Fills mesh->packed from the float vertices
+void packMesh(Mesh* mesh)
+{
+	int count = (int)(mesh->vertices.size() / MESH_VERTEX_FLOATS);
+	float lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (int i = 0; i < count; i++)
+	{
+		const float* p = &mesh->vertices[i * MESH_VERTEX_FLOATS + 5];
+		for (int k = 0; k < 3; k++)
+		{
+			lo[k] = fminf(lo[k], p[k]);
+			hi[k] = fmaxf(hi[k], p[k]);
+		}
+	}
+	float extent = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		mesh->packOrigin[k] = count > 0 ? (lo[k] + hi[k]) / 2 : 0;
+		extent = fmaxf(extent, count > 0 ? (hi[k] - lo[k]) / 2 : 0);
+	}
+	mesh->packScale = extent > 0 ? extent / MESH_PACKED_RANGE : 1;
+
+	mesh->packed.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		const float* v = &mesh->vertices[i * MESH_VERTEX_FLOATS];
+		PackedVertex* out = &mesh->packed[i];
+		out->texCoord[0] = floatToHalf(v[0]);
+		out->texCoord[1] = floatToHalf(v[1]);
+		packNormal(v + 2, out->normal);
+		for (int k = 0; k < 3; k++)
+		{
+			out->position[k] = (short)lroundf((v[5 + k] - mesh->packOrigin[k]) / mesh->packScale);
+		}
+		out->position[3] = 0;
+	}
+}
+
+// Largest differences between the packed vertices and the floats they
+// came from: position in scene units, normal in degrees, texture
+// coordinate in texture repeats
+void measurePackingError(const Mesh* mesh, float* position, float* normal, float* texCoord)
+{
+	*position = *normal = *texCoord = 0;
+	for (size_t i = 0; i < mesh->packed.size(); i++)
+	{
+		const float* v = &mesh->vertices[i * MESH_VERTEX_FLOATS];
+		const PackedVertex* p = &mesh->packed[i];
+		for (int k = 0; k < 2; k++) *texCoord = fmaxf(*texCoord, fabsf(halfToFloat(p->texCoord[k]) - v[k]));
+		float n[3], d2 = 0, cosine = 0, length2 = 0;
+		unpackNormal(p->normal, n);
+		for (int k = 0; k < 3; k++)
+		{
+			float d = mesh->packOrigin[k] + p->position[k] * mesh->packScale - v[5 + k];
+			d2 += d * d;
+			cosine += n[k] * v[2 + k];
+			length2 += n[k] * n[k];
+		}
+		*position = fmaxf(*position, sqrtf(d2));
+		if (length2 > 0) *normal = fmaxf(*normal, acosf(fminf(1, cosine / sqrtf(length2))) * 57.29578f);
+	}
+}
+
+// One line per mesh: vertex buffer sizes in both formats, which is also
+// what each draw of the mesh submits, and the packing error
+void printMeshPacking(const char* name, const Mesh* mesh)
+{
+	size_t count = mesh->vertices.size() / MESH_VERTEX_FLOATS;
+	size_t floatBytes = mesh->vertices.size() * sizeof(float), packedBytes = mesh->packed.size() * sizeof(PackedVertex);
+	float position, normal, texCoord;
+	measurePackingError(mesh, &position, &normal, &texCoord);
+	cout << "  " << name << ": " << count << " vertices, " << floatBytes << " -> " << packedBytes << " bytes a draw ("
+		<< (floatBytes > 0 ? 100 - (100 * packedBytes) / floatBytes : 0) << "% less), max error: position " << position
+		<< ", normal " << normal << " degrees, texcoord " << texCoord << endl;
+}
+
+//-- Triangle and vertex order ---------------------------------------------
+
+inline int meshVertexCount(const Mesh* mesh)
+{
+	return (int)(mesh->vertices.size() / MESH_VERTEX_FLOATS);
+}
+
+float meshACMR(const Mesh* mesh)
+{
+	return measureACMR(mesh->indices.data(), mesh->indices.size(), meshVertexCount(mesh));
+}
+
+// Runs before packing and before any lightmap coordinates exist, so only
+// the float vertices need moving
+void optimiseMeshOrder(Mesh* mesh)
+{
+	unsigned int* indices = mesh->indices.data();
+	size_t count = mesh->indices.size();
+	optimiseVertexCache(indices, count, meshVertexCount(mesh));
+	optimiseOverdraw(indices, count, mesh->vertices.data() + 5, MESH_VERTEX_FLOATS, meshVertexCount(mesh), MESH_OVERDRAW_THRESHOLD);
+
+	vector<int> order;
+	optimiseVertexFetch(indices, count, meshVertexCount(mesh), &order);
+	vector<float> vertices(order.size() * MESH_VERTEX_FLOATS);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		memcpy(&vertices[i * MESH_VERTEX_FLOATS], &mesh->vertices[order[i] * MESH_VERTEX_FLOATS], MESH_VERTEX_FLOATS * sizeof(float));
+	}
+	mesh->vertices.swap(vertices);
+}
+
+// One line per mesh: its size and ACMR in generated and current order
+void printMeshOrder(const char* name, const Mesh* mesh)
+{
+	cout << "  " << name << ": " << mesh->indices.size() / 3 << " triangles, " << meshVertexCount(mesh)
+		<< " vertices, ACMR " << mesh->generatedACMR << " -> " << meshACMR(mesh) << endl;
+}
+
+// Computes smooth normals and writes the interleaved GPU buffers.
+void buildMesh(MeshBuilder* builder, Mesh* mesh)
+{
+	const vector<float>& p = builder->positions;
+	vector<float> normals(p.size(), 0);
+
+	// The unnormalised cross product is twice the triangle's area, so
+	// summing it weights each face by its size
+	for (size_t i = 0; i < builder->indices.size(); i += 3)
+	{
+		int a = builder->vertices[builder->indices[i]].position * 3;
+		int b = builder->vertices[builder->indices[i + 1]].position * 3;
+		int c = builder->vertices[builder->indices[i + 2]].position * 3;
+		float e1[3] = { p[b] - p[a], p[b + 1] - p[a + 1], p[b + 2] - p[a + 2] };
+		float e2[3] = { p[c] - p[a], p[c + 1] - p[a + 1], p[c + 2] - p[a + 2] };
+		float n[3] = {
+			e1[1] * e2[2] - e1[2] * e2[1],
+			e1[2] * e2[0] - e1[0] * e2[2],
+			e1[0] * e2[1] - e1[1] * e2[0]
+		};
+		for (int k = 0; k < 3; k++)
+		{
+			normals[a + k] += n[k];
+			normals[b + k] += n[k];
+			normals[c + k] += n[k];
+		}
+	}
+
+	mesh->vertices.resize(builder->vertices.size() * MESH_VERTEX_FLOATS);
+	float* out = mesh->vertices.data();
+	for (size_t i = 0; i < builder->vertices.size(); i++)
+	{
+		const MeshVertexKey& v = builder->vertices[i];
+		const float* n = v.hasNormal ? v.normal : &normals[v.position * 3];
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0) len = 1;
+
+		*out++ = v.s;
+		*out++ = v.t;
+		*out++ = n[0] / len;
+		*out++ = n[1] / len;
+		*out++ = n[2] / len;
+		*out++ = p[v.position * 3];
+		*out++ = p[v.position * 3 + 1];
+		*out++ = p[v.position * 3 + 2];
+	}
+	mesh->indices = builder->indices;
+	mesh->generatedACMR = meshACMR(mesh);
+	if (meshIndexOrder == MESH_ORDER_OPTIMISED) optimiseMeshOrder(mesh);
+	mesh->lightmapCoords.clear();
+	mesh->packed.clear();
+	if (meshVertexFormat == MESH_FORMAT_PACKED) packMesh(mesh);
+}
+
+void clearMeshBuilder(MeshBuilder* builder)
+{
+	builder->positions.clear();
+	builder->positionLookup.clear();
+	builder->vertices.clear();
+	builder->vertexLookup.clear();
+	builder->indices.clear();
+}
+
+void drawMesh(const Mesh* mesh)
+{
+	bool isPacked = !mesh->packed.empty();
+	if (isPacked)
+	{
+		const float* o = mesh->packOrigin;
+		float s = mesh->packScale;
+		float unpack[16] = { s, 0, 0, 0,  0, s, 0, 0,  0, 0, s, 0,  o[0], o[1], o[2], 1 };
+		const PackedVertex* v = mesh->packed.data();
+		glPushMatrix();
+		glMultMatrixf(unpack);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glTexCoordPointer(2, GL_HALF_FLOAT, sizeof(PackedVertex), v->texCoord);
+		glNormalPointer(GL_BYTE, sizeof(PackedVertex), v->normal);
+		glVertexPointer(3, GL_SHORT, sizeof(PackedVertex), v->position);
+		meshBytesDrawn += (long)(mesh->packed.size() * sizeof(PackedVertex));
+	}
+	else
+	{
+		glInterleavedArrays(GL_T2F_N3F_V3F, 0, mesh->vertices.data());
+		meshBytesDrawn += (long)(mesh->vertices.size() * sizeof(float));
+	}
+	meshFloatBytesDrawn += (long)(mesh->vertices.size() * sizeof(float));
+	long lightmapBytes = (long)(mesh->lightmapCoords.size() * sizeof(float));
+	meshBytesDrawn += lightmapBytes;
+	meshFloatBytesDrawn += lightmapBytes;
+
+	bool hasLightmap = !mesh->lightmapCoords.empty();
+	if (hasLightmap)
+	{
+		glClientActiveTexture(GL_TEXTURE1);
+		glTexCoordPointer(2, GL_FLOAT, 0, mesh->lightmapCoords.data());
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	glDrawElements(GL_TRIANGLES, (GLsizei)mesh->indices.size(), GL_UNSIGNED_INT, mesh->indices.data());
+	if (hasLightmap)
+	{
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glClientActiveTexture(GL_TEXTURE0);
+	}
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if (isPacked) glPopMatrix();
+}
+
+#endif
@@ -0,0 +1,338 @@
+//=====================================================================
+// MeshOrder.h
+// Reorders a triangle list for the GPU without changing what it draws.
+//  - Vertex cache: Forsyth's greedy ordering, which scores each vertex
+//    by its position in a modelled LRU cache and by how few triangles
+//    still use it, and always emits the best-scoring triangle next to
+//    the cache.
+//  - Overdraw: Sander, Nehab and Barczak's method from "Fast triangle
+//    reordering for vertex locality and reduced overdraw". The cache
+//    order is cut into clusters wherever a triangle misses on all three
+//    vertices, those are cut again as long as each piece stays within
+//    a threshold of the cluster's cache efficiency, and the pieces are
+//    drawn outward-facing first, so they tend to hide what follows.
+//    The mesh as a whole keeps within the same threshold.
+//  - Vertex fetch: vertices are renumbered in first-use order, so the
+//    vertex buffer is read front to back.
+// Efficiency is reported as ACMR, the average cache miss ratio: vertices
+// transformed per triangle against a FIFO cache of MESH_CACHE_SIZE
+// entries. It runs from 3 down to about 0.5 for a regular grid.
+//=====================================================================
+
+#if !defined(H_MESHORDER)
+#define H_MESHORDER
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+using namespace std;
+
+#define MESH_CACHE_SIZE 16				// FIFO entries ACMR and the overdraw clusters are measured against
+#define MESH_FORSYTH_CACHE_SIZE 32		// LRU entries the vertex scores model
+#define MESH_OVERDRAW_THRESHOLD 1.05f	// ACMR each overdraw cluster may give up, as a factor
+
+typedef struct {
+	vector<int> insertedAt;		// clock value when each vertex last entered the cache
+	int clock;					// advances once a miss
+	int size;
+} VertexCacheModel;
+
+void initialiseVertexCacheModel(VertexCacheModel* cache, int vertexCount, int size)
+{
+	cache->size = size;
+	cache->clock = 0;
+	cache->insertedAt.assign(vertexCount, -size - 1);
+}
+
+// Ages every entry out of the cache
+inline void flushVertexCacheModel(VertexCacheModel* cache)
+{
+	cache->clock += cache->size;
+}
+
+// Returns how many of the triangle's vertices missed
+inline int cacheTriangle(VertexCacheModel* cache, const unsigned int* triangle)
+{
+	int misses = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		int& inserted = cache->insertedAt[triangle[k]];
+		if (cache->clock - inserted <= cache->size) continue;
+		inserted = cache->clock++;
+		misses++;
+	}
+	return misses;
+}
+
+float measureACMR(const unsigned int* indices, size_t indexCount, int vertexCount)
+{
+	if (indexCount < 3) return 0;
+	VertexCacheModel cache;
+	initialiseVertexCacheModel(&cache, vertexCount, MESH_CACHE_SIZE);
+	int misses = 0;
+	for (size_t i = 0; i + 2 < indexCount; i += 3) misses += cacheTriangle(&cache, indices + i);
+	return misses / (float)(indexCount / 3);
+}
+
+//-- Vertex cache ---------------------------------------------------------
+
+// Forsyth's published weights: the last triangle's vertices score a flat
+// 0.75 so the next triangle does not simply reuse them in a strip, and
+// vertices with few triangles left are boosted so they are finished off
+// rather than left stranded
+inline float forsythVertexScore(int cachePosition, int remaining)
+{
+	if (remaining == 0) return -1;
+	float score = 0;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3) score = 0.75f;
+			else score = powf(1 - (cachePosition - 3) / (float)(MESH_FORSYTH_CACHE_SIZE - 3), 1.5f);
+	}
+	return score + 2 / sqrtf((float)remaining);
+}
+
+void optimiseVertexCache(unsigned int* indices, size_t indexCount, int vertexCount)
+{
+	int triangleCount = (int)(indexCount / 3);
+	if (triangleCount == 0) return;
+
+	// Each vertex's triangles not yet emitted, kept at the front of its
+	// slice of 'adjacency'
+	vector<int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+	for (int i = 0; i < triangleCount * 3; i++) remaining[indices[i]]++;
+	for (int v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+	vector<int> adjacency(triangleCount * 3), filled(offsets.begin(), offsets.end() - 1);
+	for (int i = 0; i < triangleCount * 3; i++) adjacency[filled[indices[i]]++] = i / 3;
+
+	vector<int> cachePosition(vertexCount, -1);
+	vector<float> score(vertexCount);
+	for (int v = 0; v < vertexCount; v++) score[v] = forsythVertexScore(-1, remaining[v]);
+
+	auto triangleScore = [&](int t)
+	{
+		return score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+	};
+
+	int best = 0;
+	for (int t = 1; t < triangleCount; t++)
+	{
+		if (triangleScore(t) > triangleScore(best)) best = t;
+	}
+
+	vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	vector<char> emitted(triangleCount, 0);
+	int cache[MESH_FORSYTH_CACHE_SIZE + 3], cacheCount = 0;
+	int next = 0;		// no triangle before this is left, for when the cache runs dry
+	while ((int)output.size() < triangleCount * 3)
+	{
+		if (best < 0)
+		{
+			while (emitted[next]) next++;
+			best = next;
+		}
+		emitted[best] = 1;
+		const unsigned int* triangle = indices + best * 3;
+		output.insert(output.end(), triangle, triangle + 3);
+
+		// The triangle's vertices go to the front of the cache
+		int updated[MESH_FORSYTH_CACHE_SIZE + 3], updatedCount = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			int v = triangle[k];
+			int* first = &adjacency[offsets[v]];
+			int* last = first + remaining[v] - 1;
+			*find(first, last, best) = *last;
+			remaining[v]--;
+			if (find(updated, updated + updatedCount, v) == updated + updatedCount) updated[updatedCount++] = v;
+		}
+		int fresh = updatedCount;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			if (find(updated, updated + fresh, cache[i]) == updated + fresh) updated[updatedCount++] = cache[i];
+		}
+
+		// Rescore everything that moved, including what fell out
+		for (int i = 0; i < updatedCount; i++)
+		{
+			int v = updated[i];
+			cachePosition[v] = i < MESH_FORSYTH_CACHE_SIZE ? i : -1;
+			score[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+		}
+		cacheCount = min(updatedCount, MESH_FORSYTH_CACHE_SIZE);
+		for (int i = 0; i < cacheCount; i++) cache[i] = updated[i];
+
+		best = -1;
+		float bestScore = -INFINITY;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			int v = cache[i];
+			for (int j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+			{
+				float s = triangleScore(adjacency[j]);
+				if (s > bestScore)
+				{
+					bestScore = s;
+					best = adjacency[j];
+				}
+			}
+		}
+	}
+	copy(output.begin(), output.end(), indices);
+}
+
+//-- Overdraw -------------------------------------------------------------
+
+// Triangle indices where the clusters start, plus triangleCount. Hard
+// boundaries are where the cache order starts over; each hard cluster is
+// then cut wherever the piece so far, starting from an empty cache, is
+// within 'threshold' of the whole cluster's ACMR. A threshold of 0 keeps
+// the hard clusters whole.
+void findOverdrawClusters(const unsigned int* indices, int triangleCount, int vertexCount, float threshold, vector<int>* clusters)
+{
+	VertexCacheModel cache;
+	initialiseVertexCacheModel(&cache, vertexCount, MESH_CACHE_SIZE);
+	vector<int> hard;
+	for (int t = 0; t < triangleCount; t++)
+	{
+		int misses = cacheTriangle(&cache, indices + t * 3);
+		if (t == 0 || misses == 3) hard.push_back(t);
+	}
+	hard.push_back(triangleCount);
+
+	clusters->clear();
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		int begin = hard[h], end = hard[h + 1];
+		flushVertexCacheModel(&cache);
+		int misses = 0;
+		for (int t = begin; t < end; t++) misses += cacheTriangle(&cache, indices + t * 3);
+		float limit = threshold * misses / (end - begin);
+
+		flushVertexCacheModel(&cache);
+		int pieceMisses = 0, pieceStart = begin;
+		clusters->push_back(begin);
+		for (int t = begin; t < end - 1; t++)
+		{
+			pieceMisses += cacheTriangle(&cache, indices + t * 3);
+			if (pieceMisses <= limit * (t + 1 - pieceStart))
+			{
+				clusters->push_back(t + 1);
+				flushVertexCacheModel(&cache);
+				pieceMisses = 0;
+				pieceStart = t + 1;
+			}
+		}
+	}
+	clusters->push_back(triangleCount);
+}
+
+// Writes the clusters to 'output' with those far out along their own
+// normal from the mesh's centre first; centres and normals are area
+// weighted
+void sortOverdrawClusters(const unsigned int* indices, const float* positions, int stride, const vector<int>& clusters,
+	vector<unsigned int>* output)
+{
+	int clusterCount = (int)clusters.size() - 1;
+	vector<float> centroids(clusterCount * 3, 0), normals(clusterCount * 3, 0);
+	float meshCentroid[3] = { 0, 0, 0 }, meshArea = 0;
+	for (int c = 0; c < clusterCount; c++)
+	{
+		float area = 0;
+		for (int t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const float* a = positions + indices[t * 3] * stride;
+			const float* b = positions + indices[t * 3 + 1] * stride;
+			const float* d = positions + indices[t * 3 + 2] * stride;
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			float w = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int k = 0; k < 3; k++)
+			{
+				centroids[c * 3 + k] += w * (a[k] + b[k] + d[k]) / 3;
+				normals[c * 3 + k] += n[k];
+			}
+			area += w;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			meshCentroid[k] += centroids[c * 3 + k];
+			if (area > 0) centroids[c * 3 + k] /= area;
+		}
+		meshArea += area;
+	}
+	if (meshArea > 0) for (int k = 0; k < 3; k++) meshCentroid[k] /= meshArea;
+
+	vector<float> key(clusterCount);
+	vector<int> order(clusterCount);
+	for (int c = 0; c < clusterCount; c++)
+	{
+		const float* n = &normals[c * 3];
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float d = 0;
+		for (int k = 0; k < 3; k++) d += (centroids[c * 3 + k] - meshCentroid[k]) * n[k];
+		key[c] = length > 0 ? d / length : 0;
+		order[c] = c;
+	}
+	stable_sort(order.begin(), order.end(), [&](int a, int b) { return key[a] > key[b]; });
+
+	output->clear();
+	for (int c = 0; c < clusterCount; c++)
+	{
+		output->insert(output->end(), indices + clusters[order[c]] * 3, indices + clusters[order[c] + 1] * 3);
+	}
+}
+
+// Reorders cache-ordered triangles to draw front-most clusters first,
+// giving up at most 'threshold' of the mesh's ACMR. Small clusters sort
+// most freely but lose the vertices they shared, so if they cost too
+// much the hard clusters are tried alone, and failing that the order is
+// left as it is. 'positions' holds each vertex's xyz, 'stride' floats
+// apart.
+void optimiseOverdraw(unsigned int* indices, size_t indexCount, const float* positions, int stride, int vertexCount, float threshold)
+{
+	int triangleCount = (int)(indexCount / 3);
+	if (triangleCount < 2) return;
+
+	float limit = measureACMR(indices, indexCount, vertexCount) * threshold;
+	vector<int> clusters;
+	vector<unsigned int> output;
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		findOverdrawClusters(indices, triangleCount, vertexCount, attempt == 0 ? threshold : 0, &clusters);
+		if (clusters.size() <= 2) return;
+		sortOverdrawClusters(indices, positions, stride, clusters, &output);
+		if (measureACMR(output.data(), output.size(), vertexCount) > limit) continue;
+		copy(output.begin(), output.end(), indices);
+		return;
+	}
+}
+
+//-- Vertex fetch ---------------------------------------------------------
+
+// Renumbers the vertices in the order the indices first use them.
+// Fills 'order' with the old index of each new vertex; vertices no
+// triangle uses are left out.
+void optimiseVertexFetch(unsigned int* indices, size_t indexCount, int vertexCount, vector<int>* order)
+{
+	vector<int> remap(vertexCount, -1);
+	order->clear();
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		int& v = remap[indices[i]];
+		if (v < 0)
+		{
+			v = (int)order->size();
+			order->push_back(indices[i]);
+		}
+		indices[i] = v;
+	}
+}
+
+#endif
@@ -0,0 +1,170 @@
+//=====================================================================
+// Metatravellers.h
+// Data-oriented animation for the metatraveller exhibit.
+// Each traveller orbits a small ring; the ring's placement is a fixed
+// base transform and only the orbit phase changes per frame. Phases
+// and bases are stored structure-of-arrays, and final instance
+// matrices (column-major, ready for glMultMatrixf) are produced four
+// travellers at a time with the vecmath f4 type and split across
+// threads for large counts.
+//=====================================================================
+
+#if !defined(H_METATRAVELLERS)
+#define H_METATRAVELLERS
+
+#include <iostream>
+#include <chrono>
+#include "vecmath.h"
+#include "parallel.h"
+using namespace std;
+
+#define TRAVELLER_LANES 4
+#define TRAVELLER_PARALLEL_THRESHOLD 16384
+
+typedef struct {
+	int count;
+	int capacity;		// count rounded up to a multiple of TRAVELLER_LANES
+	float speed;		// radians per second
+	float orbitRadius;	// distance of the traveller from its ring's centre
+	float* phases;		// radians, kept in [-pi, pi)
+	float* base[12];	// upper 3x4 of each ring transform, base[column * 3 + row][traveller]
+	float* instances;	// 16 floats per traveller, column-major
+} TravellerBatch;
+
+// Places 'count' rings evenly around a circle of 'radius', each ring
+// facing along the circle, with phases spread over 'spirals' turns.
+void initialiseTravellerBatch(TravellerBatch* batch, int count, float radius, float orbitRadius, int spirals, float speed)
+{
+	batch->count = count;
+	batch->capacity = ((count + TRAVELLER_LANES - 1) / TRAVELLER_LANES) * TRAVELLER_LANES;
+	batch->speed = speed;
+	batch->orbitRadius = orbitRadius;
+	batch->phases = new float[batch->capacity]();
+	for (int i = 0; i < 12; i++)
+	{
+		batch->base[i] = new float[batch->capacity]();
+	}
+	batch->instances = new float[batch->capacity * 16]();
+
+	for (int i = 0; i < count; i++)
+	{
+		// Base = RotateY(ringAngle) * Translate(0, 0, radius)
+		float s, c;
+		sinCos((TWO_PI * i) / count, &s, &c);
+		float columns[12] = {
+			c, 0, -s,
+			0, 1, 0,
+			s, 0, c,
+			s * radius, 0, c * radius
+		};
+		for (int j = 0; j < 12; j++)
+		{
+			batch->base[j][i] = columns[j];
+		}
+
+		float phase = fmodf((TWO_PI * spirals * i) / count, TWO_PI);
+		batch->phases[i] = phase >= PI ? phase - TWO_PI : phase;
+	}
+}
+
+void freeTravellerBatch(TravellerBatch* batch)
+{
+	delete[] batch->phases;
+	for (int i = 0; i < 12; i++)
+	{
+		delete[] batch->base[i];
+	}
+	delete[] batch->instances;
+	batch->count = 0;
+	batch->capacity = 0;
+}
+
+// Advances phases and writes instance matrices for travellers
+// [begin, end). Both must be multiples of TRAVELLER_LANES.
+//   instance = base * RotateX(phase) * Translate(0, 0, orbitRadius)
+void updateTravellerRange(TravellerBatch* batch, int begin, int end, float elapsed)
+{
+	const f4 step = f4Splat(batch->speed * elapsed);
+	const f4 r = f4Splat(batch->orbitRadius);
+	const f4 pi = f4Splat(PI);
+	const f4 twoPi = f4Splat(TWO_PI);
+	const f4 one = f4Splat(1);
+	const f4 zero = f4Splat(0);
+
+	for (int t = begin; t < end; t += TRAVELLER_LANES)
+	{
+		// Advance and wrap the phase back into [-pi, pi)
+		f4 phase = f4Add(f4Load(batch->phases + t), step);
+		phase = f4Sub(phase, f4And(f4GreaterEqual(phase, pi), twoPi));
+		f4Store(batch->phases + t, phase);
+
+		f4 s, c;
+		sinCos(phase, &s, &c);
+
+		f4 b[12];
+		for (int i = 0; i < 12; i++)
+		{
+			b[i] = f4Load(batch->base[i] + t);
+		}
+
+		// Columns of the instance matrix, one traveller per lane
+		f4 m[16];
+		m[0] = b[0]; m[1] = b[1]; m[2] = b[2]; m[3] = zero;
+		for (int row = 0; row < 3; row++)
+		{
+			m[4 + row] = f4Add(f4Mul(c, b[3 + row]), f4Mul(s, b[6 + row]));
+			m[8 + row] = f4Sub(f4Mul(c, b[6 + row]), f4Mul(s, b[3 + row]));
+			m[12 + row] = f4Madd(r, m[8 + row], b[9 + row]);
+		}
+		m[7] = zero; m[11] = zero; m[15] = one;
+
+		// Transpose each column block from lanes to per-traveller matrices
+		float* out = batch->instances + t * 16;
+		for (int col = 0; col < 4; col++)
+		{
+			f4 r0 = m[col * 4], r1 = m[col * 4 + 1], r2 = m[col * 4 + 2], r3 = m[col * 4 + 3];
+			f4Transpose(r0, r1, r2, r3);
+			f4Store(out + col * 4, r0);
+			f4Store(out + 16 + col * 4, r1);
+			f4Store(out + 32 + col * 4, r2);
+			f4Store(out + 48 + col * 4, r3);
+		}
+	}
+}
+
+void advanceTravellers(TravellerBatch* batch, float elapsed)
+{
+	if (batch->capacity < TRAVELLER_PARALLEL_THRESHOLD)
+	{
+		updateTravellerRange(batch, 0, batch->capacity, elapsed);
+		return;
+	}
+	parallelFor(batch->capacity, TRAVELLER_PARALLEL_THRESHOLD / 4, TRAVELLER_LANES,
+		[batch, elapsed](int begin, int end) { updateTravellerRange(batch, begin, end, elapsed); });
+}
+
+// Times the animation update for 'count' travellers and reports whether
+// it fits in a 60 Hz frame.
+void benchmarkTravellers(int count, float radius, float orbitRadius, int spirals, float speed)
+{
+	TravellerBatch batch;
+	initialiseTravellerBatch(&batch, count, radius, orbitRadius, spirals, speed);
+	advanceTravellers(&batch, 0);
+
+	const int frames = 120;
+	auto start = chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++)
+	{
+		advanceTravellers(&batch, 1 / 60.0f);
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	double perFrame = 1000 * seconds / frames;
+
+	cout << "travellers: " << count << ", threads: " << workerCount() << endl;
+	cout << "update: " << perFrame << " ms/frame (" << (count * frames) / seconds << " travellers/s)" << endl;
+	cout << "60 Hz budget: " << (perFrame <= 1000 / 60.0 ? "met" : "missed") << endl;
+
+	freeTravellerBatch(&batch);
+}
+
+#endif
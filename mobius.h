@@ -0,0 +1,89 @@
+//=====================================================================
+// Mobius.h
+// Resolution-parametric Mobius strip generator.
+// The strip is the surface
+//     P(u, v) = ( sin(u) (R + v sin(u/2)),
+//                 v cos(u/2),
+//                 cos(u) (R + v sin(u/2)) ),   u in [0, 2pi], v in [-w, w]
+// and normals come from the analytic partial derivatives Pu x Pv.
+// Geometry is emitted once through the mesh builder and only rebuilt
+// when the parameters change.
+//=====================================================================
+
+#if !defined(H_MOBIUS)
+#define H_MOBIUS
+
+#include "vecmath.h"
+#include "mesh.h"
+using namespace std;
+
+typedef struct {
+	float radius;		// distance from the centre to the middle of the strip
+	float halfWidth;
+	int segments;		// subdivisions around the loop
+	int rows;			// subdivisions across the width
+} MobiusParams;
+
+typedef struct {
+	MobiusParams params;	// parameters the mesh was built with
+	bool valid;
+	Mesh mesh;
+} MobiusStrip;
+
+bool sameMobiusParams(const MobiusParams& a, const MobiusParams& b)
+{
+	return a.radius == b.radius && a.halfWidth == b.halfWidth
+		&& a.segments == b.segments && a.rows == b.rows;
+}
+
+// Builds the strip's buffers unless they are already up to date.
+// Returns true if the geometry was regenerated.
+bool generateMobiusStrip(MobiusStrip* strip, MobiusParams params)
+{
+	if (strip->valid && sameMobiusParams(strip->params, params)) return false;
+
+	int columns = params.segments + 1;
+	int rows = params.rows + 1;
+	float R = params.radius;
+
+	// Vertices on the seam (u = 2pi) coincide with the start of the strip
+	// but carry the opposite normal, so the builder keeps them separate
+	MeshBuilder builder;
+	vector<int> grid(columns * rows);
+	for (int r = 0; r < rows; r++)
+	{
+		float v = -params.halfWidth + (2 * params.halfWidth * r) / params.rows;
+		for (int c = 0; c < columns; c++)
+		{
+			float su, cu, st, ct;
+			sinCos((TWO_PI * c) / params.segments, &su, &cu);
+			sinCos((PI * c) / params.segments, &st, &ct);
+			float w = R + v * st;
+
+			// Partial derivatives with respect to u and v
+			Vec3 pu = vec3(cu * w + su * v * ct * 0.5f, -v * st * 0.5f, -su * w + cu * v * ct * 0.5f);
+			Vec3 pv = vec3(su * st, ct, cu * st);
+			Vec3 n = normalize(cross(pu, pv));
+
+			grid[r * columns + c] = addMeshVertex(&builder, su * w, v * ct, cu * w,
+				n.x, n.y, n.z, (float)c / params.segments, (float)r / params.rows);
+		}
+	}
+
+	for (int r = 0; r < params.rows; r++)
+	{
+		for (int c = 0; c < params.segments; c++)
+		{
+			int lower = r * columns + c;
+			int upper = lower + columns;
+			addMeshQuad(&builder, grid[upper], grid[lower], grid[lower + 1], grid[upper + 1]);
+		}
+	}
+	buildMesh(&builder, &strip->mesh);
+
+	strip->params = params;
+	strip->valid = true;
+	return true;
+}
+
+#endif
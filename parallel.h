@@ -0,0 +1,54 @@
+//=====================================================================
+// Parallel.h
+// Splits a range of work items across the available hardware threads.
+// The calling thread always takes the last chunk, so small ranges run
+// without starting any threads at all.
+//=====================================================================
+
+#if !defined(H_PARALLEL)
+#define H_PARALLEL
+
+#include <thread>
+#include <vector>
+using namespace std;
+
+int workerCount()
+{
+	int count = (int)thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+// Calls fn(begin, end) for consecutive chunks of [0, count). Chunk
+// boundaries are multiples of 'align' and no chunk is smaller than
+// 'minPerThread' items, except possibly the last.
+template <typename Fn>
+void parallelFor(int count, int minPerThread, int align, Fn fn)
+{
+	int threads = workerCount();
+	if (minPerThread < 1) minPerThread = 1;
+	if (threads > count / minPerThread) threads = count / minPerThread;
+	if (threads <= 1)
+	{
+		fn(0, count);
+		return;
+	}
+
+	int chunk = (count + threads - 1) / threads;
+	chunk = ((chunk + align - 1) / align) * align;
+
+	vector<thread> workers;
+	int begin = 0;
+	while (begin + chunk < count)
+	{
+		workers.push_back(thread(fn, begin, begin + chunk));
+		begin += chunk;
+	}
+	fn(begin, count);
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+#endif
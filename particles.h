@@ -0,0 +1,343 @@
+//=====================================================================
+// Particles.h
+// Pooled particle system.
+// A pool holds a fixed number of particles structure-of-arrays, with
+// the live ones packed at the front; nothing is allocated after the
+// pool is created. Emitters add particles at a rate or in bursts, and
+// new particles are dropped while the pool is full. Particles move
+// under the pool's gravity and drag, four at a time with the vecmath
+// f4 type (split across threads for large pools), and die when their
+// age reaches their life; dead particles are replaced by the last live
+// one. Vertices for a single point sprite draw are written separately,
+// so they can go straight into a published frame: colour (tint and
+// fading alpha) and position, 8 floats per particle, optionally sorted
+// back to front from an eye position for alpha blending.
+//=====================================================================
+
+#if !defined(H_PARTICLES)
+#define H_PARTICLES
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include "vecmath.h"
+#include "parallel.h"
+using namespace std;
+
+#define PARTICLE_LANES 4
+#define PARTICLE_PARALLEL_THRESHOLD 65536
+#define PARTICLE_VERTEX_FLOATS 8	// r, g, b, a, x, y, z, unused
+
+typedef struct {
+	int count;					// live particles, at the front
+	int capacity;				// a multiple of PARTICLE_LANES
+	float* position[3];			// [axis][particle]
+	float* velocity[3];
+	float* age;					// seconds
+	float* inverseLife;			// 1 / life in seconds, so the update never divides
+	int* order;					// depth sorting scratch
+	int* orderSwap;
+	unsigned int* keys;
+	unsigned int* keySwap;
+	Vec3 gravity;				// acceleration, in units per second squared
+	float drag;					// fraction of velocity lost per second
+	float tint[3];
+	unsigned int random;		// xorshift state
+	long dropped;				// particles not emitted because the pool was full
+} ParticlePool;
+
+typedef struct {
+	Vec3 position;
+	Vec3 extent;				// particles start anywhere in position +- extent
+	Vec3 velocity;
+	float spread;				// random speed added along each axis, +- spread
+	float rate;					// particles per second, for emitParticles
+	float life;					// seconds, +- lifeSpread
+	float lifeSpread;
+	float carry;				// fraction of a particle owed from the last step
+} ParticleEmitter;
+
+typedef struct {
+	vector<float> data;			// PARTICLE_VERTEX_FLOATS per particle, padded to PARTICLE_LANES
+	int count;
+} ParticleVertices;
+
+void initialiseParticlePool(ParticlePool* pool, int capacity, Vec3 gravity, float drag, float r, float g, float b)
+{
+	pool->count = 0;
+	pool->capacity = ((capacity + PARTICLE_LANES - 1) / PARTICLE_LANES) * PARTICLE_LANES;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		pool->position[axis] = new float[pool->capacity]();
+		pool->velocity[axis] = new float[pool->capacity]();
+	}
+	pool->age = new float[pool->capacity]();
+	pool->inverseLife = new float[pool->capacity]();
+	pool->order = new int[pool->capacity];
+	pool->orderSwap = new int[pool->capacity];
+	pool->keys = new unsigned int[pool->capacity];
+	pool->keySwap = new unsigned int[pool->capacity];
+	pool->gravity = gravity;
+	pool->drag = drag;
+	pool->tint[0] = r;
+	pool->tint[1] = g;
+	pool->tint[2] = b;
+	pool->random = 2463534242u;
+	pool->dropped = 0;
+}
+
+void freeParticlePool(ParticlePool* pool)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		delete[] pool->position[axis];
+		delete[] pool->velocity[axis];
+	}
+	delete[] pool->age;
+	delete[] pool->inverseLife;
+	delete[] pool->order;
+	delete[] pool->orderSwap;
+	delete[] pool->keys;
+	delete[] pool->keySwap;
+	pool->count = 0;
+	pool->capacity = 0;
+}
+
+// Uniform in [-1, 1]
+inline float randomSigned(ParticlePool* pool)
+{
+	unsigned int x = pool->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pool->random = x;
+	return (x >> 8) * (2.0f / 16777215.0f) - 1;
+}
+
+// Adds up to 'count' particles from the emitter
+void spawnParticles(ParticlePool* pool, const ParticleEmitter* emitter, int count)
+{
+	int room = min(count, pool->capacity - pool->count);
+	pool->dropped += count - room;
+	float start[3] = { emitter->position.x, emitter->position.y, emitter->position.z };
+	float extent[3] = { emitter->extent.x, emitter->extent.y, emitter->extent.z };
+	float velocity[3] = { emitter->velocity.x, emitter->velocity.y, emitter->velocity.z };
+	for (int i = pool->count; i < pool->count + room; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			pool->position[axis][i] = start[axis] + extent[axis] * randomSigned(pool);
+			pool->velocity[axis][i] = velocity[axis] + emitter->spread * randomSigned(pool);
+		}
+		pool->age[i] = 0;
+		pool->inverseLife[i] = 1 / max(0.01f, emitter->life + emitter->lifeSpread * randomSigned(pool));
+	}
+	pool->count += room;
+}
+
+// Adds the emitter's particles for 'elapsed' seconds at its rate
+void emitParticles(ParticlePool* pool, ParticleEmitter* emitter, float elapsed)
+{
+	float due = emitter->rate * elapsed + emitter->carry;
+	int count = (int)due;
+	emitter->carry = due - count;
+	spawnParticles(pool, emitter, count);
+}
+
+// Moves particles [begin, end) on by 'elapsed' seconds. Both must be
+// multiples of PARTICLE_LANES; lanes past the live count are updated
+// harmlessly.
+void updateParticleRange(ParticlePool* pool, int begin, int end, float elapsed)
+{
+	const f4 dt = f4Splat(elapsed);
+	const f4 damping = f4Splat(max(0.0f, 1 - pool->drag * elapsed));
+	const f4 dv[3] = { f4Splat(pool->gravity.x * elapsed), f4Splat(pool->gravity.y * elapsed), f4Splat(pool->gravity.z * elapsed) };
+
+	for (int p = begin; p < end; p += PARTICLE_LANES)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			f4 v = f4Madd(f4Load(pool->velocity[axis] + p), damping, dv[axis]);
+			f4Store(pool->velocity[axis] + p, v);
+			f4Store(pool->position[axis] + p, f4Madd(v, dt, f4Load(pool->position[axis] + p)));
+		}
+		f4Store(pool->age + p, f4Add(f4Load(pool->age + p), dt));
+	}
+}
+
+// Replaces each dead particle with the last live one
+void removeDeadParticles(ParticlePool* pool)
+{
+	int i = 0;
+	while (i < pool->count)
+	{
+		if (pool->age[i] * pool->inverseLife[i] < 1)
+		{
+			i++;
+			continue;
+		}
+		int last = --pool->count;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			pool->position[axis][i] = pool->position[axis][last];
+			pool->velocity[axis][i] = pool->velocity[axis][last];
+		}
+		pool->age[i] = pool->age[last];
+		pool->inverseLife[i] = pool->inverseLife[last];
+	}
+}
+
+// Writes vertices for particles [begin, end), multiples of
+// PARTICLE_LANES, in pool order. Alpha fades from 1 at birth to 0 at
+// death.
+void writeParticleRange(const ParticlePool* pool, float* vertices, int begin, int end)
+{
+	const f4 one = f4Splat(1);
+	const f4 zero = f4Splat(0);
+	const f4 r = f4Splat(pool->tint[0]), g = f4Splat(pool->tint[1]), b = f4Splat(pool->tint[2]);
+
+	for (int p = begin; p < end; p += PARTICLE_LANES)
+	{
+		f4 alpha = f4Sub(one, f4Mul(f4Load(pool->age + p), f4Load(pool->inverseLife + p)));
+		alpha = f4Select(f4Greater(alpha, zero), alpha, zero);
+
+		// One particle per lane in, one per block of 8 floats out
+		f4 c0 = r, c1 = g, c2 = b, c3 = alpha;
+		f4 p0 = f4Load(pool->position[0] + p), p1 = f4Load(pool->position[1] + p), p2 = f4Load(pool->position[2] + p), p3 = zero;
+		f4Transpose(c0, c1, c2, c3);
+		f4Transpose(p0, p1, p2, p3);
+		float* out = vertices + p * PARTICLE_VERTEX_FLOATS;
+		f4Store(out, c0); f4Store(out + 4, p0);
+		f4Store(out + 8, c1); f4Store(out + 12, p1);
+		f4Store(out + 16, c2); f4Store(out + 20, p2);
+		f4Store(out + 24, c3); f4Store(out + 28, p3);
+	}
+}
+
+// Sorts pool->order by pool->keys, ascending, with three 11-bit radix
+// passes
+void radixSortParticles(ParticlePool* pool)
+{
+	int count = pool->count;
+	for (int shift = 0; shift < 32; shift += 11)
+	{
+		int offsets[2048] = { 0 };
+		for (int i = 0; i < count; i++) offsets[(pool->keys[i] >> shift) & 2047]++;
+		int total = 0;
+		for (int d = 0; d < 2048; d++)
+		{
+			int n = offsets[d];
+			offsets[d] = total;
+			total += n;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			int to = offsets[(pool->keys[i] >> shift) & 2047]++;
+			pool->keySwap[to] = pool->keys[i];
+			pool->orderSwap[to] = pool->order[i];
+		}
+		swap(pool->keys, pool->keySwap);
+		swap(pool->order, pool->orderSwap);
+	}
+}
+
+// Writes vertices farthest from 'eye' first. Squared distances are
+// non-negative, so their float bits sort in the same order; the bits
+// are inverted to put the farthest first.
+void writeSortedParticles(ParticlePool* pool, float* vertices, Vec3 eye)
+{
+	for (int i = 0; i < pool->count; i++)
+	{
+		float dx = pool->position[0][i] - eye.x, dy = pool->position[1][i] - eye.y, dz = pool->position[2][i] - eye.z;
+		float distance = dx * dx + dy * dy + dz * dz;
+		unsigned int bits;
+		memcpy(&bits, &distance, 4);
+		pool->keys[i] = ~bits;
+		pool->order[i] = i;
+	}
+	radixSortParticles(pool);
+
+	for (int i = 0; i < pool->count; i++)
+	{
+		int p = pool->order[i];
+		float* out = vertices + i * PARTICLE_VERTEX_FLOATS;
+		out[0] = pool->tint[0];
+		out[1] = pool->tint[1];
+		out[2] = pool->tint[2];
+		out[3] = max(0.0f, 1 - pool->age[p] * pool->inverseLife[p]);
+		out[4] = pool->position[0][p];
+		out[5] = pool->position[1][p];
+		out[6] = pool->position[2][p];
+		out[7] = 0;
+	}
+}
+
+// Steps every live particle and removes the dead
+void advanceParticles(ParticlePool* pool, float elapsed)
+{
+	int lanes = ((pool->count + PARTICLE_LANES - 1) / PARTICLE_LANES) * PARTICLE_LANES;
+	if (lanes < PARTICLE_PARALLEL_THRESHOLD) updateParticleRange(pool, 0, lanes, elapsed);
+		else parallelFor(lanes, PARTICLE_PARALLEL_THRESHOLD / 4, PARTICLE_LANES,
+			[pool, elapsed](int begin, int end) { updateParticleRange(pool, begin, end, elapsed); });
+	removeDeadParticles(pool);
+}
+
+// Writes the live particles' vertices, sorted from 'eye' when it is
+// given. The storage is sized for the whole pool on first use, so it
+// never grows again.
+void writeParticleVertices(ParticlePool* pool, ParticleVertices* vertices, const Vec3* eye = 0)
+{
+	size_t size = (size_t)pool->capacity * PARTICLE_VERTEX_FLOATS;
+	if (vertices->data.size() < size) vertices->data.resize(size);
+	vertices->count = pool->count;
+	float* out = vertices->data.data();
+	if (eye)
+	{
+		writeSortedParticles(pool, out, *eye);
+		return;
+	}
+	int lanes = ((pool->count + PARTICLE_LANES - 1) / PARTICLE_LANES) * PARTICLE_LANES;
+	if (lanes < PARTICLE_PARALLEL_THRESHOLD) writeParticleRange(pool, out, 0, lanes);
+		else parallelFor(lanes, PARTICLE_PARALLEL_THRESHOLD / 4, PARTICLE_LANES,
+			[pool, out](int begin, int end) { writeParticleRange(pool, out, begin, end); });
+}
+
+// Keeps 'count' particles alive with lives of 1 to 3 seconds and times
+// the update and vertex writing, unsorted and depth sorted. Reports
+// whether a frame's work fits in a 60 Hz frame.
+void benchmarkParticles(int count)
+{
+	ParticlePool pool;
+	initialiseParticlePool(&pool, count, vec3(0, -98, 0), 0.5f, 1, 0.7f, 0.3f);
+	ParticleEmitter emitter = { vec3(0, 50, 0), vec3(50, 50, 50), vec3(0, 20, 0), 30, 0, 2, 1, 0 };
+	spawnParticles(&pool, &emitter, count);
+	ParticleVertices vertices;
+
+	const int frames = 60;
+	const float step = 1 / 60.0f;
+	Vec3 eye = vec3(0, 50, -300);
+	for (int sorted = 0; sorted < 2; sorted++)
+	{
+		double updateMs = 0;
+		long live = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			spawnParticles(&pool, &emitter, pool.capacity - pool.count);
+			auto start = chrono::steady_clock::now();
+			advanceParticles(&pool, step);
+			writeParticleVertices(&pool, &vertices, sorted ? &eye : 0);
+			updateMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			live += pool.count;
+		}
+		double perFrame = updateMs / frames;
+		cout << "particles: " << live / frames << " live average, " << (sorted ? "sorted" : "unsorted")
+			<< ", threads: " << workerCount() << endl;
+		cout << "update: " << perFrame << " ms/frame (" << live / (updateMs / 1000) << " particles/s), 60 Hz budget: "
+			<< (perFrame <= 1000 / 60.0 ? "met" : "missed") << endl;
+	}
+	freeParticlePool(&pool);
+}
+
+#endif
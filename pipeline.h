@@ -0,0 +1,124 @@
+//=====================================================================
+// Pipeline.h
+// Bounded producer/consumer ring of frame slots.
+// The simulation thread writes the next frame into a free slot while
+// the render thread draws the oldest published one, so frame N + 1 is
+// simulated while frame N renders. The depth is the number of frames in
+// flight, including the one being rendered: 1 runs simulation and
+// rendering in lockstep, and the simulation blocks when it is 'depth'
+// frames ahead. Slot storage belongs to the caller; the pipeline only
+// hands out indices. Latency is measured from the moment a frame's
+// input was sampled to the moment its slot is released after display.
+//=====================================================================
+
+#if !defined(H_PIPELINE)
+#define H_PIPELINE
+
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+using namespace std;
+
+typedef chrono::steady_clock::time_point FrameTime;
+
+typedef struct {
+	int depth;
+	int first;						// oldest published slot, rendering or waiting
+	int used;						// published slots not yet released
+	bool running;
+	mutex lock;
+	condition_variable changed;
+	vector<FrameTime> sampled;		// per slot, when its input was read
+
+	// Latency over the current reporting window
+	int latencyFrames;
+	double latencySum;				// ms
+	double latencyMax;
+} FramePipeline;
+
+void initialiseFramePipeline(FramePipeline* pipeline, int depth)
+{
+	if (depth < 1) depth = 1;
+	pipeline->depth = depth;
+	pipeline->first = 0;
+	pipeline->used = 0;
+	pipeline->running = true;
+	pipeline->sampled.assign(depth, FrameTime());
+	pipeline->latencyFrames = 0;
+	pipeline->latencySum = 0;
+	pipeline->latencyMax = 0;
+}
+
+// Wakes both sides; any blocked call returns -1
+void stopFramePipeline(FramePipeline* pipeline)
+{
+	{
+		lock_guard<mutex> guard(pipeline->lock);
+		pipeline->running = false;
+	}
+	pipeline->changed.notify_all();
+}
+
+// Blocks until a slot is free and returns it for writing. Only one
+// thread may write frames.
+int beginFrameWrite(FramePipeline* pipeline)
+{
+	unique_lock<mutex> guard(pipeline->lock);
+	pipeline->changed.wait(guard, [pipeline] { return pipeline->used < pipeline->depth || !pipeline->running; });
+	if (!pipeline->running) return -1;
+	return (pipeline->first + pipeline->used) % pipeline->depth;
+}
+
+// Makes the slot from beginFrameWrite visible to the renderer
+void publishFrame(FramePipeline* pipeline, int slot, FrameTime sampled)
+{
+	{
+		lock_guard<mutex> guard(pipeline->lock);
+		pipeline->sampled[slot] = sampled;
+		pipeline->used++;
+	}
+	pipeline->changed.notify_all();
+}
+
+// Blocks until a frame is published and returns the oldest one. The
+// slot stays untouched by the writer until releaseFrame.
+int acquireFrame(FramePipeline* pipeline)
+{
+	unique_lock<mutex> guard(pipeline->lock);
+	pipeline->changed.wait(guard, [pipeline] { return pipeline->used > 0 || !pipeline->running; });
+	if (!pipeline->running) return -1;
+	return pipeline->first;
+}
+
+void releaseFrame(FramePipeline* pipeline)
+{
+	FrameTime now = chrono::steady_clock::now();
+	{
+		lock_guard<mutex> guard(pipeline->lock);
+		double ms = chrono::duration<double, milli>(now - pipeline->sampled[pipeline->first]).count();
+		pipeline->latencyFrames++;
+		pipeline->latencySum += ms;
+		if (ms > pipeline->latencyMax) pipeline->latencyMax = ms;
+
+		pipeline->first = (pipeline->first + 1) % pipeline->depth;
+		pipeline->used--;
+	}
+	pipeline->changed.notify_all();
+}
+
+// Prints and resets the latency window once it holds 'frames' frames
+void reportFrameLatency(FramePipeline* pipeline, int frames)
+{
+	lock_guard<mutex> guard(pipeline->lock);
+	if (pipeline->latencyFrames < frames) return;
+	cout << "pipeline: depth " << pipeline->depth << ", input to display latency "
+		<< pipeline->latencySum / pipeline->latencyFrames << " ms average, "
+		<< pipeline->latencyMax << " ms worst over " << pipeline->latencyFrames << " frames" << endl;
+	pipeline->latencyFrames = 0;
+	pipeline->latencySum = 0;
+	pipeline->latencyMax = 0;
+}
+
+#endif
@@ -0,0 +1,219 @@
+//=====================================================================
+// Primitives.h
+// Mesh versions of the GLUT solids (sphere, cylinder, cone, torus and
+// cube), with the same orientation: cylinders and cones stand on z = 0
+// and rise along +z, and the torus lies in the xy plane. Shapes are
+// built at unit size with analytic normals, so one mesh serves every
+// size through a scale; only the torus keeps its tube-to-ring ratio.
+// Unlike the GLUT solids these need no glutInit, so they also draw in
+// a headless context.
+//=====================================================================
+
+#if !defined(H_PRIMITIVES)
+#define H_PRIMITIVES
+
+#include <deque>
+#include "vecmath.h"
+#include "mesh.h"
+using namespace std;
+
+#define PRIMITIVE_SPHERE 0
+#define PRIMITIVE_CYLINDER 1
+#define PRIMITIVE_CONE 2
+#define PRIMITIVE_TORUS 3
+#define PRIMITIVE_CUBE 4
+
+typedef struct {
+	int type;
+	float shape;		// torus tube radius over ring radius, else 0
+	int slices;
+	int stacks;
+	Mesh mesh;
+} PrimitiveMesh;
+
+// Unit sphere about the origin; stacks run from +z to -z
+void generateSphere(Mesh* mesh, int slices, int stacks)
+{
+	MeshBuilder builder;
+	vector<int> grid((stacks + 1) * (slices + 1));
+	for (int i = 0; i <= stacks; i++)
+	{
+		float st, ct;
+		sinCos((PI * i) / stacks, &st, &ct);
+		for (int j = 0; j <= slices; j++)
+		{
+			float sp, cp;
+			sinCos((TWO_PI * j) / slices, &sp, &cp);
+			Vec3 p = vec3(st * cp, st * sp, ct);
+			grid[i * (slices + 1) + j] = addMeshVertex(&builder, p.x, p.y, p.z, p.x, p.y, p.z, (float)j / slices, (float)i / stacks);
+		}
+	}
+	for (int i = 0; i < stacks; i++)
+	{
+		for (int j = 0; j < slices; j++)
+		{
+			int a = grid[i * (slices + 1) + j], b = grid[(i + 1) * (slices + 1) + j];
+			int c = grid[(i + 1) * (slices + 1) + j + 1], d = grid[i * (slices + 1) + j + 1];
+			// The rows at the poles collapse to a point
+			if (i == 0) addMeshTriangle(&builder, a, b, c);
+				else if (i == stacks - 1) addMeshTriangle(&builder, a, b, d);
+				else addMeshQuad(&builder, a, b, c, d);
+		}
+	}
+	buildMesh(&builder, mesh);
+}
+
+// Unit cylinder (or cone when 'topRadius' is 0) from z = 0 to z = 1,
+// capped at both ends
+void generateCylinder(Mesh* mesh, float topRadius, int slices, int stacks)
+{
+	MeshBuilder builder;
+	vector<int> grid((stacks + 1) * (slices + 1));
+
+	// The side normal leans up by the slope of the wall
+	float slope = 1 - topRadius;
+	float normalScale = 1 / sqrtf(1 + slope * slope);
+	for (int i = 0; i <= stacks; i++)
+	{
+		float z = (float)i / stacks;
+		float r = 1 + (topRadius - 1) * z;
+		for (int j = 0; j <= slices; j++)
+		{
+			float sp, cp;
+			sinCos((TWO_PI * j) / slices, &sp, &cp);
+			grid[i * (slices + 1) + j] = addMeshVertex(&builder, r * cp, r * sp, z,
+				cp * normalScale, sp * normalScale, slope * normalScale, (float)j / slices, z);
+		}
+	}
+	for (int i = 0; i < stacks; i++)
+	{
+		for (int j = 0; j < slices; j++)
+		{
+			int a = grid[i * (slices + 1) + j], b = grid[i * (slices + 1) + j + 1];
+			int c = grid[(i + 1) * (slices + 1) + j + 1], d = grid[(i + 1) * (slices + 1) + j];
+			if (topRadius == 0 && i == stacks - 1) addMeshTriangle(&builder, a, b, c);
+				else addMeshQuad(&builder, a, b, c, d);
+		}
+	}
+
+	// Caps as fans, wound to face away from the body
+	int bottom = addMeshVertex(&builder, 0, 0, 0, 0, 0, -1, 0.5, 0.5);
+	int top = topRadius > 0 ? addMeshVertex(&builder, 0, 0, 1, 0, 0, 1, 0.5, 0.5) : -1;
+	for (int j = 0; j < slices; j++)
+	{
+		float s0, c0, s1, c1;
+		sinCos((TWO_PI * j) / slices, &s0, &c0);
+		sinCos((TWO_PI * (j + 1)) / slices, &s1, &c1);
+		addMeshTriangle(&builder, bottom,
+			addMeshVertex(&builder, c1, s1, 0, 0, 0, -1, 0.5 + c1 / 2, 0.5 + s1 / 2),
+			addMeshVertex(&builder, c0, s0, 0, 0, 0, -1, 0.5 + c0 / 2, 0.5 + s0 / 2));
+		if (top < 0) continue;
+		addMeshTriangle(&builder, top,
+			addMeshVertex(&builder, topRadius * c0, topRadius * s0, 1, 0, 0, 1, 0.5 + c0 / 2, 0.5 + s0 / 2),
+			addMeshVertex(&builder, topRadius * c1, topRadius * s1, 1, 0, 0, 1, 0.5 + c1 / 2, 0.5 + s1 / 2));
+	}
+	buildMesh(&builder, mesh);
+}
+
+// Torus of ring radius 1 in the xy plane with tube radius 'tube'
+void generateTorus(Mesh* mesh, float tube, int sides, int rings)
+{
+	MeshBuilder builder;
+	vector<int> grid((rings + 1) * (sides + 1));
+	for (int i = 0; i <= rings; i++)
+	{
+		float sp, cp;
+		sinCos((TWO_PI * i) / rings, &sp, &cp);
+		for (int j = 0; j <= sides; j++)
+		{
+			float ss, cs;
+			sinCos((TWO_PI * j) / sides, &ss, &cs);
+			float r = 1 + tube * cs;
+			grid[i * (sides + 1) + j] = addMeshVertex(&builder, r * cp, r * sp, tube * ss,
+				cs * cp, cs * sp, ss, (float)i / rings, (float)j / sides);
+		}
+	}
+	for (int i = 0; i < rings; i++)
+	{
+		for (int j = 0; j < sides; j++)
+		{
+			addMeshQuad(&builder,
+				grid[i * (sides + 1) + j], grid[(i + 1) * (sides + 1) + j],
+				grid[(i + 1) * (sides + 1) + j + 1], grid[i * (sides + 1) + j + 1]);
+		}
+	}
+	buildMesh(&builder, mesh);
+}
+
+// Unit cube about the origin
+void generateCube(Mesh* mesh)
+{
+	// Per face: normal, then two edge directions whose cross product is the normal
+	static const float faces[6][3][3] = {
+		{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+		{ { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+		{ { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } },
+		{ { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+		{ { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+		{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } }
+	};
+	static const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+	MeshBuilder builder;
+	for (int f = 0; f < 6; f++)
+	{
+		const float* n = faces[f][0];
+		const float* u = faces[f][1];
+		const float* v = faces[f][2];
+		int quad[4];
+		for (int k = 0; k < 4; k++)
+		{
+			float a = corners[k][0] / 2, b = corners[k][1] / 2;
+			quad[k] = addMeshVertex(&builder,
+				n[0] / 2 + u[0] * a + v[0] * b, n[1] / 2 + u[1] * a + v[1] * b, n[2] / 2 + u[2] * a + v[2] * b,
+				n[0], n[1], n[2], a + 0.5f, b + 0.5f);
+		}
+		addMeshQuad(&builder, quad[0], quad[1], quad[2], quad[3]);
+	}
+	buildMesh(&builder, mesh);
+}
+
+// Built on first use; the deque keeps returned pointers valid as it grows
+deque<PrimitiveMesh> primitiveMeshes;
+
+const Mesh* primitiveMesh(int type, float shape, int slices, int stacks)
+{
+	for (size_t i = 0; i < primitiveMeshes.size(); i++)
+	{
+		const PrimitiveMesh& p = primitiveMeshes[i];
+		if (p.type == type && p.shape == shape && p.slices == slices && p.stacks == stacks) return &p.mesh;
+	}
+
+	primitiveMeshes.push_back(PrimitiveMesh());
+	PrimitiveMesh* p = &primitiveMeshes.back();
+	p->type = type;
+	p->shape = shape;
+	p->slices = slices;
+	p->stacks = stacks;
+	switch (type)
+	{
+		case PRIMITIVE_SPHERE:
+			generateSphere(&p->mesh, slices, stacks);
+			break;
+		case PRIMITIVE_CYLINDER:
+			generateCylinder(&p->mesh, 1, slices, stacks);
+			break;
+		case PRIMITIVE_CONE:
+			generateCylinder(&p->mesh, 0, slices, stacks);
+			break;
+		case PRIMITIVE_TORUS:
+			generateTorus(&p->mesh, shape, slices, stacks);
+			break;
+		case PRIMITIVE_CUBE:
+			generateCube(&p->mesh);
+			break;
+	}
+	return &p->mesh;
+}
+
+#endif
@@ -0,0 +1,164 @@
+//=====================================================================
+// Probes.h
+// Dynamic cube-map reflection probes with amortised updates.
+// Each probe owns a small cube map that is re-rendered one face at a
+// time: every frame at most 'facesPerFrame' faces are drawn in total,
+// each from a different probe, so the cost per frame is bounded however
+// many probes there are. Probes are chosen by how long they have gone
+// without an update, weighted towards the camera, and only probes in
+// view are updated. A probe's six faces therefore refresh over six of
+// its updates.
+// The caller records and replays the scene for each face between
+// beginProbeFace and endProbeFaces, using probeFaceView and
+// probeProjection. Cube maps start mid grey until their faces arrive.
+// Needs GL_GLEXT_PROTOTYPES defined before the first GL include.
+//=====================================================================
+
+#if !defined(H_PROBES)
+#define H_PROBES
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+#include "vecmath.h"
+#include "scenegraph.h"
+using namespace std;
+
+#define PROBE_RADIUS 30			// bounds used to skip probes out of view
+#define PROBE_NEAR 1
+#define PROBE_DISTANCE_BIAS 100	// distance at which a probe's priority halves
+
+typedef struct {
+	Vec3 position;
+	GLuint cubeMap;
+	int nextFace;
+	int age;					// frames since it last rendered a face
+} ReflectionProbe;
+
+typedef struct {
+	int probe;
+	int face;
+} ProbeFace;
+
+typedef struct {
+	vector<ReflectionProbe> probes;
+	int size;					// of each face, in pixels
+	int facesPerFrame;
+	GLuint framebuffer;
+	GLuint depth;
+	GLint output;				// framebuffer and viewport to restore
+	GLint viewport[4];
+	long facesRendered;
+} ReflectionProbes;
+
+// Needs a current GL context
+void initialiseReflectionProbes(ReflectionProbes* probes, int size, int facesPerFrame)
+{
+	probes->size = size;
+	probes->facesPerFrame = facesPerFrame;
+	probes->facesRendered = 0;
+	glGenRenderbuffers(1, &probes->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, probes->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glGenFramebuffers(1, &probes->framebuffer);
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+}
+
+// Returns the new probe's cube map
+GLuint addReflectionProbe(ReflectionProbes* probes, Vec3 position)
+{
+	ReflectionProbe probe = { position, 0, 0, 0 };
+	vector<unsigned char> grey((size_t)probes->size * probes->size * 3, 128);
+	glGenTextures(1, &probe.cubeMap);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, probe.cubeMap);
+	for (int face = 0; face < 6; face++)
+	{
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB8, probes->size, probes->size, 0, GL_RGB, GL_UNSIGNED_BYTE, grey.data());
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	probes->probes.push_back(probe);
+	return probe.cubeMap;
+}
+
+// Cube map faces in GL order: +x, -x, +y, -y, +z, -z
+Mat4 probeFaceView(const ReflectionProbe* probe, int face)
+{
+	static const Vec3 directions[6] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+	static const Vec3 ups[6] = { vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0) };
+	return mat4LookAt(probe->position, probe->position + directions[face], ups[face]);
+}
+
+Mat4 probeProjection(float zFar)
+{
+	return mat4Perspective(90, 1, PROBE_NEAR, zFar);
+}
+
+// Picks this frame's faces: the probes in view with the highest
+// age / (1 + distance / PROBE_DISTANCE_BIAS), one face each
+void chooseProbeFaces(ReflectionProbes* probes, Vec3 eye, const Frustum* view, vector<ProbeFace>* faces)
+{
+	vector<pair<float, int> > ranked;
+	for (size_t i = 0; i < probes->probes.size(); i++)
+	{
+		ReflectionProbe* probe = &probes->probes[i];
+		probe->age++;
+		if (!sphereInFrustum(view, probe->position, PROBE_RADIUS)) continue;
+		float distance = length(probe->position - eye);
+		ranked.push_back(make_pair(probe->age / (1 + distance / PROBE_DISTANCE_BIAS), (int)i));
+	}
+	sort(ranked.begin(), ranked.end(), greater<pair<float, int> >());
+
+	faces->clear();
+	for (size_t i = 0; i < ranked.size() && (int)i < probes->facesPerFrame; i++)
+	{
+		ReflectionProbe* probe = &probes->probes[ranked[i].second];
+		ProbeFace face = { ranked[i].second, probe->nextFace };
+		faces->push_back(face);
+		probe->nextFace = (probe->nextFace + 1) % 6;
+		probe->age = 0;
+	}
+}
+
+// Binds a face for drawing and clears it; the first call of a frame
+// remembers the framebuffer and viewport for endProbeFaces
+void beginProbeFace(ReflectionProbes* probes, ProbeFace face, bool isFirst)
+{
+	if (isFirst)
+	{
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &probes->output);
+		glGetIntegerv(GL_VIEWPORT, probes->viewport);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, probes->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face.face,
+		probes->probes[face.probe].cubeMap, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, probes->depth);
+	glViewport(0, 0, probes->size, probes->size);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	probes->facesRendered++;
+}
+
+void endProbeFaces(ReflectionProbes* probes)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, probes->output);
+	glViewport(probes->viewport[0], probes->viewport[1], probes->viewport[2], probes->viewport[3]);
+}
+
+void destroyReflectionProbes(ReflectionProbes* probes)
+{
+	for (size_t i = 0; i < probes->probes.size(); i++)
+	{
+		glDeleteTextures(1, &probes->probes[i].cubeMap);
+	}
+	probes->probes.clear();
+	glDeleteFramebuffers(1, &probes->framebuffer);
+	glDeleteRenderbuffers(1, &probes->depth);
+}
+
+#endif
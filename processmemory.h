@@ -0,0 +1,76 @@
+//=====================================================================
+// ProcessMemory.h
+// The process's resident and peak resident memory, read from
+// /proc/self/status, and a count of heap allocations made through
+// operator new (so including new[] and the standard containers), which
+// this header replaces with a counting wrapper around malloc. Resident
+// figures are zero where /proc does not exist.
+//=====================================================================
+
+#if !defined(H_PROCESSMEMORY)
+#define H_PROCESSMEMORY
+
+#include <iostream>
+#include <stdio.h>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+using namespace std;
+
+atomic<long> allocationCount(0);
+atomic<long> allocationBytes(0);
+
+void* operator new(size_t size)
+{
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	allocationBytes.fetch_add((long)size, memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (!p) throw bad_alloc();
+	return p;
+}
+
+// Kept out of line: once inlined, GCC sees free() on a pointer from new
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+
+typedef struct {
+	long residentKb;		// VmRSS
+	long peakResidentKb;	// VmHWM
+	long allocations;		// since the start of the process
+	long allocatedBytes;
+} ProcessMemory;
+
+// Reads with stdio, which allocates through malloc, so the reading is
+// not counted in the figures it returns
+ProcessMemory readProcessMemory()
+{
+	ProcessMemory memory = { 0, 0, allocationCount.load(), allocationBytes.load() };
+	FILE* file = fopen("/proc/self/status", "r");
+	if (!file) return memory;
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		sscanf(line, "VmRSS: %ld", &memory.residentKb);
+		sscanf(line, "VmHWM: %ld", &memory.peakResidentKb);
+	}
+	fclose(file);
+	return memory;
+}
+
+void printProcessMemory(const char* label)
+{
+	ProcessMemory memory = readProcessMemory();
+	cout << label << ": resident " << memory.residentKb / 1024.0 << " MB, peak " << memory.peakResidentKb / 1024.0
+		<< " MB, allocations " << memory.allocations << " (" << memory.allocatedBytes / 1048576.0 << " MB)" << endl;
+}
+
+// What happened between two readings
+void printProcessMemoryChange(const char* label, const ProcessMemory& before)
+{
+	ProcessMemory after = readProcessMemory();
+	cout << label << ": resident +" << (after.residentKb - before.residentKb) / 1024.0 << " MB, peak "
+		<< after.peakResidentKb / 1024.0 << " MB, " << after.allocations - before.allocations << " allocations ("
+		<< (after.allocatedBytes - before.allocatedBytes) / 1048576.0 << " MB)" << endl;
+}
+
+#endif
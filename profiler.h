@@ -0,0 +1,273 @@
+//=====================================================================
+// Profiler.h
+// Scoped frame profiler with CPU timers and GPU timer queries.
+// Each marker records its CPU time with a steady clock and, if asked,
+// its GPU time with a GL_TIME_ELAPSED query. GPU markers must not
+// overlap, since only one elapsed-time query can be active. Queries
+// are read PROFILER_FRAMES frames later, when the slot holding them is
+// reused, so reading results never stalls on the GPU in practice.
+// Finished frames are kept for an on-screen breakdown and can be
+// streamed to CSV (frame, marker, cpu_ms, gpu_ms) or to Chrome's trace
+// event JSON (chrome://tracing, Perfetto). GPU events in the trace are
+// placed at their marker's CPU start, since elapsed queries carry no
+// timestamps.
+// Needs GL_GLEXT_PROTOTYPES defined before the first GL include.
+//=====================================================================
+
+#if !defined(H_PROFILER)
+#define H_PROFILER
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+using namespace std;
+
+#define PROFILER_FRAMES 4		// frames of queries in flight
+
+typedef struct {
+	string name;
+	double cpuStart;			// ms since the profiler started
+	double cpuMs;
+	double gpuMs;				// -1 without a GPU timer
+	int query;					// index into the frame's queries, or -1
+} ProfileMarker;
+
+typedef struct {
+	long number;				// -1 while the slot is unused
+	double cpuStart;
+	double cpuMs;
+	vector<ProfileMarker> markers;
+	vector<GLuint> queries;		// grown on demand, reused every frame
+	int queriesUsed;
+} ProfileFrame;
+
+typedef struct {
+	bool enabled;
+	bool gpuTimers;				// GL_TIME_ELAPSED is available
+	chrono::steady_clock::time_point epoch;
+	ProfileFrame frames[PROFILER_FRAMES];
+	long frameNumber;
+	ProfileFrame last;			// most recent frame with resolved GPU times
+
+	ofstream output;
+	bool isTrace;				// Chrome trace JSON, else CSV
+	bool traceHasEvents;
+} Profiler;
+
+inline double profilerNow(const Profiler* profiler)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - profiler->epoch).count();
+}
+
+// Needs a current GL context. 'outputPath' may be null; a path ending
+// in .json writes a Chrome trace, anything else CSV.
+void initialiseProfiler(Profiler* profiler, const char* outputPath)
+{
+	profiler->enabled = true;
+	profiler->epoch = chrono::steady_clock::now();
+	profiler->frameNumber = 0;
+	for (int i = 0; i < PROFILER_FRAMES; i++)
+	{
+		profiler->frames[i].number = -1;
+	}
+	profiler->last.number = -1;
+
+	int major = 0, minor = 0;
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (version) sscanf(version, "%d.%d", &major, &minor);
+	profiler->gpuTimers = major > 3 || (major == 3 && minor >= 3);
+
+	profiler->isTrace = false;
+	profiler->traceHasEvents = false;
+	if (outputPath)
+	{
+		string path = outputPath;
+		profiler->isTrace = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		profiler->output.open(outputPath);
+		if (!profiler->output)
+		{
+			cout << "*** Error opening profile output: " << outputPath << endl;
+			exit(1);
+		}
+		if (profiler->isTrace) profiler->output << "{\"traceEvents\":[";
+			else profiler->output << "frame,marker,cpu_ms,gpu_ms" << endl;
+	}
+}
+
+void writeTraceEvent(Profiler* profiler, const string& name, int thread, double start, double duration)
+{
+	ofstream& out = profiler->output;
+	out << (profiler->traceHasEvents ? ",\n" : "\n");
+	out << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+		<< ",\"ts\":" << (long long)(start * 1000) << ",\"dur\":" << (long long)(duration * 1000) << "}";
+	profiler->traceHasEvents = true;
+}
+
+// Reads a frame's GPU times, waiting for any that are not ready yet,
+// and hands the frame to the outputs
+void resolveProfileFrame(Profiler* profiler, ProfileFrame* frame)
+{
+	if (frame->number < 0) return;
+	for (size_t i = 0; i < frame->markers.size(); i++)
+	{
+		ProfileMarker& m = frame->markers[i];
+		if (m.query < 0) continue;
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(frame->queries[m.query], GL_QUERY_RESULT, &elapsed);
+		m.gpuMs = elapsed / 1e6;
+	}
+
+	if (profiler->output.is_open())
+	{
+		if (profiler->isTrace)
+		{
+			writeTraceEvent(profiler, "frame " + to_string(frame->number), 1, frame->cpuStart, frame->cpuMs);
+			for (size_t i = 0; i < frame->markers.size(); i++)
+			{
+				const ProfileMarker& m = frame->markers[i];
+				writeTraceEvent(profiler, m.name, 1, m.cpuStart, m.cpuMs);
+				if (m.gpuMs >= 0) writeTraceEvent(profiler, m.name, 2, m.cpuStart, m.gpuMs);
+			}
+		}
+		else
+		{
+			profiler->output << frame->number << ",frame," << frame->cpuMs << "," << endl;
+			for (size_t i = 0; i < frame->markers.size(); i++)
+			{
+				const ProfileMarker& m = frame->markers[i];
+				profiler->output << frame->number << "," << m.name << "," << m.cpuMs << ",";
+				if (m.gpuMs >= 0) profiler->output << m.gpuMs;
+				profiler->output << endl;
+			}
+		}
+	}
+
+	profiler->last.number = frame->number;
+	profiler->last.cpuMs = frame->cpuMs;
+	profiler->last.markers = frame->markers;
+	frame->number = -1;
+}
+
+void beginProfileFrame(Profiler* profiler)
+{
+	if (!profiler->enabled) return;
+	ProfileFrame* frame = &profiler->frames[profiler->frameNumber % PROFILER_FRAMES];
+	resolveProfileFrame(profiler, frame);
+	frame->number = profiler->frameNumber;
+	frame->cpuStart = profilerNow(profiler);
+	frame->markers.clear();
+	frame->queriesUsed = 0;
+}
+
+// Returns a handle for endProfileMarker
+int beginProfileMarker(Profiler* profiler, const string& name, bool timeGpu)
+{
+	if (!profiler->enabled) return -1;
+	ProfileFrame* frame = &profiler->frames[profiler->frameNumber % PROFILER_FRAMES];
+	ProfileMarker m = { name, profilerNow(profiler), 0, -1, -1 };
+	if (timeGpu && profiler->gpuTimers)
+	{
+		if (frame->queriesUsed == (int)frame->queries.size())
+		{
+			GLuint query;
+			glGenQueries(1, &query);
+			frame->queries.push_back(query);
+		}
+		m.query = frame->queriesUsed++;
+		glBeginQuery(GL_TIME_ELAPSED, frame->queries[m.query]);
+	}
+	frame->markers.push_back(m);
+	return (int)frame->markers.size() - 1;
+}
+
+void endProfileMarker(Profiler* profiler, int marker)
+{
+	if (!profiler->enabled || marker < 0) return;
+	ProfileMarker& m = profiler->frames[profiler->frameNumber % PROFILER_FRAMES].markers[marker];
+	if (m.query >= 0) glEndQuery(GL_TIME_ELAPSED);
+	m.cpuMs = profilerNow(profiler) - m.cpuStart;
+}
+
+void endProfileFrame(Profiler* profiler)
+{
+	if (!profiler->enabled) return;
+	ProfileFrame* frame = &profiler->frames[profiler->frameNumber % PROFILER_FRAMES];
+	frame->cpuMs = profilerNow(profiler) - frame->cpuStart;
+	profiler->frameNumber++;
+}
+
+// Resolves the frames still in flight and closes the output
+void shutdownProfiler(Profiler* profiler)
+{
+	if (!profiler->enabled) return;
+	for (long n = profiler->frameNumber - PROFILER_FRAMES; n < profiler->frameNumber; n++)
+	{
+		if (n >= 0) resolveProfileFrame(profiler, &profiler->frames[n % PROFILER_FRAMES]);
+	}
+	if (profiler->output.is_open())
+	{
+		if (profiler->isTrace) profiler->output << "\n]}" << endl;
+		profiler->output.close();
+	}
+	profiler->enabled = false;
+}
+
+// Draws the last resolved frame as a table in the top left corner with
+// GLUT bitmap text; needs a GLUT window
+void drawProfilerOverlay(const Profiler* profiler, int width, int height)
+{
+	const ProfileFrame* frame = &profiler->last;
+	if (frame->number < 0) return;
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_DEPTH_TEST);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, width, 0, height, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	// Backing panel for legibility over the scene
+	int lines = (int)frame->markers.size() + 2;
+	glColor4f(0, 0, 0, 0.6);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glRecti(4, height - 8 - lines * 15, 344, height - 4);
+	glDisable(GL_BLEND);
+
+	char line[128];
+	int y = height - 18;
+	glColor3f(1, 1, 1);
+	snprintf(line, sizeof(line), "frame %ld  %6.2f ms cpu", frame->number, frame->cpuMs);
+	glRasterPos2i(10, y);
+	glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+	y -= 15;
+	snprintf(line, sizeof(line), "%-20s %8s %8s", "marker", "cpu ms", "gpu ms");
+	glRasterPos2i(10, y);
+	glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+	for (size_t i = 0; i < frame->markers.size(); i++)
+	{
+		const ProfileMarker& m = frame->markers[i];
+		y -= 15;
+		if (m.gpuMs >= 0) snprintf(line, sizeof(line), "%-20.20s %8.3f %8.3f", m.name.c_str(), m.cpuMs, m.gpuMs);
+			else snprintf(line, sizeof(line), "%-20.20s %8.3f %8s", m.name.c_str(), m.cpuMs, "-");
+		glRasterPos2i(10, y);
+		glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+	}
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+}
+
+#endif
@@ -0,0 +1,192 @@
+//=====================================================================
+// Resolution.h
+// Dynamic resolution: the scene is drawn into a framebuffer object at a
+// fraction of the output size and stretched over the output with
+// bilinear filtering. The fraction is steered towards a target frame
+// time by a damped controller that assumes frame cost grows with the
+// pixel count. The render target is allocated at full size once, and
+// only the part in use is drawn to and sampled.
+// Frame times are measured on the CPU around the whole frame, so on a
+// display with vsync the target should sit above the refresh interval.
+// Needs GL_GLEXT_PROTOTYPES defined before the first GL include.
+//=====================================================================
+
+#if !defined(H_RESOLUTION)
+#define H_RESOLUTION
+
+#include <iostream>
+#include <math.h>
+#include <GL/freeglut.h>
+#include <GL/glext.h>
+using namespace std;
+
+#define RESOLUTION_MIN_SCALE 0.25
+#define RESOLUTION_SMOOTHING 0.1	// weight of each new frame time in the average
+#define RESOLUTION_GAIN 0.25		// fraction of the error corrected per frame
+#define RESOLUTION_DEADBAND 0.05	// relative scale error that is ignored
+
+typedef struct {
+	bool enabled;
+	GLuint framebuffer;
+	GLuint colour;				// texture, sampled for the upscale
+	GLuint depth;
+	int width;					// output size
+	int height;
+	float scale;				// of each side
+	double targetMs;
+	double averageMs;			// smoothed frame time
+	GLint output;				// framebuffer bound when the frame began
+
+	// Log window
+	int logFrames;
+	double logMs;
+	double logScale;
+	float logMinScale;
+	float logMaxScale;
+} DynamicResolution;
+
+void resetResolutionLog(DynamicResolution* resolution)
+{
+	resolution->logFrames = 0;
+	resolution->logMs = 0;
+	resolution->logScale = 0;
+	resolution->logMinScale = 1;
+	resolution->logMaxScale = 0;
+}
+
+// Needs a current GL context
+void initialiseDynamicResolution(DynamicResolution* resolution, int width, int height, double targetMs)
+{
+	resolution->width = width;
+	resolution->height = height;
+	resolution->scale = 1;
+	resolution->targetMs = targetMs;
+	resolution->averageMs = targetMs;
+	resetResolutionLog(resolution);
+
+	glGenTextures(1, &resolution->colour);
+	glBindTexture(GL_TEXTURE_2D, resolution->colour);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glGenRenderbuffers(1, &resolution->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, resolution->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	GLint output;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+	glGenFramebuffers(1, &resolution->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolution->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolution->colour, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, resolution->depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cout << "*** Error creating the dynamic resolution target: incomplete framebuffer" << endl;
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, output);
+	resolution->enabled = true;
+}
+
+inline int scaledSize(const DynamicResolution* resolution, int size)
+{
+	return max(1, (int)(size * resolution->scale + 0.5f));
+}
+
+// Redirects drawing into the scaled render target; call before clearing
+void beginResolutionFrame(DynamicResolution* resolution)
+{
+	if (!resolution->enabled) return;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &resolution->output);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolution->framebuffer);
+	glViewport(0, 0, scaledSize(resolution, resolution->width), scaledSize(resolution, resolution->height));
+}
+
+// Stretches the rendered part over the whole output. Texture
+// coordinates stop half a texel inside it so filtering never reaches
+// the unused part.
+void endResolutionFrame(DynamicResolution* resolution)
+{
+	if (!resolution->enabled) return;
+	glBindFramebuffer(GL_FRAMEBUFFER, resolution->output);
+	glViewport(0, 0, resolution->width, resolution->height);
+
+	float u0 = 0.5f / resolution->width, u1 = (scaledSize(resolution, resolution->width) - 0.5f) / resolution->width;
+	float v0 = 0.5f / resolution->height, v1 = (scaledSize(resolution, resolution->height) - 0.5f) / resolution->height;
+
+	glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, resolution->colour);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glBegin(GL_QUADS);
+		glTexCoord2f(u0, v0); glVertex2f(-1, -1);
+		glTexCoord2f(u1, v0); glVertex2f(1, -1);
+		glTexCoord2f(u1, v1); glVertex2f(1, 1);
+		glTexCoord2f(u0, v1); glVertex2f(-1, 1);
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+}
+
+// Feeds in the time of the frame just finished and picks the scale for
+// the next. The scale expected to meet the target is
+// scale * sqrt(target / average); a fraction of the way there is taken
+// each frame, and errors inside the deadband are left alone so the
+// image does not flicker between nearby sizes.
+void updateDynamicResolution(DynamicResolution* resolution, double frameMs)
+{
+	if (!resolution->enabled) return;
+	resolution->logFrames++;
+	resolution->logMs += frameMs;
+	resolution->logScale += resolution->scale;
+	resolution->logMinScale = min(resolution->logMinScale, resolution->scale);
+	resolution->logMaxScale = max(resolution->logMaxScale, resolution->scale);
+
+	resolution->averageMs += (frameMs - resolution->averageMs) * RESOLUTION_SMOOTHING;
+	float ideal = resolution->scale * sqrt(resolution->targetMs / max(resolution->averageMs, 0.01));
+	if (fabs(ideal - resolution->scale) > RESOLUTION_DEADBAND * resolution->scale)
+	{
+		resolution->scale += (ideal - resolution->scale) * RESOLUTION_GAIN;
+	}
+	resolution->scale = min(1.0f, max((float)RESOLUTION_MIN_SCALE, resolution->scale));
+}
+
+// Prints and resets the log window once it holds 'frames' frames
+void reportDynamicResolution(DynamicResolution* resolution, int frames)
+{
+	if (!resolution->enabled || resolution->logFrames < frames) return;
+	float scale = resolution->logScale / resolution->logFrames;
+	cout << "resolution: scale " << scale << " average (" << (int)(resolution->width * scale) << "x"
+		<< (int)(resolution->height * scale) << "), " << resolution->logMinScale << " to " << resolution->logMaxScale
+		<< ", frame " << resolution->logMs / resolution->logFrames << " ms average against " << resolution->targetMs
+		<< " ms over " << resolution->logFrames << " frames" << endl;
+	resetResolutionLog(resolution);
+}
+
+void destroyDynamicResolution(DynamicResolution* resolution)
+{
+	if (!resolution->enabled) return;
+	glDeleteFramebuffers(1, &resolution->framebuffer);
+	glDeleteTextures(1, &resolution->colour);
+	glDeleteRenderbuffers(1, &resolution->depth);
+	resolution->enabled = false;
+}
+
+#endif
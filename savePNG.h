@@ -0,0 +1,118 @@
+//=====================================================================
+// SavePNG.h
+// Writes 8-bit RGB images as PNG files with no library dependency.
+// Image data is stored uncompressed (deflate "stored" blocks), which
+// keeps the writer small and fast at the cost of file size.
+// Rows are expected top to bottom.
+//=====================================================================
+
+#if !defined(H_PNG)
+#define H_PNG
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+using namespace std;
+
+unsigned int pngCrc(const unsigned char* data, size_t length, unsigned int crc = 0xffffffff)
+{
+	static unsigned int table[256];
+	static bool hasTable = false;
+	if (!hasTable)
+	{
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		hasTable = true;
+	}
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+void pngPutBigEndian(vector<unsigned char>* out, unsigned int value)
+{
+	out->push_back((value >> 24) & 0xff);
+	out->push_back((value >> 16) & 0xff);
+	out->push_back((value >> 8) & 0xff);
+	out->push_back(value & 0xff);
+}
+
+// Appends a chunk: length, type, data, then the CRC of type and data
+void pngPutChunk(vector<unsigned char>* out, const char* type, const vector<unsigned char>& data)
+{
+	pngPutBigEndian(out, (unsigned int)data.size());
+	size_t start = out->size();
+	out->insert(out->end(), type, type + 4);
+	out->insert(out->end(), data.begin(), data.end());
+	pngPutBigEndian(out, pngCrc(&(*out)[start], out->size() - start) ^ 0xffffffff);
+}
+
+void savePNG(const char* filename, int width, int height, const unsigned char* rgb)
+{
+	// Every row is prefixed with filter type 0 (none)
+	size_t rowSize = (size_t)width * 3;
+	vector<unsigned char> raw;
+	raw.reserve((rowSize + 1) * height);
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb + y * rowSize, rgb + (y + 1) * rowSize);
+	}
+
+	// zlib stream of stored blocks, at most 65535 bytes each
+	vector<unsigned char> zlib;
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		size_t length = min(raw.size() - offset, (size_t)65535);
+		bool isLast = offset + length == raw.size();
+		zlib.push_back(isLast ? 1 : 0);
+		zlib.push_back(length & 0xff);
+		zlib.push_back((length >> 8) & 0xff);
+		zlib.push_back(~length & 0xff);
+		zlib.push_back((~length >> 8) & 0xff);
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+
+	unsigned int a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); i++)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	pngPutBigEndian(&zlib, (b << 16) | a);
+
+	vector<unsigned char> header;
+	pngPutBigEndian(&header, width);
+	pngPutBigEndian(&header, height);
+	header.push_back(8);	// bit depth
+	header.push_back(2);	// colour type: RGB
+	header.push_back(0);	// compression
+	header.push_back(0);	// filter
+	header.push_back(0);	// interlace
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	vector<unsigned char> png(signature, signature + 8);
+	pngPutChunk(&png, "IHDR", header);
+	pngPutChunk(&png, "IDAT", zlib);
+	pngPutChunk(&png, "IEND", vector<unsigned char>());
+
+	ofstream file(filename, ios::out | ios::binary);
+	if (!file)
+	{
+		cout << "*** Error opening image file: " << filename << endl;
+		exit(1);
+	}
+	file.write((const char*)png.data(), png.size());
+}
+
+#endif
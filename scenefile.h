@@ -0,0 +1,579 @@
+//=====================================================================
+// SceneFile.h
+// Scene description in a text authoring form and a compiled binary form.
+// The text form is line based:
+//     material <name> <path> [key=value ...]
+//     mesh <name> <generator> [key=value ...]
+//     light <name> <type> [key=value ...]
+//     node <name> <type> <parent|-> <x> <y> <z> <yaw> [key=value ...]
+// '#' starts a comment and parents must be declared before children.
+// The binary form is a header followed by flat arrays of fixed-size
+// records and a string table, in native byte order. It is mmapped and
+// used in place, so loading costs one validation pass over the header.
+//=====================================================================
+
+#if !defined(H_SCENEFILE)
+#define H_SCENEFILE
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+using namespace std;
+
+#define SCENE_MAGIC 0x4e435353	// "SSCN"
+#define SCENE_VERSION 1
+#define SCENE_MAX_PARAMS 8
+
+// Section keywords in the text form
+#define SCENE_SECTION_NODE 0
+#define SCENE_SECTION_MESH 1
+#define SCENE_SECTION_MATERIAL 2
+#define SCENE_SECTION_LIGHT 3
+
+#define SCENE_NODE_GROUP 0
+#define SCENE_NODE_MUSEUM 1
+#define SCENE_NODE_TRAVELLERS 2
+#define SCENE_NODE_MOBIUS 3
+#define SCENE_NODE_CRADLE 4
+
+#define SCENE_MESH_FLOOR 0
+#define SCENE_MESH_PLATFORM 1
+#define SCENE_MESH_PILLAR 2
+
+#define SCENE_LIGHT_DIRECTIONAL 0
+#define SCENE_LIGHT_POINT 1
+
+// Accepted values of a parameter; sizes are divided by or truncated to
+// int steps when the scene is built, so out of range values would crash
+#define SCENE_RANGE_ANY 0
+#define SCENE_RANGE_POSITIVE 1
+#define SCENE_RANGE_AT_LEAST_ONE 2
+#define SCENE_RANGE_SIDES 3			// at least 3
+
+// Per-type parameters; unset keys take the defaults in sceneParamSpecs
+typedef union {
+	float values[SCENE_MAX_PARAMS];
+	struct { float radius, sides; } museum;
+	struct { float count; } travellers;
+	struct { float balls; } mobius;
+	struct { float halfX, halfZ, tile, texScale; } floor;
+	struct { float width, height, depth; } platform;
+	struct { float radius, height, sides; } pillar;
+	struct { float mipmaps, size, clamp; } texture;	// path holds %d for the level size when mipmapped
+	struct { float x, y, z, r, g, b; } light;		// direction towards the light when directional
+} SceneParams;
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int fileSize;
+	unsigned int nodeCount, nodeOffset;
+	unsigned int meshCount, meshOffset;
+	unsigned int materialCount, materialOffset;
+	unsigned int lightCount, lightOffset;
+	unsigned int stringSize, stringOffset;
+} SceneFileHeader;
+
+typedef struct {
+	unsigned int name;		// offset into the string table
+	int type;
+	int parent;				// index of an earlier node, -1 for roots
+	float position[3];
+	float yaw;				// degrees about +y
+	SceneParams params;
+} SceneNodeDesc;
+
+typedef struct {
+	unsigned int name;
+	int type;
+	SceneParams params;
+} SceneMeshDesc;
+
+typedef struct {
+	unsigned int name;
+	unsigned int path;
+	SceneParams params;
+} SceneMaterialDesc;
+
+typedef struct {
+	unsigned int name;
+	int type;
+	SceneParams params;
+} SceneLightDesc;
+
+typedef struct {
+	const SceneFileHeader* header;
+	const SceneNodeDesc* nodes;
+	const SceneMeshDesc* meshes;
+	const SceneMaterialDesc* materials;
+	const SceneLightDesc* lights;
+	const char* strings;
+	void* mapping;			// mmapped file, or null when compiled in memory
+	size_t mappingSize;
+	vector<char> image;		// in-memory image when the binary could not be written
+} SceneFile;
+
+typedef struct {
+	int section;
+	int type;
+	const char* key;
+	int slot;
+	float value;
+	int range;
+} SceneParamSpec;
+
+const char* sceneNodeTypes[] = { "group", "museum", "travellers", "mobius", "cradle" };
+const char* sceneMeshTypes[] = { "floor", "platform", "pillar" };
+const char* sceneLightTypes[] = { "directional", "point" };
+
+const SceneParamSpec sceneParamSpecs[] = {
+	{ SCENE_SECTION_NODE, SCENE_NODE_MUSEUM, "radius", 0, 180, SCENE_RANGE_POSITIVE },
+	{ SCENE_SECTION_NODE, SCENE_NODE_MUSEUM, "sides", 1, 6, SCENE_RANGE_SIDES },
+	{ SCENE_SECTION_NODE, SCENE_NODE_TRAVELLERS, "count", 0, 72, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_NODE, SCENE_NODE_MOBIUS, "balls", 0, 3, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MESH, SCENE_MESH_FLOOR, "half_x", 0, 1000, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MESH, SCENE_MESH_FLOOR, "half_z", 1, 1000, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MESH, SCENE_MESH_FLOOR, "tile", 2, 10, SCENE_RANGE_AT_LEAST_ONE },
+	{ SCENE_SECTION_MESH, SCENE_MESH_FLOOR, "tex_scale", 3, 8, SCENE_RANGE_AT_LEAST_ONE },
+	{ SCENE_SECTION_MESH, SCENE_MESH_PLATFORM, "width", 0, 120, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MESH, SCENE_MESH_PLATFORM, "height", 1, 10, SCENE_RANGE_POSITIVE },
+	{ SCENE_SECTION_MESH, SCENE_MESH_PLATFORM, "depth", 2, 80, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MESH, SCENE_MESH_PILLAR, "radius", 0, 10, SCENE_RANGE_POSITIVE },
+	{ SCENE_SECTION_MESH, SCENE_MESH_PILLAR, "height", 1, 100, SCENE_RANGE_POSITIVE },
+	{ SCENE_SECTION_MESH, SCENE_MESH_PILLAR, "sides", 2, 24, SCENE_RANGE_SIDES },
+	{ SCENE_SECTION_MATERIAL, 0, "mipmaps", 0, 1, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MATERIAL, 0, "size", 1, 0, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_MATERIAL, 0, "clamp", 2, 0, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_LIGHT, -1, "x", 0, 0, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_LIGHT, -1, "y", 1, 0, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_LIGHT, -1, "z", 2, 0, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_LIGHT, -1, "r", 3, 1, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_LIGHT, -1, "g", 4, 1, SCENE_RANGE_ANY },
+	{ SCENE_SECTION_LIGHT, -1, "b", 5, 1, SCENE_RANGE_ANY },
+};
+const int sceneParamSpecCount = sizeof(sceneParamSpecs) / sizeof(sceneParamSpecs[0]);
+
+// Specs with type -1 apply to every type in their section
+bool sceneSpecApplies(const SceneParamSpec& spec, int section, int type)
+{
+	return spec.section == section && (spec.type == type || spec.type == -1);
+}
+
+SceneParams defaultSceneParams(int section, int type)
+{
+	SceneParams params;
+	memset(&params, 0, sizeof(params));
+	for (int i = 0; i < sceneParamSpecCount; i++)
+	{
+		if (sceneSpecApplies(sceneParamSpecs[i], section, type)) params.values[sceneParamSpecs[i].slot] = sceneParamSpecs[i].value;
+	}
+	return params;
+}
+
+// Checks a record's parameters against the ranges in sceneParamSpecs;
+// returns what is wrong, or an empty string. A texture's size may be left
+// at 0 unless it is mipmapped, when it is the size of the largest level.
+string sceneParamsError(int section, int type, const SceneParams& params)
+{
+	for (int i = 0; i < sceneParamSpecCount; i++)
+	{
+		const SceneParamSpec& spec = sceneParamSpecs[i];
+		if (!sceneSpecApplies(spec, section, type)) continue;
+		float value = params.values[spec.slot];
+		string key = spec.key;
+		if (spec.range == SCENE_RANGE_POSITIVE && !(value > 0)) return "'" + key + "' must be positive";
+		if (spec.range == SCENE_RANGE_AT_LEAST_ONE && !(value >= 1)) return "'" + key + "' must be at least 1";
+		if (spec.range == SCENE_RANGE_SIDES && !(value >= 3)) return "'" + key + "' must be at least 3";
+	}
+	if (section == SCENE_SECTION_MATERIAL)
+	{
+		if (!(params.texture.size >= 0)) return "'size' must be positive";
+		if (params.texture.mipmaps > 1 && params.texture.size == 0) return "mipmapped textures need a size";
+	}
+	return "";
+}
+
+void sceneError(const char* path, int line, const string& message)
+{
+	cout << "*** Scene error: " << path << ":" << line << ": " << message << endl;
+	exit(1);
+}
+
+int findSceneKeyword(const char* const* names, int count, const string& word)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (word == names[i]) return i;
+	}
+	return -1;
+}
+
+typedef struct {
+	vector<SceneNodeDesc> nodes;
+	vector<SceneMeshDesc> meshes;
+	vector<SceneMaterialDesc> materials;
+	vector<SceneLightDesc> lights;
+	vector<char> strings;
+	vector<string> nodeNames;
+} SceneCompiler;
+
+unsigned int addSceneString(SceneCompiler* compiler, const string& s)
+{
+	unsigned int offset = (unsigned int)compiler->strings.size();
+	compiler->strings.insert(compiler->strings.end(), s.begin(), s.end());
+	compiler->strings.push_back(0);
+	return offset;
+}
+
+// Applies the remaining key=value tokens of a line
+void parseSceneParams(istringstream& tokens, int section, int type, SceneParams* params, const char* path, int line)
+{
+	string token;
+	while (tokens >> token)
+	{
+		size_t eq = token.find('=');
+		if (eq == string::npos) sceneError(path, line, "expected key=value, got '" + token + "'");
+		string key = token.substr(0, eq);
+
+		int spec = -1;
+		for (int i = 0; i < sceneParamSpecCount && spec < 0; i++)
+		{
+			if (sceneSpecApplies(sceneParamSpecs[i], section, type) && key == sceneParamSpecs[i].key) spec = i;
+		}
+		if (spec < 0) sceneError(path, line, "unknown parameter '" + key + "'");
+
+		char* end;
+		const char* value = token.c_str() + eq + 1;
+		params->values[sceneParamSpecs[spec].slot] = strtof(value, &end);
+		if (end == value || *end != 0) sceneError(path, line, "bad number in '" + token + "'");
+	}
+	string error = sceneParamsError(section, type, *params);
+	if (!error.empty()) sceneError(path, line, error);
+}
+
+// Compiles the text form into the binary image; 'path' names the
+// source in error messages
+void compileSceneStream(istream& file, const char* path, vector<char>* image)
+{
+	SceneCompiler compiler;
+	compiler.strings.push_back(0);		// offset 0 is the empty string
+
+	string text;
+	int line = 0;
+	while (getline(file, text))
+	{
+		line++;
+		size_t comment = text.find('#');
+		if (comment != string::npos) text.erase(comment);
+		istringstream tokens(text);
+		string keyword, name;
+		if (!(tokens >> keyword)) continue;
+		if (!(tokens >> name)) sceneError(path, line, "missing name");
+
+		if (keyword == "material")
+		{
+			string texturePath;
+			if (!(tokens >> texturePath)) sceneError(path, line, "missing texture path");
+			SceneMaterialDesc m;
+			m.name = addSceneString(&compiler, name);
+			m.path = addSceneString(&compiler, texturePath);
+			m.params = defaultSceneParams(SCENE_SECTION_MATERIAL, 0);
+			parseSceneParams(tokens, SCENE_SECTION_MATERIAL, 0, &m.params, path, line);
+			compiler.materials.push_back(m);
+		}
+		else if (keyword == "mesh" || keyword == "light")
+		{
+			bool isMesh = keyword == "mesh";
+			string typeName;
+			tokens >> typeName;
+			int type = isMesh ? findSceneKeyword(sceneMeshTypes, 3, typeName) : findSceneKeyword(sceneLightTypes, 2, typeName);
+			if (type < 0) sceneError(path, line, "unknown " + keyword + " type '" + typeName + "'");
+			int section = isMesh ? SCENE_SECTION_MESH : SCENE_SECTION_LIGHT;
+
+			SceneParams params = defaultSceneParams(section, type);
+			parseSceneParams(tokens, section, type, &params, path, line);
+			if (isMesh)
+			{
+				SceneMeshDesc m = { addSceneString(&compiler, name), type, params };
+				compiler.meshes.push_back(m);
+			}
+			else
+			{
+				SceneLightDesc l = { addSceneString(&compiler, name), type, params };
+				compiler.lights.push_back(l);
+			}
+		}
+		else if (keyword == "node")
+		{
+			string typeName, parentName;
+			SceneNodeDesc n;
+			if (!(tokens >> typeName >> parentName >> n.position[0] >> n.position[1] >> n.position[2] >> n.yaw))
+			{
+				sceneError(path, line, "expected: node <name> <type> <parent|-> <x> <y> <z> <yaw>");
+			}
+			n.type = findSceneKeyword(sceneNodeTypes, 5, typeName);
+			if (n.type < 0) sceneError(path, line, "unknown node type '" + typeName + "'");
+
+			n.parent = -1;
+			if (parentName != "-")
+			{
+				for (int i = (int)compiler.nodeNames.size() - 1; i >= 0 && n.parent < 0; i--)
+				{
+					if (compiler.nodeNames[i] == parentName) n.parent = i;
+				}
+				if (n.parent < 0) sceneError(path, line, "parent '" + parentName + "' is not declared above");
+			}
+
+			n.name = addSceneString(&compiler, name);
+			n.params = defaultSceneParams(SCENE_SECTION_NODE, n.type);
+			parseSceneParams(tokens, SCENE_SECTION_NODE, n.type, &n.params, path, line);
+			compiler.nodes.push_back(n);
+			compiler.nodeNames.push_back(name);
+		}
+		else
+		{
+			sceneError(path, line, "unknown keyword '" + keyword + "'");
+		}
+	}
+
+	// Every record is a multiple of 4 bytes, so the sections stay aligned
+	SceneFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SCENE_MAGIC;
+	header.version = SCENE_VERSION;
+	unsigned int offset = sizeof(SceneFileHeader);
+	header.nodeCount = (unsigned int)compiler.nodes.size();
+	header.nodeOffset = offset;
+	offset += header.nodeCount * sizeof(SceneNodeDesc);
+	header.meshCount = (unsigned int)compiler.meshes.size();
+	header.meshOffset = offset;
+	offset += header.meshCount * sizeof(SceneMeshDesc);
+	header.materialCount = (unsigned int)compiler.materials.size();
+	header.materialOffset = offset;
+	offset += header.materialCount * sizeof(SceneMaterialDesc);
+	header.lightCount = (unsigned int)compiler.lights.size();
+	header.lightOffset = offset;
+	offset += header.lightCount * sizeof(SceneLightDesc);
+	header.stringSize = (unsigned int)compiler.strings.size();
+	header.stringOffset = offset;
+	header.fileSize = offset + header.stringSize;
+
+	image->assign(header.fileSize, 0);
+	char* out = image->data();
+	memcpy(out, &header, sizeof(header));
+	memcpy(out + header.nodeOffset, compiler.nodes.data(), header.nodeCount * sizeof(SceneNodeDesc));
+	memcpy(out + header.meshOffset, compiler.meshes.data(), header.meshCount * sizeof(SceneMeshDesc));
+	memcpy(out + header.materialOffset, compiler.materials.data(), header.materialCount * sizeof(SceneMaterialDesc));
+	memcpy(out + header.lightOffset, compiler.lights.data(), header.lightCount * sizeof(SceneLightDesc));
+	memcpy(out + header.stringOffset, compiler.strings.data(), header.stringSize);
+}
+
+void compileSceneText(const char* path, vector<char>* image)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "*** Error opening scene file: " << path << endl;
+		exit(1);
+	}
+	compileSceneStream(file, path, image);
+}
+
+bool writeSceneBinary(const char* path, const vector<char>& image)
+{
+	ofstream file(path, ios::out | ios::binary | ios::trunc);
+	if (!file) return false;
+	file.write(image.data(), image.size());
+	return (bool)file;
+}
+
+bool sceneSectionFits(unsigned int offset, unsigned int count, size_t recordSize, size_t size)
+{
+	return offset % 4 == 0 && offset <= size && count <= (size - offset) / recordSize;
+}
+
+// Points the scene's arrays into an image after checking that every
+// section and string offset lies inside it.
+bool bindSceneImage(SceneFile* scene, const char* data, size_t size)
+{
+	const SceneFileHeader* h = (const SceneFileHeader*)data;
+	if (size < sizeof(SceneFileHeader) || h->magic != SCENE_MAGIC || h->version != SCENE_VERSION || h->fileSize != size) return false;
+	if (!sceneSectionFits(h->nodeOffset, h->nodeCount, sizeof(SceneNodeDesc), size)
+		|| !sceneSectionFits(h->meshOffset, h->meshCount, sizeof(SceneMeshDesc), size)
+		|| !sceneSectionFits(h->materialOffset, h->materialCount, sizeof(SceneMaterialDesc), size)
+		|| !sceneSectionFits(h->lightOffset, h->lightCount, sizeof(SceneLightDesc), size)
+		|| !sceneSectionFits(h->stringOffset, h->stringSize, 1, size)
+		|| h->stringSize == 0 || data[h->stringOffset + h->stringSize - 1] != 0) return false;
+
+	scene->header = h;
+	scene->nodes = (const SceneNodeDesc*)(data + h->nodeOffset);
+	scene->meshes = (const SceneMeshDesc*)(data + h->meshOffset);
+	scene->materials = (const SceneMaterialDesc*)(data + h->materialOffset);
+	scene->lights = (const SceneLightDesc*)(data + h->lightOffset);
+	scene->strings = data + h->stringOffset;
+
+	for (unsigned int i = 0; i < h->nodeCount; i++)
+	{
+		const SceneNodeDesc& n = scene->nodes[i];
+		if (n.name >= h->stringSize || n.parent < -1 || n.parent >= (int)i) return false;
+		if (!sceneParamsError(SCENE_SECTION_NODE, n.type, n.params).empty()) return false;
+	}
+	for (unsigned int i = 0; i < h->meshCount; i++)
+	{
+		const SceneMeshDesc& m = scene->meshes[i];
+		if (m.name >= h->stringSize || !sceneParamsError(SCENE_SECTION_MESH, m.type, m.params).empty()) return false;
+	}
+	for (unsigned int i = 0; i < h->materialCount; i++)
+	{
+		const SceneMaterialDesc& m = scene->materials[i];
+		if (m.name >= h->stringSize || m.path >= h->stringSize) return false;
+		if (!sceneParamsError(SCENE_SECTION_MATERIAL, 0, m.params).empty()) return false;
+	}
+	for (unsigned int i = 0; i < h->lightCount; i++)
+	{
+		if (scene->lights[i].name >= h->stringSize) return false;
+	}
+	return true;
+}
+
+bool mapSceneFile(SceneFile* scene, const char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SceneFileHeader))
+	{
+		close(fd);
+		return false;
+	}
+	void* mapping = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return false;
+
+	if (!bindSceneImage(scene, (const char*)mapping, st.st_size))
+	{
+		munmap(mapping, st.st_size);
+		return false;
+	}
+	scene->mapping = mapping;
+	scene->mappingSize = st.st_size;
+	return true;
+}
+
+void closeSceneFile(SceneFile* scene)
+{
+	if (scene->mapping) munmap(scene->mapping, scene->mappingSize);
+	scene->mapping = 0;
+	scene->image.clear();
+}
+
+// Loads a scene by path. A .bin file is mapped directly. A text scene is
+// compiled to '<path>.bin' whenever that is missing or older than the
+// text, then mapped; if it cannot be written the in-memory image is used.
+void loadSceneFile(SceneFile* scene, const char* path)
+{
+	auto start = chrono::steady_clock::now();
+	scene->mapping = 0;
+
+	string binaryPath = path;
+	size_t length = binaryPath.size();
+	bool isBinary = length > 4 && binaryPath.compare(length - 4, 4, ".bin") == 0;
+	if (!isBinary)
+	{
+		binaryPath += ".bin";
+		struct stat text, binary;
+		if (stat(path, &text) != 0)
+		{
+			cout << "*** Error opening scene file: " << path << endl;
+			exit(1);
+		}
+		bool stale = stat(binaryPath.c_str(), &binary) != 0 || binary.st_mtime <= text.st_mtime;
+		if (stale || !mapSceneFile(scene, binaryPath.c_str()))
+		{
+			compileSceneText(path, &scene->image);
+			if (!writeSceneBinary(binaryPath.c_str(), scene->image) || !mapSceneFile(scene, binaryPath.c_str()))
+			{
+				bindSceneImage(scene, scene->image.data(), scene->image.size());
+			}
+		}
+	}
+	else if (!mapSceneFile(scene, path))
+	{
+		cout << "*** Invalid scene file: " << path << endl;
+		exit(1);
+	}
+	if (scene->mapping) scene->image.clear();
+
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	cout << "scene: " << scene->header->nodeCount << " nodes, " << scene->header->meshCount << " meshes, "
+		<< scene->header->materialCount << " materials, " << scene->header->lightCount << " lights ("
+		<< (scene->mapping ? "mapped" : "compiled") << " in " << ms << " ms)" << endl;
+}
+
+// Compiles scene text held in memory, e.g. a generated scene
+void loadSceneText(SceneFile* scene, const string& text, const char* name)
+{
+	istringstream stream(text);
+	scene->mapping = 0;
+	compileSceneStream(stream, name, &scene->image);
+	bindSceneImage(scene, scene->image.data(), scene->image.size());
+}
+
+inline const char* sceneString(const SceneFile* scene, unsigned int offset)
+{
+	return scene->strings + offset;
+}
+
+const SceneMeshDesc* findSceneMesh(const SceneFile* scene, const char* name)
+{
+	for (unsigned int i = 0; i < scene->header->meshCount; i++)
+	{
+		if (strcmp(sceneString(scene, scene->meshes[i].name), name) == 0) return &scene->meshes[i];
+	}
+	cout << "*** Scene has no mesh named: " << name << endl;
+	exit(1);
+}
+
+// Index of the named material, or -1
+int lookupSceneMaterial(const SceneFile* scene, const char* name)
+{
+	for (unsigned int i = 0; i < scene->header->materialCount; i++)
+	{
+		if (strcmp(sceneString(scene, scene->materials[i].name), name) == 0) return i;
+	}
+	return -1;
+}
+
+int findSceneMaterial(const SceneFile* scene, const char* name)
+{
+	int material = lookupSceneMaterial(scene, name);
+	if (material >= 0) return material;
+	cout << "*** Scene has no material named: " << name << endl;
+	exit(1);
+}
+
+// Tool entry point: writes the binary form of a text scene
+void compileSceneFile(const char* textPath, const char* binaryPath)
+{
+	vector<char> image;
+	compileSceneText(textPath, &image);
+	if (!writeSceneBinary(binaryPath, image))
+	{
+		cout << "*** Error writing scene file: " << binaryPath << endl;
+		exit(1);
+	}
+	SceneFile scene;
+	bindSceneImage(&scene, image.data(), image.size());
+	cout << binaryPath << ": " << image.size() << " bytes, " << scene.header->nodeCount << " nodes" << endl;
+}
+
+#endif
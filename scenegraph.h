@@ -0,0 +1,134 @@
+//=====================================================================
+// SceneGraph.h
+// Flattened transform hierarchy with cached world matrices.
+// Nodes are stored in arrays with every parent before its children,
+// so one linear pass updates the whole graph. Only nodes whose local
+// transform changed, and their descendants, are recomputed. Each node
+// also carries a bounding sphere that is transformed into world space
+// alongside its matrix, for frustum culling.
+//=====================================================================
+
+#if !defined(H_SCENEGRAPH)
+#define H_SCENEGRAPH
+
+#include <vector>
+#include "vecmath.h"
+using namespace std;
+
+typedef struct {
+	vector<int> parent;				// -1 for roots
+	vector<Mat4> local;
+	vector<Mat4> world;
+	vector<Vec3> boundsCentre;		// local space
+	vector<float> boundsRadius;		// 0 = no geometry of its own
+	vector<Vec3> worldCentre;
+	vector<float> worldRadius;
+	vector<unsigned char> dirty;	// local transform changed since the last update
+	int lastUpdated;				// nodes recomputed by the last update, for diagnostics
+} SceneGraph;
+
+typedef struct {
+	Vec4 planes[6];		// ax + by + cz + d >= 0 inside, normals unit length
+} Frustum;
+
+// Parents must be added before their children.
+int addSceneNode(SceneGraph* graph, int parent, const Mat4& local, Vec3 centre, float radius)
+{
+	int index = (int)graph->parent.size();
+	graph->parent.push_back(parent);
+	graph->local.push_back(local);
+	graph->world.push_back(mat4Identity());
+	graph->boundsCentre.push_back(centre);
+	graph->boundsRadius.push_back(radius);
+	graph->worldCentre.push_back(centre);
+	graph->worldRadius.push_back(radius);
+	graph->dirty.push_back(1);
+	return index;
+}
+
+int addSceneNode(SceneGraph* graph, int parent, const Mat4& local)
+{
+	return addSceneNode(graph, parent, local, vec3(0, 0, 0), 0);
+}
+
+void setLocalTransform(SceneGraph* graph, int node, const Mat4& local)
+{
+	graph->local[node] = local;
+	graph->dirty[node] = 1;
+}
+
+// Recomputes world matrices and bounds for dirty nodes and everything
+// below them. A node is recomputed when it or its parent changed; the
+// flag is carried down by marking recomputed nodes until the pass ends.
+void updateSceneGraph(SceneGraph* graph)
+{
+	int count = (int)graph->parent.size();
+	int updated = 0;
+	for (int i = 0; i < count; i++)
+	{
+		int p = graph->parent[i];
+		if (p >= 0 && graph->dirty[p]) graph->dirty[i] = 1;
+		if (!graph->dirty[i]) continue;
+
+		graph->world[i] = p >= 0 ? graph->world[p] * graph->local[i] : graph->local[i];
+
+		// Radius grows with the largest axis scale of the world matrix
+		const float* m = graph->world[i].m;
+		float sx = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+		float sy = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+		float sz = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+		graph->worldCentre[i] = transformPoint(graph->world[i], graph->boundsCentre[i]);
+		graph->worldRadius[i] = graph->boundsRadius[i] * sqrtf(maxf(sx, maxf(sy, sz)));
+		updated++;
+	}
+
+	// Children have already been visited, so the flags can be cleared
+	for (int i = 0; i < count; i++)
+	{
+		graph->dirty[i] = 0;
+	}
+	graph->lastUpdated = updated;
+}
+
+inline const Mat4& worldMatrix(const SceneGraph* graph, int node)
+{
+	return graph->world[node];
+}
+
+// Gribb-Hartmann plane extraction from a projection * view matrix
+Frustum frustumFromMatrix(const Mat4& viewProjection)
+{
+	const float* m = viewProjection.m;
+	Frustum f;
+	for (int i = 0; i < 3; i++)
+	{
+		// Rows are strided by 4 in column-major storage
+		f.planes[i * 2] = vec4(m[3] + m[i], m[7] + m[4 + i], m[11] + m[8 + i], m[15] + m[12 + i]);
+		f.planes[i * 2 + 1] = vec4(m[3] - m[i], m[7] - m[4 + i], m[11] - m[8 + i], m[15] - m[12 + i]);
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		float len = length(xyz(f.planes[i]));
+		f.planes[i] = f.planes[i] * (1 / len);
+	}
+	return f;
+}
+
+bool sphereInFrustum(const Frustum* frustum, Vec3 centre, float radius)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const Vec4& p = frustum->planes[i];
+		if (p.x * centre.x + p.y * centre.y + p.z * centre.z + p.w < -radius) return false;
+	}
+	return true;
+}
+
+// Nodes without bounds of their own are never culled
+bool isNodeVisible(const SceneGraph* graph, int node, const Frustum* frustum)
+{
+	if (graph->boundsRadius[node] <= 0) return true;
+	return sphereInFrustum(frustum, graph->worldCentre[node], graph->worldRadius[node]);
+}
+
+#endif
@@ -0,0 +1,293 @@
+//=====================================================================
+// VecMathTest.cpp
+// Checks VecMath.h against the references it claims to match: libm for
+// sin/cos, OpenGL's own matrices for the glRotatef, gluLookAt and
+// gluPerspective conventions (read back from a headless context), and
+// plain scalar loops for the four-wide products. Build it once per f4
+// backend; 'make test' builds the native one and the scalar one.
+// Exits non-zero if any check fails.
+//=====================================================================
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <iostream>
+#include <math.h>
+#include <GL/glu.h>
+#include "../vecmath.h"
+#include "../headless.h"
+using namespace std;
+
+#if defined(VECMATH_SSE)
+#define BACKEND "sse"
+#elif defined(VECMATH_NEON)
+#define BACKEND "neon"
+#else
+#define BACKEND "scalar"
+#endif
+
+int checks = 0;
+int failures = 0;
+
+// Records one comparison; prints the first few failures of each kind
+void check(const char* what, float value, float expected, float tolerance)
+{
+	checks++;
+	if (fabsf(value - expected) <= tolerance) return;
+	if (failures++ < 20) cout << "*** FAIL " << what << ": " << value << ", expected " << expected << endl;
+}
+
+void checkVec3(const char* what, Vec3 value, Vec3 expected, float tolerance)
+{
+	check(what, value.x, expected.x, tolerance);
+	check(what, value.y, expected.y, tolerance);
+	check(what, value.z, expected.z, tolerance);
+}
+
+void checkMat4(const char* what, const Mat4& value, const float* expected, float tolerance)
+{
+	for (int i = 0; i < 16; i++) check(what, value.m[i], expected[i], tolerance);
+}
+
+// Deterministic values in [lo, hi)
+unsigned int randomState = 12345;
+float randomFloat(float lo, float hi)
+{
+	randomState = randomState * 1664525u + 1013904223u;
+	return lo + (hi - lo) * ((randomState >> 8) / 16777216.0f);
+}
+
+Vec3 randomAxis()
+{
+	Vec3 v;
+	do v = vec3(randomFloat(-1, 1), randomFloat(-1, 1), randomFloat(-1, 1)); while (length(v) < 0.1f);
+	return normalize(v);
+}
+
+// The current matrix of 'mode' after running fn on an identity
+template <typename Fn>
+void glMatrix(GLenum mode, float* m, Fn fn)
+{
+	glMatrixMode(mode);
+	glLoadIdentity();
+	fn();
+	glGetFloatv(mode == GL_PROJECTION ? GL_PROJECTION_MATRIX : GL_MODELVIEW_MATRIX, m);
+}
+
+Vec3 glTransform(const float* m, Vec3 p)
+{
+	return vec3(m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+		m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+		m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+}
+
+// Scalar column-major product, the reference for the f4 ones
+Mat4 referenceMultiply(const Mat4& a, const Mat4& b)
+{
+	Mat4 r;
+	for (int c = 0; c < 4; c++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			double sum = 0;
+			for (int k = 0; k < 4; k++) sum += (double)a.m[k * 4 + row] * b.m[c * 4 + k];
+			r.m[c * 4 + row] = (float)sum;
+		}
+	}
+	return r;
+}
+
+Mat4 randomMatrix()
+{
+	Mat4 m;
+	for (int i = 0; i < 16; i++) m.m[i] = randomFloat(-10, 10);
+	return m;
+}
+
+void testSinCos()
+{
+	// The scalar form is libm's sincosf, so it should agree to rounding
+	for (int i = 0; i < 10000; i++)
+	{
+		float x = randomFloat(-100, 100), s, c;
+		sinCos(x, &s, &c);
+		check("sinCos sin", s, sinf(x), 1e-6f);
+		check("sinCos cos", c, cosf(x), 1e-6f);
+	}
+
+	// The four-wide polynomial on its own domain, including the ends and
+	// the fold at +-pi/2
+	float edges[8] = { -PI, -HALF_PI, -1e-7f, 0, 1e-7f, HALF_PI, PI, 3 };
+	for (int i = 0; i < 10000 + 2; i++)
+	{
+		float x[4];
+		for (int k = 0; k < 4; k++) x[k] = i < 2 ? edges[i * 4 + k] : randomFloat(-PI, PI);
+		f4 s, c;
+		sinCos(f4Load(x), &s, &c);
+		float ss[4], cc[4];
+		f4Store(ss, s);
+		f4Store(cc, c);
+		for (int k = 0; k < 4; k++)
+		{
+			check("sinCos(f4) sin", ss[k], sinf(x[k]), 2e-6f);
+			check("sinCos(f4) cos", cc[k], cosf(x[k]), 2e-6f);
+		}
+	}
+
+	// Every tail length, and arguments far from zero, where reducing by a
+	// float 2pi loses about one ulp of x
+	for (int count = 0; count <= 9; count++)
+	{
+		for (int range = 1; range <= 1000; range *= 10)
+		{
+			float x[9], s[9], c[9];
+			for (int i = 0; i < count; i++) x[i] = randomFloat(-(float)range, (float)range);
+			sinCosArray(x, s, c, count);
+			for (int i = 0; i < count; i++)
+			{
+				float tolerance = 2e-6f + fabsf(x[i]) * 1.2e-7f;
+				check("sinCosArray sin", s[i], sinf(x[i]), tolerance);
+				check("sinCosArray cos", c[i], cosf(x[i]), tolerance);
+			}
+		}
+	}
+}
+
+void testRotations()
+{
+	Vec3 axes[3] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) };
+	for (int i = 0; i < 200; i++)
+	{
+		float degrees = randomFloat(-720, 720);
+		Vec3 p = vec3(randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-10, 10));
+		for (int a = 0; a < 3; a++)
+		{
+			float m[16];
+			glMatrix(GL_MODELVIEW, m, [&]() { glRotatef(degrees, axes[a].x, axes[a].y, axes[a].z); });
+			Vec3 expected = glTransform(m, p);
+			Vec3 rotated = a == 0 ? rotateX(p, degrees) : (a == 1 ? rotateY(p, degrees) : rotateZ(p, degrees));
+			checkVec3("rotateX/Y/Z", rotated, expected, 1e-4f);
+			checkMat4("mat4Rotation (principal axis)", mat4Rotation(degrees, axes[a]), m, 1e-6f);
+		}
+
+		Vec3 axis = randomAxis();
+		float m[16];
+		glMatrix(GL_MODELVIEW, m, [&]() { glRotatef(degrees, axis.x, axis.y, axis.z); });
+		checkMat4("mat4Rotation", mat4Rotation(degrees, axis), m, 1e-5f);
+	}
+}
+
+void testQuaternions()
+{
+	for (int i = 0; i < 200; i++)
+	{
+		Vec3 axisA = randomAxis(), axisB = randomAxis();
+		float degreesA = randomFloat(-360, 360), degreesB = randomFloat(-360, 360);
+		Quat a = quatAxisAngle(axisA, degreesA), b = quatAxisAngle(axisB, degreesB);
+		Vec3 p = vec3(randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-10, 10));
+		Mat4 ra = mat4Rotation(degreesA, axisA), rb = mat4Rotation(degreesB, axisB);
+
+		checkVec3("rotate(quatAxisAngle)", rotate(a, p), transformDirection(ra, p), 1e-4f);
+		Quat ab = a * b;
+		checkVec3("quaternion product", rotate(ab, p), transformDirection(ra * rb, p), 1e-4f);
+		check("quaternion product length", sqrtf(ab.x * ab.x + ab.y * ab.y + ab.z * ab.z + ab.w * ab.w), 1, 1e-5f);
+
+		Quat scaled = { a.x * 3, a.y * 3, a.z * 3, a.w * 3 };
+		Quat n = normalize(scaled);
+		check("normalize", n.x, a.x, 1e-6f);
+		check("normalize", n.w, a.w, 1e-6f);
+
+		Vec3 t = vec3(randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-10, 10));
+		Mat4 expected = mat4Translation(t) * ra;
+		checkMat4("mat4FromQuat", mat4FromQuat(a, t), expected.m, 1e-5f);
+
+		// Slerp hits both ends and, along one axis, halves the angle
+		checkVec3("slerp t=0", rotate(slerp(a, b, 0), p), rotate(a, p), 1e-3f);
+		checkVec3("slerp t=1", rotate(slerp(a, b, 1), p), rotate(b, p), 1e-3f);
+		float degrees = randomFloat(-170, 170), tt = randomFloat(0, 1);
+		Quat halfway = slerp(quatIdentity(), quatAxisAngle(axisA, degrees), tt);
+		checkVec3("slerp", rotate(halfway, p), rotate(quatAxisAngle(axisA, degrees * tt), p), 1e-3f);
+	}
+}
+
+void testCamera()
+{
+	for (int i = 0; i < 200; i++)
+	{
+		Vec3 eye = vec3(randomFloat(-100, 100), randomFloat(-100, 100), randomFloat(-100, 100));
+		Vec3 centre = eye + randomAxis() * randomFloat(1, 50);
+		Vec3 up = randomAxis();
+		float m[16];
+		glMatrix(GL_MODELVIEW, m, [&]() { gluLookAt(eye.x, eye.y, eye.z, centre.x, centre.y, centre.z, up.x, up.y, up.z); });
+		// Translations are dot products with the eye, so scale by its size
+		checkMat4("mat4LookAt", mat4LookAt(eye, centre, up), m, 1e-5f * (1 + length(eye)));
+
+		float fovy = randomFloat(10, 120), aspect = randomFloat(0.5f, 2.5f);
+		float zNear = randomFloat(0.1f, 10), zFar = zNear + randomFloat(10, 10000);
+		glMatrix(GL_PROJECTION, m, [&]() { gluPerspective(fovy, aspect, zNear, zFar); });
+		Mat4 p = mat4Perspective(fovy, aspect, zNear, zFar);
+		for (int k = 0; k < 16; k++) check("mat4Perspective", p.m[k], m[k], 1e-5f * (1 + fabsf(m[k])));
+	}
+	glMatrixMode(GL_MODELVIEW);
+}
+
+void testBatches()
+{
+	// Counts around the four-wide width, and one large batch
+	int counts[6] = { 0, 1, 3, 4, 5, 1000 };
+	for (int n = 0; n < 6; n++)
+	{
+		int count = counts[n];
+		Mat4 m = randomMatrix();
+		vector<Vec3> points(count + 1), out(count + 1);
+		for (int i = 0; i < count; i++) points[i] = vec3(randomFloat(-10, 10), randomFloat(-10, 10), randomFloat(-10, 10));
+		transformPoints(m, points.data(), out.data(), count);
+		for (int i = 0; i < count; i++)
+		{
+			Vec3 p = points[i];
+			Vec3 expected = glTransform(m.m, p);
+			checkVec3("transformPoints", out[i], expected, 1e-3f);
+			checkVec3("transformPoint", transformPoint(m, p), expected, 1e-3f);
+			Vec4 v = m * vec4(p, 1);
+			checkVec3("Mat4 * Vec4", xyz(v), expected, 1e-3f);
+		}
+
+		vector<Mat4> local(count + 1), parents(3), result(count + 1);
+		vector<int> parentIndex(count + 1);
+		for (int i = 0; i < count; i++)
+		{
+			local[i] = randomMatrix();
+			parentIndex[i] = i % 3;
+		}
+		for (int i = 0; i < 3; i++) parents[i] = randomMatrix();
+
+		multiplyMatrices(m, local.data(), result.data(), count);
+		for (int i = 0; i < count; i++)
+		{
+			Mat4 expected = referenceMultiply(m, local[i]);
+			checkMat4("multiplyMatrices", result[i], expected.m, 1e-2f);
+			checkMat4("Mat4 * Mat4", m * local[i], expected.m, 1e-2f);
+		}
+		multiplyMatrices(parents.data(), parentIndex.data(), local.data(), result.data(), count);
+		for (int i = 0; i < count; i++)
+		{
+			Mat4 expected = referenceMultiply(parents[parentIndex[i]], local[i]);
+			checkMat4("multiplyMatrices (per-item parents)", result[i], expected.m, 1e-2f);
+		}
+	}
+}
+
+int main()
+{
+	HeadlessContext headless;
+	createHeadlessContext(&headless, 16, 16);
+
+	testSinCos();
+	testRotations();
+	testQuaternions();
+	testCamera();
+	testBatches();
+
+	destroyHeadlessContext(&headless);
+	cout << "vecmath (" << BACKEND << "): " << checks << " checks, " << failures << " failed" << endl;
+	return failures > 0 ? 1 : 0;
+}
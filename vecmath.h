@@ -0,0 +1,605 @@
+//=====================================================================
+// VecMath.h
+// Small vector math library: Vec3, Vec4, Mat4 (column-major, as used
+// by OpenGL) and Quat, plus scalar helpers that evaluate their
+// arguments once. Four-wide operations go through the f4 type, which
+// maps to SSE on x86, NEON on ARM and plain floats elsewhere, so the
+// matrix, sin/cos and batched transform routines are written once.
+// Defining VECMATH_SCALAR before the include forces the plain float
+// backend, so it can be tested on machines that have SIMD.
+//=====================================================================
+
+#if !defined(H_VECMATH)
+#define H_VECMATH
+
+#include <iostream>
+#include <chrono>
+#include <string.h>
+#include <math.h>
+using namespace std;
+
+#if defined(VECMATH_SCALAR)
+#elif defined(__SSE2__) || defined(_M_X64)
+#define VECMATH_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define VECMATH_NEON
+#include <arm_neon.h>
+#endif
+
+constexpr float PI = 3.14159265358979f;
+constexpr float TWO_PI = 2 * PI;
+constexpr float HALF_PI = PI / 2;
+constexpr float INV_TWO_PI = 1 / TWO_PI;
+constexpr float DEG_TO_RAD = PI / 180;
+constexpr float RAD_TO_DEG = 180 / PI;
+
+inline constexpr float deg2rad(float deg) { return deg * DEG_TO_RAD; }
+inline constexpr float rad2deg(float rad) { return rad * RAD_TO_DEG; }
+inline float minf(float a, float b) { return a < b ? a : b; }
+inline float maxf(float a, float b) { return a > b ? a : b; }
+inline float clampf(float val, float lo, float hi) { return val < lo ? lo : (val > hi ? hi : val); }
+
+//-- Four-wide backend ----------------------------------------------------
+#if defined(VECMATH_SSE)
+typedef __m128 f4;
+inline f4 f4Load(const float* p) { return _mm_loadu_ps(p); }
+inline void f4Store(float* p, f4 a) { _mm_storeu_ps(p, a); }
+inline f4 f4Splat(float x) { return _mm_set1_ps(x); }
+inline f4 f4Add(f4 a, f4 b) { return _mm_add_ps(a, b); }
+inline f4 f4Sub(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+inline f4 f4Mul(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+inline f4 f4Madd(f4 a, f4 b, f4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline f4 f4Abs(f4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline f4 f4Round(f4 a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }	// nearest, |a| < 2^31
+inline f4 f4Sign(f4 a) { return _mm_and_ps(_mm_set1_ps(-0.0f), a); }	// sign bits only
+inline f4 f4Xor(f4 a, f4 b) { return _mm_xor_ps(a, b); }
+inline f4 f4Or(f4 a, f4 b) { return _mm_or_ps(a, b); }
+inline f4 f4And(f4 a, f4 b) { return _mm_and_ps(a, b); }
+inline f4 f4Greater(f4 a, f4 b) { return _mm_cmpgt_ps(a, b); }
+inline f4 f4GreaterEqual(f4 a, f4 b) { return _mm_cmpge_ps(a, b); }
+inline f4 f4Select(f4 mask, f4 a, f4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+inline f4 f4Lane(f4 a, int i)
+{
+	switch (i)
+	{
+		case 0: return _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0));
+		case 1: return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1));
+		case 2: return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2));
+		default: return _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+}
+inline void f4Transpose(f4& r0, f4& r1, f4& r2, f4& r3) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+#elif defined(VECMATH_NEON)
+typedef float32x4_t f4;
+inline f4 f4Load(const float* p) { return vld1q_f32(p); }
+inline void f4Store(float* p, f4 a) { vst1q_f32(p, a); }
+inline f4 f4Splat(float x) { return vdupq_n_f32(x); }
+inline f4 f4Add(f4 a, f4 b) { return vaddq_f32(a, b); }
+inline f4 f4Sub(f4 a, f4 b) { return vsubq_f32(a, b); }
+inline f4 f4Mul(f4 a, f4 b) { return vmulq_f32(a, b); }
+inline f4 f4Madd(f4 a, f4 b, f4 c) { return vmlaq_f32(c, a, b); }
+inline f4 f4Abs(f4 a) { return vabsq_f32(a); }
+inline f4 f4Round(f4 a) { return vrndnq_f32(a); }
+inline f4 f4Sign(f4 a) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x80000000))); }
+inline f4 f4Xor(f4 a, f4 b) { return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+inline f4 f4Or(f4 a, f4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+inline f4 f4And(f4 a, f4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+inline f4 f4Greater(f4 a, f4 b) { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+inline f4 f4GreaterEqual(f4 a, f4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline f4 f4Select(f4 mask, f4 a, f4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+inline f4 f4Lane(f4 a, int i)
+{
+	float lanes[4];
+	vst1q_f32(lanes, a);
+	return vdupq_n_f32(lanes[i]);
+}
+inline void f4Transpose(f4& r0, f4& r1, f4& r2, f4& r3)
+{
+	float32x4x2_t t01 = vtrnq_f32(r0, r1);
+	float32x4x2_t t23 = vtrnq_f32(r2, r3);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#else
+typedef struct { float v[4]; } f4;
+inline f4 f4Load(const float* p) { f4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+inline void f4Store(float* p, f4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+inline f4 f4Splat(float x) { f4 r = { { x, x, x, x } }; return r; }
+#define VECMATH_F4_OP(name, expr) \
+	inline f4 name(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; i++) { float x = a.v[i], y = b.v[i]; r.v[i] = (expr); } return r; }
+#define VECMATH_F4_BITS(name, op) \
+	inline f4 name(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; i++) { unsigned int x, y; memcpy(&x, &a.v[i], 4); memcpy(&y, &b.v[i], 4); x = x op y; memcpy(&r.v[i], &x, 4); } return r; }
+VECMATH_F4_OP(f4Add, x + y)
+VECMATH_F4_OP(f4Sub, x - y)
+VECMATH_F4_OP(f4Mul, x * y)
+VECMATH_F4_BITS(f4Xor, ^)
+VECMATH_F4_BITS(f4Or, |)
+VECMATH_F4_BITS(f4And, &)
+inline f4 f4Mask(bool b) { unsigned int m = b ? 0xFFFFFFFF : 0; float f; memcpy(&f, &m, 4); return f4Splat(f); }
+inline f4 f4Greater(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = f4Mask(a.v[i] > b.v[i]).v[0]; return r; }
+inline f4 f4GreaterEqual(f4 a, f4 b) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = f4Mask(a.v[i] >= b.v[i]).v[0]; return r; }
+inline f4 f4Madd(f4 a, f4 b, f4 c) { return f4Add(f4Mul(a, b), c); }
+inline f4 f4Abs(f4 a) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = fabsf(a.v[i]); return r; }
+inline f4 f4Round(f4 a) { f4 r; for (int i = 0; i < 4; i++) r.v[i] = nearbyintf(a.v[i]); return r; }
+inline f4 f4Sign(f4 a) { return f4And(a, f4Splat(-0.0f)); }
+inline f4 f4Select(f4 mask, f4 a, f4 b)
+{
+	f4 r;
+	for (int i = 0; i < 4; i++)
+	{
+		unsigned int m;
+		memcpy(&m, &mask.v[i], 4);
+		r.v[i] = m ? a.v[i] : b.v[i];
+	}
+	return r;
+}
+inline f4 f4Lane(f4 a, int i) { return f4Splat(a.v[i]); }
+inline void f4Transpose(f4& r0, f4& r1, f4& r2, f4& r3)
+{
+	f4* rows[4] = { &r0, &r1, &r2, &r3 };
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = i + 1; j < 4; j++)
+		{
+			float t = rows[i]->v[j];
+			rows[i]->v[j] = rows[j]->v[i];
+			rows[j]->v[i] = t;
+		}
+	}
+}
+#undef VECMATH_F4_OP
+#undef VECMATH_F4_BITS
+#endif
+
+//-- Fused sine and cosine -------------------------------------------------
+// One call computes both, so the argument reduction is shared. The scalar
+// form uses the C library's sincosf, which is hard to beat one value at a
+// time; the four-wide form below is for batched work.
+inline void sinCos(float x, float* s, float* c)
+{
+#if defined(__GNUC__)
+	__builtin_sincosf(x, s, c);
+#else
+	*s = sinf(x);
+	*c = cosf(x);
+#endif
+}
+
+// Arguments are folded into [-pi/2, pi/2], where short odd/even
+// polynomials are accurate to about 1e-6, without branches.
+// Four-wide version for arguments already in [-pi, pi]
+inline void sinCos(f4 x, f4* s, f4* c)
+{
+	const f4 pi = f4Splat(PI);
+	const f4 one = f4Splat(1);
+	f4 sign = f4Sign(x);
+	f4 fold = f4Greater(f4Abs(x), f4Splat(HALF_PI));
+	x = f4Select(fold, f4Sub(f4Or(pi, sign), x), x);
+	f4 x2 = f4Mul(x, x);
+
+	f4 ps = f4Sub(f4Splat(1 / 362880.0f), f4Mul(x2, f4Splat(1 / 39916800.0f)));
+	ps = f4Sub(f4Splat(1 / 5040.0f), f4Mul(x2, ps));
+	ps = f4Sub(f4Splat(1 / 120.0f), f4Mul(x2, ps));
+	ps = f4Sub(f4Splat(1 / 6.0f), f4Mul(x2, ps));
+	*s = f4Mul(x, f4Sub(one, f4Mul(x2, ps)));
+
+	f4 pc = f4Sub(f4Splat(1 / 40320.0f), f4Mul(x2, f4Splat(1 / 3628800.0f)));
+	pc = f4Sub(f4Splat(1 / 720.0f), f4Mul(x2, pc));
+	pc = f4Sub(f4Splat(1 / 24.0f), f4Mul(x2, pc));
+	pc = f4Sub(f4Splat(1 / 2.0f), f4Mul(x2, pc));
+	*c = f4Xor(f4Sub(one, f4Mul(x2, pc)), f4And(fold, f4Splat(-0.0f)));
+}
+
+// s[i], c[i] = sin(x[i]), cos(x[i]) for any finite x
+void sinCosArray(const float* x, float* s, float* c, int count)
+{
+	const f4 twoPi = f4Splat(TWO_PI);
+	const f4 invTwoPi = f4Splat(INV_TWO_PI);
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// Reduce to [-pi, pi] by subtracting the nearest multiple of 2pi
+		f4 v = f4Load(x + i);
+		v = f4Sub(v, f4Mul(f4Round(f4Mul(v, invTwoPi)), twoPi));
+
+		f4 vs, vc;
+		sinCos(v, &vs, &vc);
+		f4Store(s + i, vs);
+		f4Store(c + i, vc);
+	}
+	for (; i < count; i++)
+	{
+		sinCos(x[i], &s[i], &c[i]);
+	}
+}
+
+//-- Vec3 ---------------------------------------------------------------
+typedef struct {
+	float x, y, z;
+} Vec3;
+
+inline Vec3 vec3(float x, float y, float z) { Vec3 r = { x, y, z }; return r; }
+inline Vec3 operator+(Vec3 a, Vec3 b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline Vec3 operator-(Vec3 a, Vec3 b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline Vec3 operator-(Vec3 a) { return vec3(-a.x, -a.y, -a.z); }
+inline Vec3 operator*(Vec3 a, float s) { return vec3(a.x * s, a.y * s, a.z * s); }
+inline Vec3 operator*(float s, Vec3 a) { return a * s; }
+inline Vec3 operator*(Vec3 a, Vec3 b) { return vec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+inline Vec3& operator+=(Vec3& a, Vec3 b) { a = a + b; return a; }
+inline Vec3& operator-=(Vec3& a, Vec3 b) { a = a - b; return a; }
+inline Vec3& operator*=(Vec3& a, float s) { a = a * s; return a; }
+inline float dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vec3 cross(Vec3 a, Vec3 b) { return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float length(Vec3 a) { return sqrtf(dot(a, a)); }
+inline Vec3 vmin(Vec3 a, Vec3 b) { return vec3(minf(a.x, b.x), minf(a.y, b.y), minf(a.z, b.z)); }
+inline Vec3 vmax(Vec3 a, Vec3 b) { return vec3(maxf(a.x, b.x), maxf(a.y, b.y), maxf(a.z, b.z)); }
+inline Vec3 normalize(Vec3 a)
+{
+	float len = length(a);
+	return len > 0 ? a * (1 / len) : a;
+}
+
+// Rotations by an angle in degrees, following the glRotatef convention
+inline Vec3 rotateX(Vec3 v, float degrees)
+{
+	float s, c;
+	sinCos(deg2rad(degrees), &s, &c);
+	return vec3(v.x, c * v.y - s * v.z, s * v.y + c * v.z);
+}
+
+inline Vec3 rotateY(Vec3 v, float degrees)
+{
+	float s, c;
+	sinCos(deg2rad(degrees), &s, &c);
+	return vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+}
+
+inline Vec3 rotateZ(Vec3 v, float degrees)
+{
+	float s, c;
+	sinCos(deg2rad(degrees), &s, &c);
+	return vec3(c * v.x - s * v.y, s * v.x + c * v.y, v.z);
+}
+
+//-- Vec4 ---------------------------------------------------------------
+typedef struct alignas(16) {
+	float x, y, z, w;
+} Vec4;
+
+inline Vec4 vec4(float x, float y, float z, float w) { Vec4 r = { x, y, z, w }; return r; }
+inline Vec4 vec4(Vec3 v, float w) { return vec4(v.x, v.y, v.z, w); }
+inline Vec3 xyz(Vec4 v) { return vec3(v.x, v.y, v.z); }
+inline f4 f4Load(const Vec4& v) { return f4Load(&v.x); }
+inline Vec4 toVec4(f4 a) { Vec4 r; f4Store(&r.x, a); return r; }
+inline Vec4 operator+(const Vec4& a, const Vec4& b) { return toVec4(f4Add(f4Load(a), f4Load(b))); }
+inline Vec4 operator-(const Vec4& a, const Vec4& b) { return toVec4(f4Sub(f4Load(a), f4Load(b))); }
+inline Vec4 operator*(const Vec4& a, float s) { return toVec4(f4Mul(f4Load(a), f4Splat(s))); }
+inline float dot(const Vec4& a, const Vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+//-- Mat4 ---------------------------------------------------------------
+// Column-major: m[column * 4 + row], directly usable with glMultMatrixf
+typedef struct alignas(16) {
+	float m[16];
+} Mat4;
+
+inline Mat4 mat4Identity()
+{
+	Mat4 r = { { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 } };
+	return r;
+}
+
+inline Mat4 mat4Translation(Vec3 t)
+{
+	Mat4 r = mat4Identity();
+	r.m[12] = t.x; r.m[13] = t.y; r.m[14] = t.z;
+	return r;
+}
+
+inline Mat4 mat4Scale(Vec3 s)
+{
+	Mat4 r = mat4Identity();
+	r.m[0] = s.x; r.m[5] = s.y; r.m[10] = s.z;
+	return r;
+}
+
+// Rotation of 'degrees' about a unit axis, as glRotatef
+inline Mat4 mat4Rotation(float degrees, Vec3 axis)
+{
+	float s, c;
+	sinCos(deg2rad(degrees), &s, &c);
+	float t = 1 - c;
+	float x = axis.x, y = axis.y, z = axis.z;
+	Mat4 r = { {
+		t * x * x + c,     t * x * y + s * z, t * x * z - s * y, 0,
+		t * x * y - s * z, t * y * y + c,     t * y * z + s * x, 0,
+		t * x * z + s * y, t * y * z - s * x, t * z * z + c,     0,
+		0, 0, 0, 1
+	} };
+	return r;
+}
+
+// Each column of the product is a combination of a's columns
+inline f4 mat4Column(const f4* aColumns, f4 bColumn)
+{
+	f4 r = f4Mul(aColumns[0], f4Lane(bColumn, 0));
+	r = f4Madd(aColumns[1], f4Lane(bColumn, 1), r);
+	r = f4Madd(aColumns[2], f4Lane(bColumn, 2), r);
+	return f4Madd(aColumns[3], f4Lane(bColumn, 3), r);
+}
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b)
+{
+	f4 columns[4] = { f4Load(a.m), f4Load(a.m + 4), f4Load(a.m + 8), f4Load(a.m + 12) };
+	Mat4 r;
+	for (int i = 0; i < 4; i++)
+	{
+		f4Store(r.m + i * 4, mat4Column(columns, f4Load(b.m + i * 4)));
+	}
+	return r;
+}
+
+inline Vec4 operator*(const Mat4& a, const Vec4& v)
+{
+	f4 columns[4] = { f4Load(a.m), f4Load(a.m + 4), f4Load(a.m + 8), f4Load(a.m + 12) };
+	return toVec4(mat4Column(columns, f4Load(v)));
+}
+
+inline Vec3 transformPoint(const Mat4& a, Vec3 p)
+{
+	return vec3(a.m[0] * p.x + a.m[4] * p.y + a.m[8] * p.z + a.m[12],
+		a.m[1] * p.x + a.m[5] * p.y + a.m[9] * p.z + a.m[13],
+		a.m[2] * p.x + a.m[6] * p.y + a.m[10] * p.z + a.m[14]);
+}
+
+inline Vec3 transformDirection(const Mat4& a, Vec3 d)
+{
+	return vec3(a.m[0] * d.x + a.m[4] * d.y + a.m[8] * d.z,
+		a.m[1] * d.x + a.m[5] * d.y + a.m[9] * d.z,
+		a.m[2] * d.x + a.m[6] * d.y + a.m[10] * d.z);
+}
+
+inline Vec3 mat4GetTranslation(const Mat4& a) { return vec3(a.m[12], a.m[13], a.m[14]); }
+
+// Inverse of a rotation + translation (no scale)
+inline Mat4 mat4RigidInverse(const Mat4& a)
+{
+	Mat4 r = mat4Identity();
+	for (int c = 0; c < 3; c++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			r.m[c * 4 + row] = a.m[row * 4 + c];
+		}
+	}
+	Vec3 t = transformDirection(r, mat4GetTranslation(a));
+	r.m[12] = -t.x; r.m[13] = -t.y; r.m[14] = -t.z;
+	return r;
+}
+
+// Same matrix as gluPerspective
+inline Mat4 mat4Perspective(float fovyDegrees, float aspect, float zNear, float zFar)
+{
+	float f = 1 / tanf(deg2rad(fovyDegrees) / 2);
+	Mat4 r = { {
+		f / aspect, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, (zFar + zNear) / (zNear - zFar), -1,
+		0, 0, (2 * zFar * zNear) / (zNear - zFar), 0
+	} };
+	return r;
+}
+
+// Same matrix as gluLookAt
+inline Mat4 mat4LookAt(Vec3 eye, Vec3 centre, Vec3 up)
+{
+	Vec3 f = normalize(centre - eye);
+	Vec3 s = normalize(cross(f, up));
+	Vec3 u = cross(s, f);
+	Mat4 r = { {
+		s.x, u.x, -f.x, 0,
+		s.y, u.y, -f.y, 0,
+		s.z, u.z, -f.z, 0,
+		-dot(s, eye), -dot(u, eye), dot(f, eye), 1
+	} };
+	return r;
+}
+
+//-- Quat ---------------------------------------------------------------
+typedef struct alignas(16) {
+	float x, y, z, w;
+} Quat;
+
+inline Quat quatIdentity() { Quat q = { 0, 0, 0, 1 }; return q; }
+
+inline Quat quatAxisAngle(Vec3 axis, float degrees)
+{
+	float s, c;
+	sinCos(deg2rad(degrees) / 2, &s, &c);
+	Quat q = { axis.x * s, axis.y * s, axis.z * s, c };
+	return q;
+}
+
+inline Quat operator*(Quat a, Quat b)
+{
+	Quat q = {
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+	};
+	return q;
+}
+
+inline Vec3 rotate(Quat q, Vec3 v)
+{
+	Vec3 u = vec3(q.x, q.y, q.z);
+	Vec3 t = 2 * cross(u, v);
+	return v + q.w * t + cross(u, t);
+}
+
+inline Quat normalize(Quat q)
+{
+	float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	Quat r = { q.x / len, q.y / len, q.z / len, q.w / len };
+	return r;
+}
+
+inline Quat slerp(Quat a, Quat b, float t)
+{
+	float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	if (d < 0) { b.x = -b.x; b.y = -b.y; b.z = -b.z; b.w = -b.w; d = -d; }
+	float wa = 1 - t, wb = t;
+	if (d < 0.9995f)
+	{
+		float theta = acosf(d);
+		float s = sinf(theta);
+		wa = sinf(wa * theta) / s;
+		wb = sinf(wb * theta) / s;
+	}
+	Quat q = { wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z, wa * a.w + wb * b.w };
+	return normalize(q);
+}
+
+inline Mat4 mat4FromQuat(Quat q, Vec3 translation)
+{
+	float x = q.x, y = q.y, z = q.z, w = q.w;
+	Mat4 r = { {
+		1 - 2 * (y * y + z * z), 2 * (x * y + z * w),     2 * (x * z - y * w),     0,
+		2 * (x * y - z * w),     1 - 2 * (x * x + z * z), 2 * (y * z + x * w),     0,
+		2 * (x * z + y * w),     2 * (y * z - x * w),     1 - 2 * (x * x + y * y), 0,
+		translation.x, translation.y, translation.z, 1
+	} };
+	return r;
+}
+
+//-- Batched transforms -------------------------------------------------
+// out[i] = m * in[i] for 'count' points
+void transformPoints(const Mat4& m, const Vec3* in, Vec3* out, int count)
+{
+	f4 c0 = f4Load(m.m), c1 = f4Load(m.m + 4), c2 = f4Load(m.m + 8), c3 = f4Load(m.m + 12);
+	float result[4];
+	for (int i = 0; i < count; i++)
+	{
+		f4 r = f4Madd(c0, f4Splat(in[i].x), c3);
+		r = f4Madd(c1, f4Splat(in[i].y), r);
+		r = f4Madd(c2, f4Splat(in[i].z), r);
+		f4Store(result, r);
+		out[i] = vec3(result[0], result[1], result[2]);
+	}
+}
+
+// out[i] = parent * local[i] for 'count' matrices
+void multiplyMatrices(const Mat4& parent, const Mat4* local, Mat4* out, int count)
+{
+	f4 columns[4] = { f4Load(parent.m), f4Load(parent.m + 4), f4Load(parent.m + 8), f4Load(parent.m + 12) };
+	for (int i = 0; i < count; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			f4Store(out[i].m + c * 4, mat4Column(columns, f4Load(local[i].m + c * 4)));
+		}
+	}
+}
+
+// out[i] = parents[parentIndex[i]] * local[i]; used when each matrix has
+// its own parent, as in a flattened hierarchy
+void multiplyMatrices(const Mat4* parents, const int* parentIndex, const Mat4* local, Mat4* out, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const Mat4& p = parents[parentIndex[i]];
+		f4 columns[4] = { f4Load(p.m), f4Load(p.m + 4), f4Load(p.m + 8), f4Load(p.m + 12) };
+		for (int c = 0; c < 4; c++)
+		{
+			f4Store(out[i].m + c * 4, mat4Column(columns, f4Load(local[i].m + c * 4)));
+		}
+	}
+}
+
+//-- Benchmarks ---------------------------------------------------------
+// Compares the library against the helpers it replaced: a Vector struct
+// rotated with four cosf/sinf calls and an atan(1) per deg2rad.
+void benchmarkMath(int count)
+{
+	typedef struct { float x, y, z; } LegacyVector;
+	#define LEGACY_DEG2RAD(deg) (deg * 4.0 * atan(1)) / 180
+	auto legacyRotateY = [](LegacyVector* vec, float rot)
+	{
+		LegacyVector newVec =
+		{
+			(float)((cosf(LEGACY_DEG2RAD(rot)) * vec->x) + (sinf(LEGACY_DEG2RAD(rot)) * vec->z)),
+			vec->y,
+			(float)(-(sinf(LEGACY_DEG2RAD(rot)) * vec->x) + (cosf(LEGACY_DEG2RAD(rot)) * vec->z)),
+		};
+		*vec = newVec;
+	};
+	#undef LEGACY_DEG2RAD
+
+	Vec3* points = new Vec3[count];
+	Vec3* results = new Vec3[count];
+	LegacyVector* legacy = new LegacyVector[count];
+	for (int i = 0; i < count; i++)
+	{
+		points[i] = vec3((float)(i % 97), (float)(i % 13), (float)(i % 31));
+		legacy[i] = { points[i].x, points[i].y, points[i].z };
+	}
+
+	auto time = [](auto fn)
+	{
+		auto start = chrono::steady_clock::now();
+		fn();
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	};
+
+	float* angles = new float[count];
+	float* sines = new float[count];
+	float* cosines = new float[count];
+	for (int i = 0; i < count; i++)
+	{
+		// Touch every output first so page faults are not timed
+		angles[i] = (float)(i % 720) * 0.01f;
+		sines[i] = cosines[i] = 0;
+		results[i] = points[i];
+	}
+	double legacySinCos = time([&]() { for (int i = 0; i < count; i++) { sines[i] = sinf(angles[i]); cosines[i] = cosf(angles[i]); } });
+	double batchSinCos = time([&]() { sinCosArray(angles, sines, cosines, count); });
+
+	double legacyRotate = time([&]() { for (int i = 0; i < count; i++) legacyRotateY(&legacy[i], (float)(i % 360)); });
+	double newRotate = time([&]() { for (int i = 0; i < count; i++) results[i] = rotateY(points[i], (float)(i % 360)); });
+
+	// Transform all points by a fixed matrix: per-point legacy rotation and
+	// translation versus one batched matrix pass
+	double legacyTransform = time([&]()
+	{
+		for (int i = 0; i < count; i++)
+		{
+			legacyRotateY(&legacy[i], 30);
+			legacy[i].x += 1; legacy[i].y += 2; legacy[i].z += 3;
+		}
+	});
+	Mat4 m = mat4Translation(vec3(1, 2, 3)) * mat4Rotation(30, vec3(0, 1, 0));
+	double batchTransform = time([&]() { transformPoints(m, points, results, count); });
+
+	float check = 0;
+	for (int i = 0; i < count; i += 997) check += results[i].x + legacy[i].x;
+
+	cout << "points: " << count << " (checksum " << check << ")" << endl;
+	cout << "sinf + cosf per element:  " << legacySinCos << " ms" << endl;
+	cout << "sinCosArray (batched):    " << batchSinCos << " ms" << endl;
+	cout << "rotateVectorY (legacy): " << legacyRotate << " ms" << endl;
+	cout << "rotateY:                " << newRotate << " ms" << endl;
+	cout << "per-point transform (legacy): " << legacyTransform << " ms" << endl;
+	cout << "transformPoints (batched):    " << batchTransform << " ms" << endl;
+
+	delete[] points;
+	delete[] results;
+	delete[] legacy;
+	delete[] angles;
+	delete[] sines;
+	delete[] cosines;
+}
+
+#endif